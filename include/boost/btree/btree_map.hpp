@@ -128,11 +128,38 @@ namespace boost
         return result;
       }
 
+      const_iterator emplace_hint(const_iterator hint, const Key& key,
+        const T& mapped_value)
+      {
+        std::pair<const_iterator, bool> result(this->m_insert_unique(hint, key));
+        if (result.second)
+          std::memcpy(const_cast<T*>(&result.first->second),
+            &mapped_value, sizeof(T));
+        return result.first;
+      }
+
+      const_iterator insert(const_iterator hint, const value_type& value)
+      {
+        return emplace_hint(hint, this->key(value), this->mapped(value));
+      }
+
+      //  insert_packed() is insert() tuned for values arriving in ascending order
+      std::pair<const_iterator, bool> insert_packed(const value_type& value)
+      {
+        std::pair<const_iterator, bool> result(
+          this->m_insert_unique(this->end(), this->key(value)));
+        if (result.second)
+          std::memcpy(const_cast<T*>(&result.first->second), &this->mapped(value), sizeof(T));
+        return result;
+      }
+
       template <class InputIterator>
       void insert(InputIterator begin, InputIterator end)
-      { 
-        for (; begin != end; ++begin) 
-          insert(*begin);
+      {
+        if (this->m_bulk_build_range(begin, end))
+          return;
+        for (; begin != end; ++begin)
+          insert_packed(*begin);
       }
 
       iterator writable(const_iterator itr)  {return this->m_write_cast(itr);}
@@ -209,8 +236,7 @@ namespace boost
         : btree_base<Key,btree_map_base<Key,T,Traits,Compare> >(p,
             flags::user_flags(flgs), sig, comp, node_sz)
       {
-        for (; begin != end; ++begin)
-          insert(*begin);
+        insert(begin, end);
       }
 
      ~btree_multimap()
@@ -244,11 +270,32 @@ namespace boost
         return result;          
       }
 
+      const_iterator emplace_hint(const_iterator hint, const Key& key,
+        const T& mapped_value)
+      {
+        const_iterator result(this->m_insert_non_unique(hint, key));
+        std::memcpy(const_cast<T*>(&result->second), &mapped_value, sizeof(T));
+        return result;          
+      }
+
+      const_iterator insert(const_iterator hint, const value_type& value)
+      {
+        return emplace_hint(hint, this->key(value), this->mapped(value));
+      }
+
+      //  insert_packed() is insert() tuned for values arriving in ascending order
+      const_iterator insert_packed(const value_type& value)
+      {
+        return emplace_hint(this->end(), this->key(value), this->mapped(value));
+      }
+
       template <class InputIterator>
       void insert(InputIterator begin, InputIterator end)
       {
+        if (this->m_bulk_build_range(begin, end))
+          return;
         for (; begin != end; ++begin)
-          insert(*begin);
+          insert_packed(*begin);
       }
 
       iterator writable(const_iterator itr)  {return m_write_cast(itr);}
@@ -181,11 +181,30 @@ namespace boost
         return this->m_insert_unique(value);
       }
 
+      const_iterator emplace_hint(const_iterator hint, const value_type& value)
+      {
+        return this->m_insert_unique(hint, value).first;
+      }
+
+      const_iterator insert(const_iterator hint, const value_type& value)
+      {
+        return this->m_insert_unique(hint, value).first;
+      }
+
+      //  insert_packed() is insert() tuned for values arriving in ascending order
+      std::pair<const_iterator, bool>
+      insert_packed(const value_type& value)
+      {
+        return this->m_insert_unique(this->end(), value);
+      }
+
       template <class InputIterator>
       void insert(InputIterator begin, InputIterator end)
       {
+        if (this->m_bulk_build_range(begin, end))
+          return;
         for (; begin != end; ++begin)
-          insert(*begin);
+          insert_packed(*begin);
       }
     };
 
@@ -254,8 +273,7 @@ namespace boost
       : btree_base<Key,btree_set_base<Key,Traits,Compare> >(p,
           flags::user_flags(flgs) | flags::key_only, sig, comp, node_sz)
       {
-        for (; begin != end; ++begin)
-          insert(*begin);
+        insert(begin, end);
       }
 
      ~btree_multiset()
@@ -285,12 +303,30 @@ namespace boost
         return this->m_insert_non_unique(value);
       }
 
+      const_iterator emplace_hint(const_iterator hint, const value_type& value)
+      {
+        return this->m_insert_non_unique(hint, value);
+      }
+
+      const_iterator insert(const_iterator hint, const value_type& value)
+      {
+        return this->m_insert_non_unique(hint, value);
+      }
+
+      //  insert_packed() is insert() tuned for values arriving in ascending order
+      const_iterator insert_packed(const value_type& value)
+      {
+        return this->m_insert_non_unique(this->end(), value);
+      }
+
       template <class InputIterator>
       void insert(InputIterator begin, InputIterator end)
       {
+        if (this->m_bulk_build_range(begin, end))
+          return;
         for (; begin != end; ++begin) 
         {
-          this->m_insert_non_unique(*begin);
+          this->m_insert_non_unique(this->end(), *begin);
         }
       }
     };
@@ -14,6 +14,7 @@
 #include <boost/btree/detail/binary_file.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/iterator/iterator_facade.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/timer/timer.hpp>
 #include <boost/detail/bitmask.hpp>
@@ -196,6 +197,63 @@ namespace btree
 
       bool operator<(const file_state& rhs) const {return element < rhs.element;}
      };
+
+    //  merge_iterator is an input iterator over the elements of the open temporary
+    //  files, in order. Equal elements come from earlier files first, so the merge is
+    //  stable. A default constructed merge_iterator is the end iterator.
+    template <class T, class Value>
+    class merge_iterator
+      : public boost::iterator_facade<merge_iterator<T, Value>, Value,
+          boost::single_pass_traversal_tag, Value>
+    {
+    public:
+      typedef std::vector<file_state<T> > files_type;
+
+      merge_iterator() : m_files(0) {}
+      explicit merge_iterator(files_type& files) : m_files(&files)
+      {
+        if (!m_files->empty())
+          m_min = std::min_element(m_files->begin(), m_files->end());
+      }
+
+    private:
+      friend class boost::iterator_core_access;
+
+      files_type*                     m_files;
+      typename files_type::iterator   m_min;  // valid if !at_end()
+
+      bool at_end() const {return !m_files || m_files->empty();}
+
+      Value dereference() const
+        {return Value(m_min->element.key, m_min->element.mapped);}
+
+      bool equal(const merge_iterator& rhs) const {return at_end() == rhs.at_end();}
+
+      void increment()
+      {
+        if (m_min->bytes_left)
+        {
+#ifdef BOOST_BTREE_CSTDIO
+          if (std::fread(&m_min->element, sizeof(T), 1, m_min->stream_ptr) != 1)
+            throw std::runtime_error("temp file read failure");
+#else
+          m_min->stream_ptr->read(reinterpret_cast<char*>(&m_min->element), sizeof(T));
+#endif
+          m_min->bytes_left -= sizeof(T);
+        }
+        else
+        {
+#ifdef BOOST_BTREE_CSTDIO
+          std::fclose(m_min->stream_ptr);
+#else
+          m_min->stream_ptr->close();
+#endif
+          m_files->erase(m_min);
+        }
+        if (!m_files->empty())
+          m_min = std::min_element(m_files->begin(), m_files->end());
+      }
+    };
   }
 
   //---------------------------------  bulk_load_map  ----------------------------------//
@@ -344,7 +402,8 @@ namespace btree
         msg_stream << "    temporary file " << file_n << ", " << elements << " elements\n"
                       "      reading..." << std::endl;
         t.start();
-        infile.read(begin, elements);
+        infile.read_at(static_cast<boost::btree::binary_file::offset_type>(
+          elements_completed * sizeof(value_type)), begin, elements * sizeof(value_type));
         t.stop();
         msg_stream << "       ";
         t.report();
@@ -362,7 +421,7 @@ namespace btree
         bfs::path tmp_path = temp_dir / bfs::path("btree.tmp" + file_n_string);
         boost::btree::binary_file tmpfile(tmp_path, boost::btree::oflag::out
           | boost::btree::oflag::truncate | boost::btree::oflag::sequential);
-        tmpfile.write(begin, elements);
+        tmpfile.write_at(0, begin, elements * sizeof(value_type));
         t.stop();
         msg_stream << "       ";
         t.report();
@@ -414,78 +473,55 @@ namespace btree
         - sizeof(value_type);
     }
 
-    uint64_t emplace_calls = 0;
-    uint64_t inserts = 0;
-    //  hold most recent iterator to minimize cache thrashing; may become unneccessary
-    //  if an packed_insert is implemented, but still needed if insert/emplace with
-    //  hint implemented.
-    std::pair<typename BTree::const_iterator, bool> result;  
+    typedef detail::merge_iterator<value_type, typename BTree::value_type>
+      merge_iterator;
+    uint64_t size_before = bt.size();
 
     t.start();
-    timer::cpu_times then = t.elapsed();
 
-    //  until all elements done, insert minimum element
-    //    note well: stable due to stable_sort of each file, and then min_element
-    //    order guarantee that files will be checked in begin to end order
-    while (!files.empty())
+    if (bt.empty())
     {
-      typename vector_type::iterator min = std::min_element(files.begin(), files.end());
-
-      result = bt.emplace(min->element.key, min->element.mapped);
-      ++emplace_calls;
-
-      if (result.second)
-      {
-        ++inserts;
-        BOOST_ASSERT(bt.inspect_leaf_to_root(msg_stream, result.first));
-      }
-
-      if (log_point && emplace_calls % log_point == 0)
-      {
-        const double sec = 1000000000.0;
-        t.stop();
-        timer::cpu_times now = t.elapsed();
-        msg_stream << "    " << emplace_calls << " emplace calls, "
-                             << inserts << " inserts, "
-        //msg_stream << ", this one from file " << (min - files.begin())
-        //           << " of " << files.size()-1 << std::endl;
-                   << (now.wall-then.wall)/sec << " secs, "
-                   << log_point / ((now.wall-then.wall)/sec) << " per sec"
-                   << std::endl;
-        then = now;
-        t.resume();
-      }
+      //  the merged elements are sorted, so the btree can be built bottom up
+      msg_stream << "  building btree from merged elements..." << std::endl;
+      bt.bulk_build(merge_iterator(files), merge_iterator());
+    }
+    else
+    {
+      uint64_t insert_calls = 0;
+      timer::cpu_times then = t.elapsed();
 
-      if (min->bytes_left)
+      //  until all elements done, insert minimum element
+      //    note well: stable due to stable_sort of each file, and then min_element
+      //    order guarantee that files will be checked in begin to end order
+      for (merge_iterator it(files); it != merge_iterator(); ++it)
       {
-#ifdef BOOST_BTREE_CSTDIO
-      if (std::fread(&min->element, sizeof(value_type), 1, min->stream_ptr) != 1)
-        throw std::runtime_error("temp file read failure");
-#else
-        min->stream_ptr->read(
-          reinterpret_cast<char*>(&min->element), sizeof(value_type));
-#endif
-        min->bytes_left -= sizeof(value_type);
-      }
-      else
-      {
-#ifdef BOOST_BTREE_CSTDIO
-        std::fclose(min->stream_ptr);
-#else
-        min-stream_ptr->close();
-#endif
-        files.erase(min);
+        //  elements arrive in ascending order, so insert_packed() avoids the search
+        bt.insert_packed(*it);
+        ++insert_calls;
+
+        if (log_point && insert_calls % log_point == 0)
+        {
+          const double sec = 1000000000.0;
+          t.stop();
+          timer::cpu_times now = t.elapsed();
+          msg_stream << "    " << insert_calls << " insert calls, "
+                     << (now.wall-then.wall)/sec << " secs, "
+                     << log_point / ((now.wall-then.wall)/sec) << " per sec"
+                     << std::endl;
+          then = now;
+          t.resume();
+        }
       }
     }
     t.stop();
     t.report();
 
-    msg_stream << emplace_calls << " emplace calls, " << inserts << " inserts\n";
+    msg_stream << n_elements << " elements merged, " << bt.size() - size_before
+               << " inserts\n";
 
     msg_stream << bt << std::endl;
     msg_stream << bt.manager() << std::endl;
 
-    BOOST_ASSERT(emplace_calls == n_elements);
     // TODO throw if inserts != n_elements
 
   }
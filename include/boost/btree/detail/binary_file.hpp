@@ -50,7 +50,8 @@ namespace boost
         random      =1<<6,    // hint: optimize for random access
         sequential  =1<<7,    // hint: optimize for sequential access
 
-        preload     =1<<8     // hint: read entire file on open to preload O/S disk cache
+        preload     =1<<8,    // hint: read entire file on open to preload O/S disk cache
+        direct      =1<<9     // bypass the O/S disk cache; see binary_file::direct()
       };
 
       BOOST_BITMASK(bitmask);
@@ -68,6 +69,14 @@ namespace boost
 
     //  class binary_file  -------------------------------------------------------------//
     
+    //  io_segment  ---------------------------------------------------------------------//
+
+    struct io_segment  // one part of a gather write
+    {
+      const void*  data;
+      std::size_t  size;
+    };
+
     class BOOST_BTREE_DECL binary_file // noncopyable
     {
     private:
@@ -87,13 +96,13 @@ namespace boost
 
  
       binary_file()
-        : m_handle(invalid_handle) {}
+        : m_handle(invalid_handle), m_direct(false) {}
 
       explicit binary_file(const filesystem::path& p, oflag::bitmask flags=oflag::in)
-        : m_handle(invalid_handle) { open(p, flags); }
+        : m_handle(invalid_handle), m_direct(false) { open(p, flags); }
 
       binary_file(const filesystem::path& p, oflag::bitmask flags, system::error_code& ec)
-        : m_handle(invalid_handle) { open(p, flags, ec); }
+        : m_handle(invalid_handle), m_direct(false) { open(p, flags, ec); }
 
      ~binary_file();
 
@@ -118,6 +127,20 @@ namespace boost
 
       const filesystem::path& path() const  { return m_path; }
 
+      //  direct I/O  -------------------------------------------------------------------//
+
+      //  When opened with oflag::direct, transfers bypass the operating system's disk
+      //  cache (O_DIRECT on Linux and the BSDs, F_NOCACHE on Mac OS X,
+      //  FILE_FLAG_NO_BUFFERING on Windows). The memory address, file offset, and size
+      //  of every transfer must then be multiples of direct_alignment. If the file
+      //  system does not support direct I/O, the file is opened normally.
+
+      static const std::size_t direct_alignment = 4096;  // covers 512 byte and 4K
+                                                          // sector devices
+
+      bool direct() const  { return m_direct; }
+      // Returns: true if the file is open and transfers bypass the O/S disk cache
+
       // -------------------------------------------------------------------------------//
  
       // Requirement on type T, void* objects below: Memcpyable
@@ -191,7 +214,7 @@ namespace boost
       // Returns: true, except false if end-of-file or error.
       {
         BOOST_ASSERT(is_open());
-        return m_read(target, n * sizeoftypename (boost::remove_extent<T>::type), ec);
+        return m_read(target, n * sizeof(typename boost::remove_extent<T>::type), ec);
       }
 
       std::size_t raw_write(const void* source, std::size_t sz,
@@ -251,6 +274,72 @@ namespace boost
         m_write(source, n * sizeof(typename boost::remove_extent<T>::type), ec);
       }
 
+      //  positioned I/O  ---------------------------------------------------------------//
+
+      //  read_at and write_at transfer at an explicit offset, so each costs one system
+      //  call rather than a seek followed by a read or write. On POSIX they neither use
+      //  nor change the file offset, so they may be used concurrently on the same file.
+      //  On Windows the file offset after the call is unspecified.
+
+      bool read_at(offset_type offset, void* target, std::size_t sz,
+        system::error_code& ec);
+      // Requires: is_open()
+      // Effects: As if calls POSIX pread(), except will finish partial reads.
+      // ec.clear() if no error, otherwise set ec to the system error code.
+      // Returns: true, except false if end-of-file or error.
+
+      bool read_at(offset_type offset, void* target, std::size_t sz);
+      // Requires: is_open()
+      // Effects: As if POSIX pread(), except will finish partial reads.
+      // Throws: On error.
+      // Returns: true, except false if end-of-file.
+
+      template<typename T>
+      bool read_at(offset_type offset, T& target)
+      // Requires: is_open()
+      // Effects: read_at(offset, &target, sizeof(T))
+      {
+        BOOST_ASSERT(is_open());
+        return read_at(offset, static_cast<void*>(&target), sizeof(T));
+      }
+
+      void write_at(offset_type offset, const void* source, std::size_t sz,
+        system::error_code& ec);
+      // Requires: is_open()
+      // Effects: As if calls POSIX pwrite(), except will finish partial writes.
+      // Sets ec to 0 if no error, otherwise sets ec to the system error code.
+
+      void write_at(offset_type offset, const void* source, std::size_t sz);
+      // Requires: is_open()
+      // Effects: As if POSIX pwrite(), except will finish partial writes.
+      // Throws: On error.
+
+      template<typename T>
+      void write_at(offset_type offset, const T& source)
+      // Requires: is_open()
+      // Effects: write_at(offset, &source, sizeof(T))
+      {
+        BOOST_ASSERT(is_open());
+        write_at(offset, static_cast<const void*>(&source), sizeof(T));
+      }
+
+      void gather_write_at(offset_type offset, const io_segment* segments,
+        std::size_t n, system::error_code& ec);
+      // Requires: is_open()
+      // Effects: Writes segments[0] through segments[n-1], in that order, to
+      //   consecutive locations beginning at offset. As if calls POSIX pwritev()
+      //   where available, otherwise write_at() for each segment. Will finish
+      //   partial writes. Sets ec to 0 if no error, otherwise sets ec to the
+      //   system error code.
+
+      void gather_write_at(offset_type offset, const io_segment* segments,
+        std::size_t n);
+      // Requires: is_open()
+      // Effects: As above.
+      // Throws: On error.
+
+      // -------------------------------------------------------------------------------//
+
       offset_type seek(offset_type offset, seekdir::pos from,
         system::error_code& ec);
       // Effects: As if POSIX lseek(), except with offset argument of a type
@@ -266,6 +355,17 @@ namespace boost
       // for maximum file size possible for operating system.
       // Throws: On error.
 
+      void truncate(offset_type sz, system::error_code& ec);
+      // Requires: is_open()
+      // Effects: As if POSIX ftruncate(); the file is cut back to, or extended to,
+      // sz bytes. The file offset is not changed. Sets ec to 0 if no error,
+      // otherwise to the system error code.
+
+      void truncate(offset_type sz);
+      // Requires: is_open()
+      // Effects: As above.
+      // Throws: On error.
+
       // dup, dup2 ?
       // lockf ?
       // static sync?
@@ -273,6 +373,7 @@ namespace boost
     private:
       handle_type              m_handle; // -1 indicates not open
       boost::filesystem::path  m_path;
+      bool                     m_direct;
 
       bool m_read(void* target, std::size_t sz, system::error_code& ec);
       bool m_read(void* target, std::size_t sz);
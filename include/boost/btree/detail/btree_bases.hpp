@@ -13,6 +13,8 @@
 #include <boost/iterator/iterator_facade.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/btree/detail/buffer_manager.hpp>
+#include <boost/btree/detail/node_search.hpp>
+#include <boost/btree/detail/free_map.hpp>
 #include <boost/assert.hpp>
 #include <boost/static_assert.hpp>
 #include <cstddef>     // for size_t
@@ -24,6 +26,7 @@
 #include <algorithm>
 #include <ostream>
 #include <stdexcept>
+#include <vector>
 
 /*
 
@@ -53,10 +56,6 @@
     and (2) apply only when BOOST_BINARY_FILE_LOG is defined. This implies adding m_ to
     the actual binary_file.cpp implementation names.
 
-  * Preload option currently is just passed on to binary_file, which reads the entire file.
-    That preloads the O/S cache, but does nothing for the btree cache. Should also iterate
-    over the btree to preload the btree cache.
-
   * Should (some) constructors, open, have max_cache_size argument?
 
   * Problem: if key_type or mapped type require 64-bit alignment on some machines, but
@@ -66,9 +65,6 @@
 
   * Search all files for TODO, clear problems if possible, otherwise add to this list.
 
-  * buffer_manager is using an intrusive set (buffers_type) for page_id lookup. An
-    intrusive unordered_set might be more appropriate.
-
   * bt_time does not actually implement -html option except for -stl
 
   * bt_time should use high_res clock, perhaps in addition to cpu times?
@@ -80,12 +76,6 @@
     Instead provide observer functions that call the equivalent manager() and header()
     observer functions.
 
-   * An insert_packed() function could avoid searching and cache thrashing by hanging onto
-    an iterator between calls. Check pack optimization applies (last page, etc) and verify
-    new element > previous element (>= if non-unique), then just tack on the end; see
-    m_branch_insert. Consider whether or not this could be combined with an insert-with-
-    hint function or insert-after function.
-
   * Bulk load: If file_size(source) <= max_memory: just load, sort, and insert:-)
 
   * If an erase causes the tree size to become 0, pack optimization should be reenabled.
@@ -188,7 +178,9 @@ public:
 
   This class implements a B+tree.
   
-  There is no leaf node linked-list; a tree-walk provides equivalent functionality.
+  Leaves are doubly linked in key order (a B-link tree at the leaf level), so iterators
+  step from leaf to leaf without reading branches. The header records the first and
+  last leaf.
 
   Valid-chain-to-root invariant:
 
@@ -197,10 +189,35 @@ public:
     Leaf and branch nodes contain a btree_node_ptr to the parent node in the tree, and
     a (dumb) branch_value_type* to the parent element itself.
 
-    This chain, from iterator to root, is valid as long as the iterator is valid. Any
-    operations that create an iterator must establish this chain, and any operations
-    that advance the iterator forward or backward must maintain the validity of the
-    chain.
+    Searches establish this chain, from iterator to root, and it is valid as long as
+    the iterator is valid. Iterators that reach a leaf through a sibling link may have
+    no chain, or a stale one left by an earlier search; operations that need one, such
+    as splitting or freeing the leaf, call m_parent_chain() first, which checks the
+    chain and if need be re-establishes it by searching for the leaf's first key.
+
+  Rebalancing on erase:
+
+    By default a leaf is freed only when its last element is erased. If
+    min_fill_percent() is non-zero, a leaf or branch other than the root that falls
+    below that percentage of its capacity borrows from, or merges with, an adjacent
+    sibling under the same parent, and the separator key in the parent is fixed up.
+
+  Compaction:
+
+    compact_step() visits leaves in key order, tops each up from the leaves that
+    follow it, and moves it to the next node id by exchanging contents with whatever
+    node has that id. The branches are rebuilt only after all leaves are placed, so
+    until then they are in no particular order. The new branches take the lowest free
+    node ids, which follow the placed leaves.
+
+  Free nodes:
+
+    Free nodes are linked into a list that starts in the header, but once a node is
+    allocated or freed the list is read into a bitmap, and nodes are allocated from
+    that; a node split takes the free node nearest the node being split, so nodes
+    adjacent in key order tend to stay adjacent in the file. flush() rewrites the
+    list in ascending node id order, relinking only the free nodes next to those
+    allocated or freed since the last flush().
 
   To facilitate emplace semantics, internal leaf inserts insert the key only, and if
   sizeof(key_type) is less than sizeof(value_type) (i.e. it is a map rather than a set)
@@ -272,6 +289,7 @@ public:
 
   void flush()                              {
                                               BOOST_ASSERT(is_open());
+                                              m_free_sync();
                                               if (m_mgr.flush())
                                                 m_write_header();
                                             }
@@ -333,6 +351,22 @@ public:
     BOOST_ASSERT(is_open());
     m_mgr.max_cache_size((mb*1048576)/node_size());
   }
+  void          max_write_batch(std::size_t n)  // 0 or 1 disables coalescing
+  { 
+    BOOST_ASSERT(is_open());
+    m_mgr.max_write_batch(n);
+  }
+  unsigned      min_fill_percent() const    { return m_min_fill_percent; }
+  void          min_fill_percent(unsigned pct)  // 0 disables rebalancing on erase
+  {
+    BOOST_ASSERT_MSG(pct <= 50, "min_fill_percent() greater than 50");
+    m_min_fill_percent = pct;
+  }
+  std::size_t   preload_cache(bool leaves=true);
+  //  Effects: Reads nodes into the cache breadth-first from the root; all branch
+  //    levels, then leaves if requested, stopping when max_cache_size() nodes are
+  //    cached. Each level is read in node id order with large sequential reads.
+  //  Returns: The number of nodes read.
 
   //  The following element access functions are not provided. Returning references is
   //  far too dangerous, since the memory pointed to would be in a node buffer that can
@@ -365,6 +399,52 @@ public:
 
   void               clear();
 
+  template <class InputIterator>
+  void               bulk_build(InputIterator begin, InputIterator end,
+                       double fill_factor = 1.0);
+  //  Requires: empty(). [begin,end) is sorted by key. 0 < fill_factor <= 1.
+  //  Effects: As insert(begin, end), but the tree is built bottom up. Leaves are
+  //    filled left to right to fill_factor of their capacity, then each branch level
+  //    is built from the first keys of the nodes on the level below. The nodes of
+  //    each level get ascending node ids, and are flushed in large sequential writes.
+  //  Throws: std::runtime_error if [begin,end) is not sorted.
+
+  // compaction:
+
+  void               compact(double fill_factor = 1.0)
+                                            {
+                                              compact_start(fill_factor);
+                                              while (!compact_step()) {}
+                                            }
+  void               compact_start(double fill_factor = 1.0);
+  //  Requires: !compacting(). 0 < fill_factor <= 1.
+  //  Effects: Begins an online compaction, performed by calls to compact_step(), which
+  //    may be interleaved with any other operations. Leaves are visited in key order;
+  //    each holding less than fill_factor of its capacity is filled to that from the
+  //    leaves that follow it, and each is moved to the next node id, so that the
+  //    leaves end up in ascending node ids.
+  //    The branch levels are then rebuilt above the leaves, as by bulk_build(), and
+  //    free nodes at the end of the file are removed from it.
+  bool               compact_step(std::size_t max_nodes = 64);
+  //  Effects: If compacting(), continues the compaction for up to max_nodes leaves.
+  //    The final step rebuilds the branches and takes time proportional to their
+  //    number.
+  //  Returns: !compacting().
+  //  Remarks: Invalidates all iterators.
+  void               compact_stop()         { if (m_compact) m_compact_finish(); }
+  //  Effects: Ends the compaction without completing it; leaves already placed stay
+  //    placed, and free nodes at the end of the file are removed from it.
+  bool               compacting() const     { return m_compact != 0; }
+  const compact_stats&
+                     compaction_stats() const  { return m_compact_stats; }
+  void               shrink_to_fit();
+  //  Requires: !compacting().
+  //  Effects: Moves the nodes at the end of the file into free nodes nearer its start,
+  //    cuts the free nodes then at the end from the file, and flushes.
+  //  Postconditions: If no iterators are held, header().node_count() is one more than
+  //    the number of leaves and branches, and the file holds that many nodes.
+  //  Remarks: Invalidates all iterators.
+
   // operations:
   //   Types K and Key are required to be key_comp() comparable
   //   Non-const overloads are not provided because of the need to explicitly know
@@ -394,11 +474,32 @@ public:
     equal_range(const Key& k) const
       {return std::make_pair(lower_bound<Key>(k), upper_bound<Key>(k));}
 
+  //  batched lookups:
+
+  template <class InputIterator, class OutputIterator>
+    OutputIterator   lower_bound_many(InputIterator first, InputIterator last,
+                       OutputIterator result) const
+                       {return m_bound_many(first, last, result, false);}
+  //  Effects: For each key k in [first,last), in order, *result++ = lower_bound(k).
+  //  Returns: result.
+  //  Remarks: The keys are looked up in ascending order, so that each descent only
+  //    searches the nodes where it leaves the path taken by the key before it. For
+  //    keys that cluster, most branch searches and node reads are avoided.
+
+  template <class InputIterator, class OutputIterator>
+    OutputIterator   find_many(InputIterator first, InputIterator last,
+                       OutputIterator result) const
+                       {return m_bound_many(first, last, result, true);}
+  //  Effects: For each key k in [first,last), in order, *result++ = find(k).
+  //  Returns: result.
+  //  Remarks: As for lower_bound_many().
+
 //------------------------------  inspect leaf-to-root  --------------------------------//
 
   bool inspect_leaf_to_root(std::ostream& os, const const_iterator& itr)
     // Returns: true if no errors detected
 {
+  m_parent_chain(itr.node());  // itr may have been reached through a sibling link
   btree_node* np = itr.node().get();
   for (;
        np->level() < header().root_level();
@@ -482,12 +583,28 @@ private:
 
   flags::bitmask     m_flags;
   bool               m_ok_to_pack;  // true while all inserts ordered and no erases
-                                               
+  unsigned           m_min_fill_percent;  // 0 unless rebalancing on erase
+
+  struct compact_state;
+  compact_state*     m_compact;         // 0 unless compacting
+  compact_stats      m_compact_stats;
+  boost::uint64_t    m_node_changes;    // count of nodes allocated or freed
+
+  //  free nodes; see m_free_load()
+  detail::free_map   m_free;
+  bool               m_free_loaded;
+  bool               m_free_relink_all;
+  std::vector<std::size_t>
+                     m_free_changed;    // ids allocated or freed since m_free_sync()
+
 
 //--------------------------------------------------------------------------------------//
 //                                private nested classes                                //
 //--------------------------------------------------------------------------------------//
 
+  //  how keys are located within a node; see detail/node_search.hpp
+  typedef typename detail::node_search_policy<traits_type>::type  search_policy;
+
   //------------------------ disk data formats and operations --------------------------//
 
   //  Pages hold a sequences of elements, plus administrivia. See details below.
@@ -518,6 +635,11 @@ private:
     value_type*  begin()      {return m_value;}
     value_type*  end()        {return &m_value[btree_data::size()];}
 
+    node_id_type     prior_id() const            {return m_prior_id;}
+    void             prior_id(node_id_type id)   {m_prior_id = id;}
+    node_id_type     next_id() const             {return m_next_id;}
+    void             next_id(node_id_type id)    {m_next_id = id;}
+
     //  offsetof() macro won't work for all value types, so compute by hand
     static std::size_t value_offset()
     {
@@ -528,7 +650,9 @@ private:
     }
 
     //  private:
-    value_type  m_value[1];
+    node_id_type  m_prior_id;  // sibling leaves in key order; 0 if none, since
+    node_id_type  m_next_id;   //  node 0 is the header
+    value_type    m_value[1];
   };
 
   //std::size_t char_distance(const void* from, const void* to)
@@ -633,6 +757,22 @@ private:
                                                = static_cast<uint_least32_t>(sz);}    
     bool               empty() const         {return leaf().m_size == 0;}
 
+    btree_node_ptr     next_leaf()  // return next leaf through the sibling link;
+                                    // the child to parent chain is not established
+    {
+      BOOST_ASSERT(is_leaf());
+      return leaf().next_id() ? btree_node_ptr(manager()->read(leaf().next_id()))
+                              : btree_node_ptr();
+    }
+
+    btree_node_ptr     prior_leaf() // return prior leaf through the sibling link;
+                                    // the child to parent chain is not established
+    {
+      BOOST_ASSERT(is_leaf());
+      return leaf().prior_id() ? btree_node_ptr(manager()->read(leaf().prior_id()))
+                               : btree_node_ptr();
+    }
+
     btree_node_ptr     next_node()  // return next node at current level while
                                     // maintaining the child to parent chain
     {
@@ -859,9 +999,45 @@ protected:
     m_insert_non_unique(const key_type& k);
   // Remark: Insert after any elements with equivalent keys, per C++ standard
 
+  std::pair<const_iterator, bool>
+    m_insert_unique(const_iterator hint, const key_type& k);
+
+  const_iterator
+    m_insert_non_unique(const_iterator hint, const key_type& k);
+  // Remark: Insert immediately before hint if that preserves the ordering and the leaf
+  // has room, otherwise as m_insert_non_unique(k)
+
   void m_open(const boost::filesystem::path& p, flags::bitmask flgs, uint64_t signature,
               const compare_type& comp, std::size_t node_sz);
 
+  template <class InputIterator>
+  bool m_bulk_build_range(InputIterator begin, InputIterator end)
+  // Effects: If empty() and [begin,end) is a sorted forward range, bulk_build(begin, end)
+  // Returns: true if built; otherwise nothing is done and the caller inserts the range
+  {
+    return m_bulk_build_range(begin, end,
+      typename std::iterator_traits<InputIterator>::iterator_category());
+  }
+
+  template <class InputIterator>
+  bool m_bulk_build_range(InputIterator, InputIterator, std::input_iterator_tag)
+  {
+    return false;  // a single pass range cannot be checked for order before building
+  }
+
+  template <class ForwardIterator>
+  bool m_bulk_build_range(ForwardIterator begin, ForwardIterator end,
+    std::forward_iterator_tag)
+  {
+    if (!empty() || begin == end)
+      return false;
+    for (ForwardIterator prior = begin, it = begin; ++it != end; prior = it)
+      if (key_comp()(this->key(*it), this->key(*prior)))
+        return false;
+    bulk_build(begin, end);
+    return true;
+  }
+
   iterator m_write_cast(const_iterator itr)
   {
     itr.m_node->needs_write(true);
@@ -885,18 +1061,25 @@ private:
   static buffer* m_node_alloc(buffer::buffer_id_type np_id, buffer_manager& mgr)
   { return new btree_node(np_id, mgr); }
 
+  static unsigned m_node_priority(const buffer& buf)
+  //  cache_branches: branches are kept in preference to leaves, upper levels longest
+  {
+    unsigned lv = static_cast<const btree_node&>(buf).level();
+    return lv == 0xFF ? 0 : lv;  // 0xFF is a free node list entry
+  }
+
   void m_read_header()
   {
-    m_mgr.seek(0);
-    m_mgr.binary_file::read(m_hdr);
+    m_mgr.read_header(&m_hdr, sizeof(m_hdr));
     m_hdr.endian_flip_if_needed();
   }
 
+  filesystem::path m_cache_state_path() const  { return path().string() + ".hotset"; }
+
   void m_write_header()
   {
-    m_mgr.seek(0);
     m_hdr.endian_flip_if_needed();
-    m_mgr.binary_file::write(m_hdr);
+    m_mgr.write_header(&m_hdr, sizeof(m_hdr));
     m_hdr.endian_flip_if_needed();
   }
 
@@ -906,22 +1089,59 @@ private:
   // past-the-end leaf const_iterator for const_iterator::m_node
   // postcondition: parent pointers are set, all the way up the chain to the root
 
+  template <class K>
+  const_iterator m_special_lower_bound(const K& k, std::vector<btree_node_ptr>& path,
+    const const_iterator& prior) const;
+  // as m_special_lower_bound(k), but path holds the nodes from the root down to the
+  // leaf of prior, the result for a key not greater than k, or is empty. The descent
+  // only searches from where k leaves that path, and path is updated to the new one.
+
+  template <class InputIterator, class OutputIterator>
+  OutputIterator m_bound_many(InputIterator first, InputIterator last,
+    OutputIterator result, bool find) const;
+
+  template <class Probe>
+  struct probe_less  // orders indexes into a vector of keys by the keys
+  {
+    const std::vector<Probe>*  probes;
+    compare_type               comp;
+    probe_less(const std::vector<Probe>& p, const compare_type& c)
+      : probes(&p), comp(c) {}
+    bool operator()(std::size_t a, std::size_t b) const
+      {return comp((*probes)[a], (*probes)[b]);}
+  };
+
   template <class K> 
   const_iterator m_special_upper_bound(const K& k) const;
   // returned const_iterator::m_element is the insertion point, and thus may be the 
   // past-the-end leaf const_iterator for const_iterator::m_node
   // postcondition: parent pointers are set, all the way up the chain to the root
 
-  btree_node_ptr m_new_node(node_level_type lv);
+  btree_node_ptr m_new_node(node_level_type lv, std::size_t hint_id = 0);
+  // hint_id: the node id the new node should be near, such as that of a node being
+  // split; 0 requests the lowest free node id
   void  m_new_root();
 
   const_iterator m_leaf_insert(const_iterator insert_iter, const key_type& k);
+  bool m_hint_ok(const_iterator& hint, const key_type& k, bool unique) const;
+  btree_node_ptr m_build_level(std::vector<branch_value_type>& level,
+    node_level_type lv, std::size_t fill, std::size_t flush_interval);
+
+  void m_parent_chain(const btree_node_ptr& np) const;
+  bool m_parent_chain_ok(btree_node* np) const;
+  // postcondition: parent pointers are set, all the way up the chain to the root
+
+  void m_link_leaf(btree_node* np, btree_node* np2);  // link np2 in after np
+  void m_unlink_leaf(btree_node* np);
 
   void m_branch_insert(btree_node_ptr np, branch_value_type* element, const key_type& k,
     btree_node_ptr child);  // insert key, child->node_id;
                             // set child's parent, parent_element
 
   void m_erase_branch_value(btree_node* np, branch_value_type* value);
+  const_iterator m_rebalance_leaf(btree_node_ptr np, std::size_t pos);
+  void m_rebalance_branch(btree_node* np);
+  btree_node_ptr m_sibling(btree_node* np, bool& is_right) const;
 
   void  m_free_node(btree_node* np)  // add to free node list
   {
@@ -929,14 +1149,57 @@ private:
       m_hdr.decrement_leaf_node_count();
     else
       m_hdr.decrement_branch_node_count();
+    ++m_node_changes;
     np->needs_write(true);
-    np->never_free(false);
     np->level(0xFF);
     np->size(0);
-    np->branch().begin()->node_id = node_id_type(m_hdr.free_node_list_head_id());
-    m_hdr.free_node_list_head_id(np->node_id());
+    m_free_load();
+    m_free.set(np->node_id());
+    m_free_touch(np->node_id());
+  }
+
+  //---------------------------------- free nodes --------------------------------------//
+
+  void m_free_load();
+  void m_free_sync();
+  void m_free_touch(std::size_t id)  // id has been allocated or freed
+  {
+    if (m_free_relink_all)
+      return;
+    if (m_free_changed.size() < m_free.count())
+      m_free_changed.push_back(id);
+    else
+    {
+      m_free_relink_all = true;  // no more work than relinking the changes
+      m_free_changed.clear();
+    }
   }
 
+  //---------------------------------- compaction --------------------------------------//
+
+  struct compact_state
+  {
+    std::size_t         target;      // node id for the next leaf placed
+    branch_value_type   cursor;      // id and first key of the next leaf to place;
+                                     //   node_id 0 once all leaves are placed
+    boost::uint64_t     changes;     // m_node_changes when cursor was set
+    std::size_t         leaf_fill;
+    std::size_t         branch_fill;
+  };
+
+  void m_compact_leaves(std::size_t budget);
+  void m_compact_pull(btree_node_ptr& np, btree_node_ptr& right);
+  void m_compact_branches();
+  void m_compact_finish();
+  void m_truncate_free_tail();
+  void m_swap_nodes(btree_node_ptr& np, node_id_type id);
+  void m_leaf_level(std::vector<branch_value_type>& level,
+    std::vector<node_id_type>* branches) const;
+  void m_leaf_level(node_id_type id, unsigned lv, const key_type* separator,
+    std::vector<branch_value_type>& level, std::vector<node_id_type>* branches) const;
+  void m_compact_measure(const std::vector<branch_value_type>& level,
+    boost::uint64_t& leaves, double& fill, double& sequential) const;
+
   //-------------------------------- branch_compare ------------------------------------//
 
   class branch_compare
@@ -1002,7 +1265,8 @@ std::ostream& operator<<(std::ostream& os,
 template <class Key, class Base>
 btree_base<Key,Base>::btree_base()
   // initialize in the correct order to avoid voluminous gcc warnings:
-  : m_mgr(m_node_alloc)
+  : m_mgr(m_node_alloc), m_compact(0), m_node_changes(0), m_free_loaded(false),
+      m_free_relink_all(false)
 { 
   m_mgr.owner(this);
 
@@ -1016,7 +1280,8 @@ btree_base<Key,Base>::btree_base()
 template <class Key, class Base>
 btree_base<Key,Base>::btree_base(const boost::filesystem::path& p,
   flags::bitmask flgs, uint64_t signature, const compare_type& comp, std::size_t node_sz)
-    : m_mgr(m_node_alloc)
+    : m_mgr(m_node_alloc), m_compact(0), m_node_changes(0), m_free_loaded(false),
+      m_free_relink_all(false)
 { 
   m_mgr.owner(this);
 
@@ -1045,7 +1310,14 @@ void btree_base<Key,Base>::close()
 {
   if (is_open())
   {
+    if (m_compact)
+      m_compact_finish();
     flush();
+    if (m_flags & flags::persist_cache)
+    {
+      system::error_code ec;  // the sidecar is only an optimization, so ignore errors
+      m_mgr.save_cache_state(m_cache_state_path(), ec);
+    }
     m_mgr.close();
   }
 }
@@ -1081,19 +1353,37 @@ btree_base<Key,Base>::m_open(const boost::filesystem::path& p,
     open_flags |= oflag::out | oflag::truncate;
   if (flgs & flags::preload)
     open_flags |= oflag::preload;
+  if (flgs & flags::direct_io)
+    open_flags |= oflag::direct;
 
   m_ok_to_pack = true;
+  m_min_fill_percent = 0;
+  m_free_loaded = false;
   m_max_leaf_elements
     = (node_sz - leaf_data::value_offset()) / sizeof(value_type);
   m_max_branch_elements
     = (node_sz - sizeof(node_id_type) - branch_data::value_offset())
       / sizeof(branch_value_type);
 
-  if (m_mgr.open(p, open_flags, 0, node_sz))
+  replacement::policy policy = replacement::lru;
+  if ((flgs & flags::replacement_mask) == flags::two_queue)
+    policy = replacement::two_queue;
+  else if ((flgs & flags::replacement_mask) == flags::clock_pro)
+    policy = replacement::clock_pro;
+
+  m_mgr.priority_function(m_flags & flags::cache_branches ? &m_node_priority : 0);
+  m_mgr.huge_pages((flgs & flags::huge_pages) != 0);
+  if (flgs & flags::shared_cache)
+    m_mgr.pool(&buffer_pool::global());  // max_cache_size() is then ignored
+
+  if (m_mgr.open(p, open_flags, 0, node_sz, policy))
   { // existing non-truncated file
     m_read_header();
     if (!m_hdr.marker_ok())
       m_close_and_throw("isn't a btree");
+    if (m_hdr.major_version() != btree::major_version
+      || m_hdr.minor_version() != btree::minor_version)
+      m_close_and_throw("file format version differs");
     if (m_hdr.signature() != signature)
       m_close_and_throw("signature differs");
     if (m_hdr.big_endian() != (traits_type::header_endianness == endian::order::big))
@@ -1108,9 +1398,18 @@ btree_base<Key,Base>::m_open(const boost::filesystem::path& p,
       m_close_and_throw("mapped size differs");
 
     m_mgr.data_size(m_hdr.node_size());
+    if ((flgs & flags::memory_map) && !(m_flags & flags::read_write))
+      m_mgr.map_file();
     m_root = m_mgr.read(m_hdr.root_node_id());
     max_cache_size(max_cache_default(flgs,
       static_cast<std::size_t>(boost::filesystem::file_size(p))));
+    if (flgs & flags::persist_cache)
+    {
+      system::error_code ec;
+      m_mgr.restore_cache_state(m_cache_state_path(), ec);
+    }
+    if (flgs & flags::preload)
+      preload_cache();
   }
   else
   { // new or truncated file
@@ -1136,11 +1435,20 @@ btree_base<Key,Base>::m_open(const boost::filesystem::path& p,
     m_hdr.increment_leaf_node_count();
     BOOST_ASSERT(m_root->node_id() == 1);
     m_hdr.root_node_id(m_root->node_id());
+    m_hdr.first_node_id(m_root->node_id());
     m_hdr.last_node_id(m_root->node_id());
     m_root->level(0);
     m_root->size(0);
     max_cache_size(max_cache_default(flgs, static_cast<std::size_t>(0)));
   }
+
+  if (flgs & flags::auto_cache)  // the minimum exceeds any realistic levels() + 1
+    m_mgr.auto_size(buffer_manager::default_auto_size_min,
+      static_cast<std::size_t>(-1));
+  if ((flgs & flags::write_back) && (m_flags & flags::read_write))
+    m_mgr.start_write_back();
+  if ((flgs & flags::async_io) && (m_flags & flags::read_write))
+    m_mgr.start_async_io();
 }
 
 //------------------------------------- clear() ----------------------------------------//
@@ -1154,10 +1462,14 @@ btree_base<Key,Base>::clear()
   manager().clear_write_needed();
   m_hdr.element_count(0);
   m_hdr.root_node_id(1);
+  m_hdr.first_node_id(1);
   m_hdr.last_node_id(1);
   m_hdr.root_level(0);
   m_hdr.node_count(0);
   m_hdr.free_node_list_head_id(0);
+  delete m_compact;
+  m_compact = 0;
+  m_free_loaded = false;
 
   m_mgr.close();
 }
@@ -1172,24 +1484,10 @@ btree_base<Key,Base>::begin() const
   if (empty())
     return end();
 
-  // starting at the root
-  btree_node_ptr np = m_root;
-
-  // work down the tree until a leaf is reached
-  while (np->is_branch())
-  {
-    // create the child->parent list
-    btree_node_ptr child_np = m_mgr.read(np->branch().begin()->node_id);
-    child_np->parent(np);
-    child_np->parent_element(np->branch().begin());
-#   ifndef NDEBUG
-    child_np->parent_node_id(np->node_id());
-#   endif
-
-    np = child_np;
-  }
-
+  //  read the first leaf directly; see m_parent_chain()
+  btree_node_ptr np = m_mgr.read(header().first_node_id());
   BOOST_ASSERT(np->is_leaf());
+  BOOST_ASSERT(!np->leaf().prior_id());
   return const_iterator(np, np->leaf().begin());
 }
 
@@ -1203,46 +1501,73 @@ btree_base<Key,Base>::last() const
   if (empty())
     return end();
 
-  // starting at the root
-  btree_node_ptr np = m_root;
+  //  read the last leaf directly; see m_parent_chain()
+  btree_node_ptr np = m_mgr.read(header().last_node_id());
+  BOOST_ASSERT(np->is_leaf());
+  BOOST_ASSERT(!np->leaf().next_id());
+  return const_iterator(np, np->leaf().end()-1);
+}
 
-  // work down the tree until a leaf is reached
-  while (np->is_branch())
-  {
-    // create the child->parent list
-    btree_node_ptr child_np = m_mgr.read(np->branch().end()->node_id);
-    child_np->parent(np);
-    child_np->parent_element(np->branch().end());
-#   ifndef NDEBUG
-    child_np->parent_node_id(np->node_id());
-#   endif
+//--------------------------------- preload_cache() ------------------------------------//
 
-    np = child_np;
-  }
+template <class Key, class Base>
+std::size_t
+btree_base<Key,Base>::preload_cache(bool leaves)
+{
+  BOOST_ASSERT(is_open());
+  std::vector<buffer::buffer_id_type> parents(1, m_root->node_id());
+  std::vector<buffer::buffer_id_type> children;
+  std::size_t loaded = 0;
 
-  BOOST_ASSERT(np->is_leaf());
-  return const_iterator(np, np->leaf().end()-1);
+  for (unsigned lv = m_root->level(); lv > 0 && (lv > 1 || leaves); --lv)
+  {
+    //  the children of every cached node on this level, in key order
+    children.clear();
+    for (std::vector<buffer::buffer_id_type>::iterator it = parents.begin();
+      it != parents.end(); ++it)
+    {
+      btree_node_ptr np = m_mgr.read(*it);
+      BOOST_ASSERT(np->is_branch());
+      for (branch_value_type* bp = np->branch().begin(); bp <= np->branch().end(); ++bp)
+        children.push_back(bp->node_id);
+    }
+    if (children.empty())
+      break;
+    loaded += m_mgr.preload(&children[0], children.size());
+
+    //  descend only through nodes now in memory, so the next level reads no parents
+    parents.clear();
+    for (std::vector<buffer::buffer_id_type>::iterator it = children.begin();
+      it != children.end(); ++it)
+      if (m_mgr.in_memory(*it))
+        parents.push_back(*it);
+  }
+  return loaded;
 }
 
 //---------------------------------- m_new_node() --------------------------------------//
 
 template <class Key, class Base>   
 typename btree_base<Key,Base>::btree_node_ptr 
-btree_base<Key,Base>::m_new_node(node_level_type lv)
+btree_base<Key,Base>::m_new_node(node_level_type lv, std::size_t hint_id)
 {
   btree_node_ptr np;
-  if (m_hdr.free_node_list_head_id())
+  m_free_load();
+  std::size_t free_id = hint_id ? m_free.nearest(hint_id) : m_free.lowest();
+  if (free_id)
   {
-    np = m_mgr.read(m_hdr.free_node_list_head_id());
-    BOOST_ASSERT(np->level() == 0xFF);  // free node list entry
-    m_hdr.free_node_list_head_id(np->branch().begin()->node_id);
+    m_free.reset(free_id);
+    m_free_touch(free_id);
+    np = m_mgr.overwrite(free_id);  // no need to read what will be overwritten
   }
   else
   {
     np = m_mgr.new_buffer();
     m_hdr.increment_node_count();
     BOOST_ASSERT(m_hdr.node_count() == m_mgr.buffer_count());
+    m_free.resize(m_mgr.buffer_count());
   }
+  ++m_node_changes;
 
   if (lv)  // is branch
     m_hdr.increment_branch_node_count();
@@ -1250,16 +1575,92 @@ btree_base<Key,Base>::m_new_node(node_level_type lv)
     m_hdr.increment_leaf_node_count();
 
   np->needs_write(true);
-  np->never_free(lv > 0 && (flags() & flags::cache_branches));
-//  cout << "******* lv:" << int(lv) << " cache_branches():" << cache_branches()
-//    << " never_free:" << np->never_free() << endl;;
   np->level(lv);
   np->size(0);
+  if (!lv)
+  {
+    np->leaf().prior_id(node_id_type(0));  // the caller links the leaf in
+    np->leaf().next_id(node_id_type(0));
+  }
   np->parent_reset();     // better safe than sorry
   np->parent_element(0);   // ditto
   return np;
 }
 
+//---------------------------------- m_free_load() -------------------------------------//
+
+template <class Key, class Base>   
+void
+btree_base<Key,Base>::m_free_load()
+//  Effects: If not already done, reads the free node list into m_free. A list not in
+//    ascending node id order, as written before m_free_sync() kept it so, is relinked
+//    by the next m_free_sync().
+{
+  if (m_free_loaded)
+    return;
+  m_free.clear();
+  m_free.resize(m_mgr.buffer_count());
+  m_free_changed.clear();
+  m_free_relink_all = false;
+  std::size_t prior = 0;
+  for (std::size_t id = m_hdr.free_node_list_head_id(); id;)
+  {
+    btree_node_ptr np(m_mgr.read(id));
+    BOOST_ASSERT(np->level() == 0xFF);  // free node list entry
+    m_free.set(id);
+    if (id <= prior)
+      m_free_relink_all = true;
+    prior = id;
+    id = np->branch().begin()->node_id;
+  }
+  m_free_loaded = true;
+}
+
+//---------------------------------- m_free_sync() -------------------------------------//
+
+template <class Key, class Base>   
+void
+btree_base<Key,Base>::m_free_sync()
+//  Effects: Brings the free node list up to date with m_free, linking the free nodes in
+//    ascending node id order. Allocating or freeing a node changes only its own link
+//    and that of the free node before it, so only those are rewritten.
+{
+  if (!m_free_loaded || (m_free_changed.empty() && !m_free_relink_all))
+    return;
+
+  std::vector<std::size_t> relink;
+  if (m_free_relink_all)
+  {
+    for (std::size_t id = m_free.lowest(); id; id = m_free.next(id))
+      relink.push_back(id);
+  }
+  else
+  {
+    for (std::vector<std::size_t>::const_iterator it = m_free_changed.begin();
+      it != m_free_changed.end(); ++it)
+    {
+      if (*it < m_free.size() && m_free.test(*it))  // else allocated, or cut from
+        relink.push_back(*it);                      //   the file
+      if (std::size_t prior = m_free.prior(*it))
+        relink.push_back(prior);
+    }
+    std::sort(relink.begin(), relink.end());
+    relink.erase(std::unique(relink.begin(), relink.end()), relink.end());
+  }
+
+  for (std::vector<std::size_t>::const_iterator it = relink.begin();
+    it != relink.end(); ++it)
+  {
+    btree_node_ptr np(m_mgr.overwrite(*it));
+    np->level(0xFF);
+    np->size(0);
+    np->branch().begin()->node_id = node_id_type(m_free.next(*it));
+  }
+  m_hdr.free_node_list_head_id(static_cast<uint32_t>(m_free.lowest()));
+  m_free_changed.clear();
+  m_free_relink_all = false;
+}
+
 //----------------------------------- m_new_root() -------------------------------------//
 
 template <class Key, class Base>   
@@ -1275,7 +1676,7 @@ btree_base<Key,Base>::m_new_root()
   if (max_cache_size() < header().levels() + 1)
     max_cache_size(header().levels() + 1);
 
-  m_root = m_new_node(m_hdr.root_level());
+  m_root = m_new_node(m_hdr.root_level(), old_root_id);
   m_hdr.root_node_id(m_root->node_id());
   m_root->branch().begin()->node_id = old_root_id;
   m_root->size(0);  // the end pseudo-element doesn't count as an element
@@ -1289,6 +1690,110 @@ btree_base<Key,Base>::m_new_root()
 # endif
 }
 
+//---------------------------------- m_parent_chain() ----------------------------------//
+
+template <class Key, class Base>   
+void
+btree_base<Key,Base>::m_parent_chain(const btree_node_ptr& np) const
+{
+  if (np->level() == header().root_level() || m_parent_chain_ok(np.get()))
+    return;  // np is the root and so has no parent, or chain already current
+  np->parent_reset();
+
+  if (np->is_branch())
+  {
+    //  the chain of the leftmost leaf below np passes through np
+    btree_node_ptr leaf = np;
+    while (leaf->is_branch())
+      leaf = m_mgr.read(leaf->branch().begin()->node_id);
+    m_parent_chain(leaf);
+    BOOST_ASSERT(m_parent_chain_ok(np.get()));
+    return;
+  }
+
+  //  The search for np's first key ends on np itself or, if that key is duplicated on
+  //  earlier leaves, on one of those; next_node() then walks right to np. Each step
+  //  sets the parent chain of the node stepped to, and np is the same buffer.
+  BOOST_ASSERT(!np->empty());
+  btree_node_ptr leaf = m_special_lower_bound(this->key(*np->leaf().begin())).m_node;
+  while (leaf->node_id() != np->node_id())
+  {
+    leaf = leaf->next_node();
+    BOOST_ASSERT_MSG(leaf, "leaf sibling links inconsistent with branches");
+  }
+  BOOST_ASSERT(np->parent());
+}
+
+//-------------------------------- m_parent_chain_ok() ---------------------------------//
+
+template <class Key, class Base>   
+bool
+btree_base<Key,Base>::m_parent_chain_ok(btree_node* np) const
+//  Splits, merges, and borrows move branch elements without updating the parent
+//  pointers of the cached children they describe, so a chain set by an earlier search
+//  may be stale. A stale link is detected because the element it points to no longer
+//  holds the child's node id; each node has only one parent, so a match is current.
+{
+  for (; np->level() != header().root_level(); np = np->parent().get())
+  {
+    btree_node* parent = np->parent().get();
+    if (!parent || parent->level() != np->level() + 1)
+      return false;
+    branch_value_type* element = np->parent_element();
+    if (element < parent->branch().begin() || element > parent->branch().end()
+      || element->node_id != np->node_id())
+      return false;
+  }
+  return np->node_id() == header().root_node_id();
+}
+
+//----------------------------- m_link_leaf(), m_unlink_leaf() -------------------------//
+
+template <class Key, class Base>   
+void
+btree_base<Key,Base>::m_link_leaf(btree_node* np, btree_node* np2)
+{
+  BOOST_ASSERT(np->is_leaf() && np2->is_leaf());
+  np2->leaf().prior_id(np->node_id());
+  np2->leaf().next_id(np->leaf().next_id());
+  if (np->leaf().next_id())
+  {
+    btree_node_ptr next(m_mgr.read(np->leaf().next_id()));
+    next->leaf().prior_id(np2->node_id());
+    next->needs_write(true);
+  }
+  np->leaf().next_id(np2->node_id());
+  np->needs_write(true);
+  np2->needs_write(true);
+}
+
+template <class Key, class Base>   
+void
+btree_base<Key,Base>::m_unlink_leaf(btree_node* np)
+{
+  BOOST_ASSERT(np->is_leaf());
+  node_id_type prior_id(np->leaf().prior_id());
+  node_id_type next_id(np->leaf().next_id());
+
+  if (prior_id)
+  {
+    btree_node_ptr prior(m_mgr.read(prior_id));
+    prior->leaf().next_id(next_id);
+    prior->needs_write(true);
+  }
+  else
+    m_hdr.first_node_id(next_id);
+
+  if (next_id)
+  {
+    btree_node_ptr next(m_mgr.read(next_id));
+    next->leaf().prior_id(prior_id);
+    next->needs_write(true);
+  }
+  else
+    m_hdr.last_node_id(prior_id);
+}
+
 //---------------------------------- m_leaf_insert() -----------------------------------//
 
 //  The key only is inserted; for sets the key_type is the value_type so nothing further
@@ -1315,10 +1820,13 @@ btree_base<Key,Base>::m_leaf_insert(const_iterator insert_iter, const key_type&
   {
     //  no room on node, so node must be split
 
+    m_parent_chain(np);  // np may have been reached through a sibling link
+
     if (np->level() == m_hdr.root_level()) // splitting the root?
       m_new_root();  // create a new root
     
-    np2 = m_new_node(np->level());  // create the new node 
+    np2 = m_new_node(np->level(), np->node_id());  // create the new node 
+    m_link_leaf(np.get(), np2.get());
 
     // ck pack optimization now, since header().last_node_id() may change
     if (m_ok_to_pack
@@ -1427,7 +1935,7 @@ btree_base<Key,Base>::m_branch_insert(btree_node_ptr np,
     if (np->level() == m_hdr.root_level()) // splitting the root?
       m_new_root();  // create a new root
     
-    np2 = m_new_node(np->level());  // create the new node
+    np2 = m_new_node(np->level(), np->node_id());  // create the new node
 
     // apply pack optimization if applicable
     if (m_ok_to_pack)
@@ -1543,35 +2051,25 @@ btree_base<Key,Base>::erase(const_iterator pos)
   {
     // erase a single value leaf node that is not the root
 
+    m_parent_chain(pos.m_node);  // pos may have been reached through a sibling link
     BOOST_ASSERT(pos.m_node->parent()->node_id() \
       == pos.m_node->parent_node_id()); // cache logic OK?
 
-    // Save the prior node to use below to obtain the return iterator. The prior node
-    // is saved rather than the next node, because the next node pointer will be
-    // invalidated by m_branch_erase_value(), while the prior node pointer will not be
-    // invalidated by m_branch_erase_value().
-    btree_node_ptr prior_node(pos.m_node->prior_node());  // may be null
-
-    if (pos.m_node->node_id() == header().last_node_id())
-    {
-      BOOST_ASSERT(prior_node);  // logic error; assert will only fire if this leaf is
-                                 // the root, but this control path should not be
-                                 // taken if this leaf is the root
-      m_hdr.last_node_id(prior_node->node_id());
-    }
+    // Leaf ids are not changed by m_erase_branch_value(), so the next leaf id obtains
+    // the return iterator.
+    node_id_type next_id = pos.m_node->leaf().next_id();
 
+    m_unlink_leaf(pos.m_node.get());
     m_erase_branch_value(pos.m_node->parent().get(), pos.m_node->parent_element());
 
     m_free_node(pos.m_node.get());  // add node to free node list
 
-    if (prior_node)
+    if (next_id)
     {
-      btree_node_ptr next_node(prior_node->next_node());
-      return next_node
-        ? const_iterator(next_node, next_node->leaf().begin())
-        : cend();
+      btree_node_ptr next_node(m_mgr.read(next_id));
+      return const_iterator(next_node, next_node->leaf().begin());
     }
-    return cbegin();
+    return cend();
   }
   else
   {
@@ -1587,9 +2085,14 @@ btree_base<Key,Base>::erase(const_iterator pos)
     pos.m_node->size(pos.m_node->size() - 1);
     std::memset(pos.m_node->leaf().end(), 0, sizeof(value_type));
 
+    if (m_min_fill_percent
+      && pos.m_node->node_id() != m_root->node_id()
+      && pos.m_node->size() * 100 < m_max_leaf_elements * m_min_fill_percent)
+      return m_rebalance_leaf(pos.m_node, element - pos.m_node->leaf().begin());
+
     if (pos.m_element != pos.m_node->leaf().end())
       return pos;
-    btree_node_ptr next_node(pos.m_node->next_node());
+    btree_node_ptr next_node(pos.m_node->next_leaf());
     return !next_node ? cend() : const_iterator(next_node, next_node->leaf().begin());
   }
 }
@@ -1639,6 +2142,14 @@ void btree_base<Key,Base>::m_erase_branch_value(
       0, sizeof(branch_value_type));
     np->needs_write(true);
 
+    if (m_min_fill_percent
+      && np->level() != header().root_level()
+      && np->size() * 100 < m_max_branch_elements * m_min_fill_percent)
+    {
+      m_rebalance_branch(np);
+      return;  // np has at least one key, or has been freed
+    }
+
     //  recursively free the root node if it is now empty, promoting the end
     //  pseudo element node_id to be the new root
     while (np->level()   // not the leaf (which can happen if iteration reaches leaf)
@@ -1659,6 +2170,174 @@ void btree_base<Key,Base>::m_erase_branch_value(
   }
 }
 
+//----------------------------------- m_sibling() --------------------------------------//
+
+template <class Key, class Base>
+typename btree_base<Key,Base>::btree_node_ptr
+btree_base<Key,Base>::m_sibling(btree_node* np, bool& is_right) const
+//  Requires: np's parent chain is current.
+//  Returns: The adjacent node under the same parent, preferring the right one, with
+//    its parent chain set; null if np is the parent's only child.
+{
+  btree_node* parent = np->parent().get();
+  branch_value_type* element = np->parent_element();
+  is_right = element != parent->branch().end();
+  if (!is_right && element == parent->branch().begin())
+    return btree_node_ptr();
+  branch_value_type* sibling_element = is_right ? element + 1 : element - 1;
+  btree_node_ptr sibling = m_mgr.read(sibling_element->node_id);
+  sibling->parent(np->parent());
+  sibling->parent_element(sibling_element);
+# ifndef NDEBUG
+  sibling->parent_node_id(parent->node_id());
+# endif
+  return sibling;
+}
+
+//-------------------------------- m_rebalance_leaf() ----------------------------------//
+
+template <class Key, class Base>
+typename btree_base<Key,Base>::const_iterator
+btree_base<Key,Base>::m_rebalance_leaf(btree_node_ptr np, std::size_t pos)
+//  Requires: np is a leaf other than the root, and has underflowed.
+//  Effects: Moves elements into np from a sibling, or if they fit on one leaf, merges
+//    the right leaf of the pair into the left one, frees it, and erases its element in
+//    the parent.
+//  Returns: An iterator to the element that was at position pos of np, or if pos is
+//    np's size, the element that followed np's last element.
+{
+  m_parent_chain(np);  // np may have been reached through a sibling link
+  bool is_right;
+  btree_node_ptr sibling = m_sibling(np.get(), is_right);
+  btree_node_ptr result_np = np;
+
+  if (sibling)
+  {
+    btree_node_ptr left = is_right ? np : sibling;
+    btree_node_ptr right = is_right ? sibling : np;
+    std::size_t left_sz = left->size();
+    std::size_t right_sz = right->size();
+    left->needs_write(true);
+    right->needs_write(true);
+
+    if (left_sz + right_sz <= m_max_leaf_elements)
+    {
+      //  merge right into left
+      std::memcpy(left->leaf().end(), right->leaf().begin(),
+        right_sz * sizeof(value_type));
+      left->size(left_sz + right_sz);
+      if (!is_right)
+        pos += left_sz;  // np was the right leaf
+      result_np = left;
+
+      m_unlink_leaf(right.get());
+      m_erase_branch_value(right->parent().get(), right->parent_element());
+      m_free_node(right.get());
+    }
+    else if (is_right)
+    {
+      //  move the first elements of the right sibling to the end of np
+      std::size_t n = right_sz > left_sz + 2 ? (right_sz - left_sz) / 2 : 1;
+      std::memcpy(left->leaf().end(), right->leaf().begin(), n * sizeof(value_type));
+      std::memmove(right->leaf().begin(), right->leaf().begin() + n,
+        (right_sz - n) * sizeof(value_type));
+      left->size(left_sz + n);
+      right->size(right_sz - n);
+      std::memcpy(&left->parent_element()->key,
+        &this->key(*right->leaf().begin()), sizeof(key_type));
+      left->parent()->needs_write(true);
+    }
+    else
+    {
+      //  move the last elements of the left sibling to the front of np
+      std::size_t n = left_sz > right_sz + 2 ? (left_sz - right_sz) / 2 : 1;
+      std::memmove(right->leaf().begin() + n, right->leaf().begin(),
+        right_sz * sizeof(value_type));
+      std::memcpy(right->leaf().begin(), left->leaf().begin() + (left_sz - n),
+        n * sizeof(value_type));
+      left->size(left_sz - n);
+      right->size(right_sz + n);
+      pos += n;
+      std::memcpy(&left->parent_element()->key,
+        &this->key(*right->leaf().begin()), sizeof(key_type));
+      left->parent()->needs_write(true);
+    }
+  }
+
+  if (pos != result_np->size())
+    return const_iterator(result_np, result_np->leaf().begin() + pos);
+  btree_node_ptr next_node(result_np->next_leaf());
+  return !next_node ? cend() : const_iterator(next_node, next_node->leaf().begin());
+}
+
+//------------------------------- m_rebalance_branch() ---------------------------------//
+
+template <class Key, class Base>
+void btree_base<Key,Base>::m_rebalance_branch(btree_node* np)
+//  Requires: np is a branch other than the root, has underflowed, and its parent
+//    chain is current.
+//  Effects: As m_rebalance_leaf(), except that keys rotate through the parent; the
+//    parent's separator moves down into the node receiving children, and the key
+//    beyond the last child moved takes its place.
+{
+  bool is_right;
+  btree_node_ptr sibling = m_sibling(np, is_right);
+  if (!sibling)
+    return;
+
+  btree_node* left = is_right ? np : sibling.get();
+  btree_node* right = is_right ? sibling.get() : np;
+  std::size_t left_sz = left->size();   // keys; children are one more
+  std::size_t right_sz = right->size();
+  branch_value_type* separator = left->parent_element();  // key separates left, right
+  left->needs_write(true);
+  right->needs_write(true);
+  left->parent()->needs_write(true);
+
+  if (left_sz + 1 + right_sz <= m_max_branch_elements)
+  {
+    //  merge right into left; the separator moves down between them
+    std::memcpy(&left->branch().end()->key, &separator->key, sizeof(key_type));
+    std::memcpy(left->branch().end() + 1, right->branch().begin(),
+      right_sz * sizeof(branch_value_type) + sizeof(node_id_type));
+    left->size(left_sz + 1 + right_sz);
+
+    m_erase_branch_value(right->parent().get(), right->parent_element());
+    m_free_node(right);
+  }
+  else if (is_right)
+  {
+    //  move the first n children of right to the end of left
+    std::size_t n = right_sz > left_sz + 2 ? (right_sz - left_sz) / 2 : 1;
+    std::memcpy(&left->branch().end()->key, &separator->key, sizeof(key_type));
+    std::memcpy(left->branch().end() + 1, right->branch().begin(),
+      (n - 1) * sizeof(branch_value_type) + sizeof(node_id_type));
+    std::memcpy(&separator->key, &(right->branch().begin() + (n - 1))->key,
+      sizeof(key_type));
+    std::memmove(right->branch().begin(), right->branch().begin() + n,
+      (right_sz - n) * sizeof(branch_value_type) + sizeof(node_id_type));
+    left->size(left_sz + n);
+    right->size(right_sz - n);
+  }
+  else
+  {
+    //  move the last n children of left to the front of right
+    std::size_t n = left_sz > right_sz + 2 ? (left_sz - right_sz) / 2 : 1;
+    std::memmove(right->branch().begin() + n, right->branch().begin(),
+      right_sz * sizeof(branch_value_type) + sizeof(node_id_type));
+    std::memcpy(&(right->branch().begin() + (n - 1))->key, &separator->key,
+      sizeof(key_type));
+    std::memcpy(right->branch().begin(), left->branch().begin() + (left_sz - n + 1),
+      (n - 1) * sizeof(branch_value_type) + sizeof(node_id_type));
+    std::memcpy(&separator->key, &(left->branch().begin() + (left_sz - n))->key,
+      sizeof(key_type));
+    left->size(left_sz - n);
+    right->size(right_sz + n);
+  }
+}
+
+//------------------------------------- erase() ----------------------------------------//
+
 template <class Key, class Base>   
 typename btree_base<Key,Base>::size_type
 btree_base<Key,Base>::erase(const key_type& k)
@@ -1682,7 +2361,15 @@ btree_base<Key,Base>::erase(const_iterator first, const_iterator last)
 {
   BOOST_ASSERT_MSG(is_open(), "erase() on unopen btree");
   BOOST_ASSERT_MSG((flags() & flags::read_only) == 0, "erase() on read only btree");
-  //
+
+  if (m_min_fill_percent)
+  {
+    //  rebalancing may move the elements last points to, so count them instead
+    for (size_type n = std::distance(first, last); n; --n)
+      first = erase(first);
+    return first;
+  }
+
   while (first != last)
   {
     // last must be adjusted when on the same node as first
@@ -1730,24 +2417,726 @@ btree_base<Key,Base>::m_insert_non_unique(const key_type& k)
   return m_leaf_insert(insert_point, k);
 }
 
-//----------------------------- m_special_lower_bound() --------------------------------//
-
-template <class Key, class Base>
-template <class K>
-typename btree_base<Key,Base>::const_iterator
-btree_base<Key,Base>::m_special_lower_bound(const K& k) const
-//  m_special_lower_bound() differs from lower_bound() in that if the search key is not
-//  present and the first key greater than the search key is the first key on a leaf
-//  other than the first leaf, the returned iterator points to the end element of
-//  the leaf prior to the leaf whose first element is the true lower bound.
-//
-//  Those semantics are useful because the returned iterator is pointing to the insertion
-//  point for unique inserts and does not miss the first key in a series of non-unique
-//  keys that do not begin on a node boundary.
+//------------------------------------ m_hint_ok() -------------------------------------//
 
-//  Analysis; consider a branch node with these entries:
+template <class Key, class Base>   
+bool
+btree_base<Key,Base>::m_hint_ok(const_iterator& hint, const key_type& k,
+  bool unique) const
+//  Effects: If hint is end(), sets hint to the end of the last leaf.
+//  Returns: true if k can be inserted immediately before hint without a leaf split.
 //
-//     P0, K0="B", P1, K1="D", P2, K2="F", P3, ---
+//  Only positions the descent for k would also reach are accepted; between two elements
+//  of the same leaf, before the first element of the first leaf, or after the last
+//  element of the last leaf. Before the first or after the last element of any other
+//  leaf the position depends on the parent's branch key, so the hint is rejected.
+//  A split needs an up-to-date parent chain, which a cached leaf may not have, so a
+//  full leaf is rejected too; the fallback search then refreshes the chain.
+{
+  if (empty())
+    return false;
+  if (hint.m_node == m_end_iterator.m_node)
+  {
+    btree_node_ptr np = m_mgr.read(header().last_node_id());
+    hint = const_iterator(np, np->leaf().end());
+  }
+
+  btree_node* np = hint.m_node.get();
+  BOOST_ASSERT(np->is_leaf());
+  if (np->size() == m_max_leaf_elements)
+    return false;
+
+  const value_type* pos = hint.m_element;
+  BOOST_ASSERT(pos >= np->leaf().begin() && pos <= np->leaf().end());
+
+  if (pos == np->leaf().begin() ? np->leaf().prior_id() != 0
+      : (unique ? !key_comp()(this->key(*(pos-1)), k)   // prior element >= k
+                : key_comp()(k, this->key(*(pos-1)))))  // prior element > k
+    return false;
+
+  return pos == np->leaf().end() ? np->leaf().next_id() == 0
+      : (unique ? key_comp()(k, this->key(*pos))        // k < element
+                : !key_comp()(this->key(*pos), k));     // k <= element
+}
+
+//---------------------------- m_insert_unique() with hint -----------------------------//
+
+template <class Key, class Base>   
+std::pair<typename btree_base<Key,Base>::const_iterator, bool>
+btree_base<Key,Base>::m_insert_unique(const_iterator hint, const key_type& k)
+{
+  BOOST_ASSERT_MSG(is_open(), "insert() on unopen btree");
+  BOOST_ASSERT_MSG((flags() & flags::read_only) == 0, "insert() on read only btree");
+
+  if (m_hint_ok(hint, k, true))
+    return std::pair<const_iterator, bool>(m_leaf_insert(hint, k), true);
+  return m_insert_unique(k);
+}
+
+//-------------------------- m_insert_non_unique() with hint ---------------------------//
+
+template <class Key, class Base>   
+typename btree_base<Key,Base>::const_iterator
+btree_base<Key,Base>::m_insert_non_unique(const_iterator hint, const key_type& k)
+{
+  BOOST_ASSERT_MSG(is_open(), "insert() on unopen btree");
+  BOOST_ASSERT_MSG((flags() & flags::read_only) == 0, "insert() on read only btree");
+
+  if (m_hint_ok(hint, k, false))
+    return m_leaf_insert(hint, k);
+  return m_insert_non_unique(k);
+}
+
+//------------------------------------ bulk_build() -------------------------------------//
+
+template <class Key, class Base>
+template <class InputIterator>
+void
+btree_base<Key,Base>::bulk_build(InputIterator begin, InputIterator end,
+  double fill_factor)
+{
+  BOOST_ASSERT_MSG(is_open(), "bulk_build() on unopen btree");
+  BOOST_ASSERT_MSG((flags() & flags::read_only) == 0, "bulk_build() on read only btree");
+  BOOST_ASSERT_MSG(empty(), "bulk_build() on non-empty btree");
+  BOOST_ASSERT_MSG(fill_factor > 0.0 && fill_factor <= 1.0,
+    "bulk_build() fill_factor out of range");
+
+  std::size_t leaf_fill = static_cast<std::size_t>(m_max_leaf_elements * fill_factor);
+  if (leaf_fill < 1)
+    leaf_fill = 1;
+  std::size_t branch_fill = static_cast<std::size_t>(m_max_branch_elements * fill_factor);
+  if (branch_fill < 2)  // see m_build_level()
+    branch_fill = 2;
+  const bool unique = (header().flags() & flags::unique) != 0;
+
+  //  Leaves are written in order of ascending node id, so flushing every half cache
+  //  full lets buffer_manager::flush() coalesce them into large sequential writes,
+  //  and leaves the cache free to evict them without further writes.
+  std::size_t flush_interval = max_cache_size() / 2;
+  if (flush_interval < m_mgr.max_write_batch())
+    flush_interval = m_mgr.max_write_batch();
+
+  //  the empty root leaf becomes the first leaf
+  btree_node_ptr np = m_root;
+  BOOST_ASSERT(np->is_leaf());
+  std::vector<branch_value_type> level;  // first key and node id of each leaf
+  branch_value_type bv;
+  std::memset(static_cast<void*>(&bv), 0, sizeof(branch_value_type));  // the first key is never used
+  bv.node_id = np->node_id();
+  level.push_back(bv);
+  size_type count = 0;
+
+  try
+  {
+    for (; begin != end; ++begin)
+    {
+      const value_type& v = *begin;
+      if (np->size())
+      {
+        const key_type& prior = this->key(*(np->leaf().end()-1));
+        if (key_comp()(this->key(v), prior))
+          throw std::runtime_error("bulk_build() input not sorted");
+        if (unique && !key_comp()(prior, this->key(v)))
+          continue;  // equivalent key already inserted
+      }
+
+      if (np->size() == leaf_fill)
+      {
+        btree_node_ptr np2 = m_new_node(0);
+        m_link_leaf(np.get(), np2.get());
+        bv.node_id = np2->node_id();
+        std::memcpy(&bv.key, &this->key(v), sizeof(key_type));
+        level.push_back(bv);
+        np = np2;
+        if (level.size() % flush_interval == 0)
+          m_mgr.flush();
+      }
+
+      std::memcpy(np->leaf().end(), &v, sizeof(value_type));
+      np->size(np->size()+1);
+      np->needs_write(true);
+      ++count;
+    }
+  }
+  catch (...)
+  {
+    //  leave the tree empty, as it was; the leaves added are freed, and the root
+    //  leaf emptied
+    np.reset();
+    for (std::size_t i = 1; i < level.size(); ++i)
+    {
+      btree_node_ptr leaf(m_mgr.read(level[i].node_id));
+      m_free_node(leaf.get());
+    }
+    std::memset(m_root->leaf().begin(), 0, m_root->size() * sizeof(value_type));
+    m_root->size(0);
+    m_root->leaf().next_id(node_id_type(0));
+    m_root->needs_write(true);
+    BOOST_ASSERT(m_hdr.leaf_node_count() == 1);
+    BOOST_ASSERT(m_hdr.last_node_id() == m_root->node_id());
+    throw;
+  }
+
+  m_hdr.element_count(count);
+  m_hdr.last_node_id(np->node_id());
+  np.reset();
+
+  //  build each branch level from the level below, until one node remains
+  node_level_type lv = 0;
+  while (level.size() > 1)
+    m_root = m_build_level(level, ++lv, branch_fill, flush_interval);
+  m_hdr.root_node_id(m_root->node_id());
+  m_hdr.root_level(lv);
+
+  //  maintain max_cache_size() > levels() invariant
+  if (max_cache_size() < header().levels() + 1)
+    max_cache_size(header().levels() + 1);
+  m_free_sync();
+  m_mgr.flush();
+  m_write_header();  // flush() would skip it if the intermediate flushes wrote all
+}
+
+//---------------------------------- m_build_level() -----------------------------------//
+
+template <class Key, class Base>
+typename btree_base<Key,Base>::btree_node_ptr
+btree_base<Key,Base>::m_build_level(std::vector<branch_value_type>& level,
+  node_level_type lv, std::size_t fill, std::size_t flush_interval)
+//  On entry, level holds the first key and node id of each node on level lv-1. Builds
+//  level lv with up to fill+1 children per node, and replaces level with its entries.
+//  The children are spread evenly over the nodes, so with fill >= 2 each node gets at
+//  least two children, and thus at least one key.
+//  Returns: The last node built.
+{
+  BOOST_ASSERT(level.size() > 1);
+  BOOST_ASSERT(fill >= 2 && fill <= m_max_branch_elements);
+  std::size_t nodes = (level.size() + fill) / (fill + 1);  // ceiling
+  std::size_t per_node = level.size() / nodes;
+  std::size_t extra = level.size() % nodes;  // the first extra nodes get one more
+
+  btree_node_ptr np;
+  std::size_t child = 0;
+  for (std::size_t n = 0; n < nodes; ++n)
+  {
+    std::size_t children = per_node + (n < extra ? 1 : 0);
+    BOOST_ASSERT(children >= 2 && children <= fill + 1);
+    np = m_new_node(lv);
+
+    //  P0, K0 = first key of P1, P1, K1, ... Pn
+    branch_value_type* bp = np->branch().begin();
+    bp->node_id = level[child].node_id;
+    for (std::size_t i = 1; i < children; ++i)
+    {
+      std::memcpy(&bp->key, &level[child+i].key, sizeof(key_type));
+      (++bp)->node_id = level[child+i].node_id;
+    }
+    np->size(children - 1);
+
+    //  level is rewritten in place, as the entries for level lv are never ahead of
+    //  those for level lv-1 not yet consumed
+    if (n != child)
+      std::memcpy(&level[n].key, &level[child].key, sizeof(key_type));
+    level[n].node_id = np->node_id();
+    child += children;
+
+    if ((n + 1) % flush_interval == 0)
+      m_mgr.flush();
+  }
+  BOOST_ASSERT(child == level.size());
+  level.resize(nodes);
+  return np;
+}
+
+//---------------------------------- compact_start() -----------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::compact_start(double fill_factor)
+{
+  BOOST_ASSERT_MSG(is_open(), "compact_start() on unopen btree");
+  BOOST_ASSERT_MSG((flags() & flags::read_only) == 0,
+    "compact_start() on read only btree");
+  BOOST_ASSERT_MSG(!compacting(), "compact_start() while compacting");
+  BOOST_ASSERT_MSG(fill_factor > 0.0 && fill_factor <= 1.0,
+    "compact_start() fill_factor out of range");
+
+  std::vector<branch_value_type> level;
+  std::vector<node_id_type> branches;
+  m_leaf_level(level, &branches);
+
+  m_compact_stats = compact_stats();
+  m_compact_stats.nodes_before = m_mgr.buffer_count();
+  m_compact_stats.branches_before = branches.size();
+  m_compact_measure(level, m_compact_stats.leaves_before, m_compact_stats.fill_before,
+    m_compact_stats.sequential_before);
+
+  m_compact = new compact_state;
+  compact_state& cs = *m_compact;
+  cs.leaf_fill = static_cast<std::size_t>(m_max_leaf_elements * fill_factor);
+  if (cs.leaf_fill < 1)
+    cs.leaf_fill = 1;
+  cs.branch_fill = static_cast<std::size_t>(m_max_branch_elements * fill_factor);
+  if (cs.branch_fill < 2)  // see m_build_level()
+    cs.branch_fill = 2;
+
+  //  every node not in the tree is free, including any lost from the free node list
+  std::vector<bool> live(m_mgr.buffer_count(), false);
+  for (std::size_t i = 0; i < level.size(); ++i)
+    live[level[i].node_id] = true;
+  for (std::size_t i = 0; i < branches.size(); ++i)
+    live[branches[i]] = true;
+  m_free_load();
+  for (std::size_t id = 1; id < live.size(); ++id)
+  {
+    if (!live[id] && !m_free.test(id))
+    {
+      m_free.set(id);
+      m_free_touch(id);
+    }
+  }
+
+  cs.target = 1;
+  cs.cursor.node_id = m_hdr.first_node_id();
+  btree_node_ptr np = m_mgr.read(m_hdr.first_node_id());
+  if (!np->empty())
+    std::memcpy(&cs.cursor.key, &this->key(*np->leaf().begin()), sizeof(key_type));
+  cs.changes = m_node_changes;
+}
+
+//---------------------------------- compact_step() ------------------------------------//
+
+template <class Key, class Base>
+bool
+btree_base<Key,Base>::compact_step(std::size_t max_nodes)
+{
+  if (!m_compact)
+    return true;
+  if (m_compact->cursor.node_id)
+  {
+    m_compact_leaves(max_nodes ? max_nodes : 1);
+    return false;
+  }
+  m_compact_branches();
+  m_compact_finish();
+  return true;
+}
+
+//-------------------------------- m_compact_leaves() ----------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::m_compact_leaves(std::size_t budget)
+//  Effects: Fills and places up to budget leaves, starting at the cursor, and moves
+//    the cursor past them.
+{
+  compact_state& cs = *m_compact;
+  btree_node_ptr np;
+
+  if (cs.changes == m_node_changes)  // the cursor leaf still has the same node id
+    np = m_mgr.read(cs.cursor.node_id);
+  else if (empty())
+    np = m_mgr.read(m_hdr.first_node_id());
+  else
+  {
+    //  nodes have been split, merged, or freed since the last step, so find the
+    //  leaf by its first key
+    const_iterator itr = m_special_lower_bound(cs.cursor.key);
+    np = itr.m_node;
+    if (itr.m_element == np->leaf().end())
+    {
+      if (!np->leaf().next_id())
+      {
+        cs.cursor.node_id = 0;
+        return;
+      }
+      np = np->next_leaf();
+    }
+  }
+
+  for (; budget; --budget)
+  {
+    BOOST_ASSERT(np->is_leaf());
+    if (np->size() < cs.leaf_fill && np->leaf().next_id())
+    {
+      btree_node_ptr right = np->next_leaf();
+      m_compact_pull(np, right);
+      continue;
+    }
+
+    if (cs.target < m_mgr.buffer_count() && np->node_id() != cs.target)
+      m_swap_nodes(np, node_id_type(cs.target));
+    ++cs.target;
+    ++m_compact_stats.leaves_done;
+
+    if (!np->leaf().next_id())
+    {
+      cs.cursor.node_id = 0;
+      return;
+    }
+    np = np->next_leaf();
+  }
+
+  cs.cursor.node_id = np->node_id();
+  std::memcpy(&cs.cursor.key, &this->key(*np->leaf().begin()), sizeof(key_type));
+  cs.changes = m_node_changes;
+}
+
+//--------------------------------- m_compact_pull() -----------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::m_compact_pull(btree_node_ptr& np, btree_node_ptr& right)
+//  Requires: right is the leaf after np, and np holds fewer than leaf_fill elements.
+//  Effects: Moves elements from the front of right to the end of np until np holds
+//    leaf_fill elements or right is empty, in which case right is freed. The key
+//    separating the two leaves is in the branch that is their lowest common ancestor,
+//    and is fixed up there.
+{
+  m_parent_chain(right);  // right was reached through a sibling link
+  std::size_t np_sz = np->size();
+  std::size_t right_sz = right->size();
+  std::size_t n = (std::min)(m_compact->leaf_fill - np_sz, right_sz);
+  std::memcpy(np->leaf().end(), right->leaf().begin(), n * sizeof(value_type));
+  np->size(np_sz + n);
+  np->needs_write(true);
+  right->needs_write(true);
+
+  //  right is the first leaf below each node on the path up to c, so the separator
+  //  is the key before c's element in c's parent
+  btree_node* c = right.get();
+  while (c->parent_element() == c->parent()->branch().begin())
+    c = c->parent().get();
+  branch_value_type* separator = c->parent_element() - 1;
+
+  if (n < right_sz)
+  {
+    std::memmove(right->leaf().begin(), right->leaf().begin() + n,
+      (right_sz - n) * sizeof(value_type));
+    right->size(right_sz - n);
+    std::memset(right->leaf().end(), 0, n * sizeof(value_type));
+    std::memcpy(&separator->key, &this->key(*right->leaf().begin()), sizeof(key_type));
+    c->parent()->needs_write(true);
+    return;
+  }
+
+  //  Erasing right's element removes the separator itself if right is not the first
+  //  child of its parent, or any ancestor up to c holds a key. Otherwise it removes
+  //  P0 and K0 of the lowest such ancestor, and that K0 becomes the separator.
+  for (btree_node* a = right.get(); a != c;)
+  {
+    a = a->parent().get();
+    if (!a->empty())
+    {
+      std::memcpy(&separator->key, &a->branch().begin()->key, sizeof(key_type));
+      c->parent()->needs_write(true);
+      break;
+    }
+  }
+
+  m_unlink_leaf(right.get());
+  m_erase_branch_value(right->parent().get(), right->parent_element());
+  m_free_node(right.get());
+}
+
+//---------------------------------- m_swap_nodes() ------------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::m_swap_nodes(btree_node_ptr& np, node_id_type id)
+//  Requires: m_free is loaded. np is a leaf or branch. id is not the header or np's id.
+//  Effects: Exchanges the node ids of np and the node at id, which may be free, by
+//    exchanging their contents and then updating the references to each; the element
+//    in its parent or, for the root, the header, and for a leaf, the sibling links and
+//    the header's first and last leaf. np is set to point to np's new buffer.
+{
+  node_id_type from(np->node_id());
+  bool other_free = m_free.test(id);
+  btree_node_ptr other = other_free ? m_mgr.overwrite(id) : m_mgr.read(id);
+  BOOST_ASSERT(other_free || other->level() <= header().root_level());
+
+  //  gather the references to both nodes before changing either, as they may refer
+  //  to each other
+  btree_node* node[2] = {np.get(), other.get()};
+  node_id_type new_id[2] = {id, from};
+  btree_node_ptr parent[2];
+  branch_value_type* element[2] = {0, 0};
+  node_id_type prior[2] = {node_id_type(0), node_id_type(0)};
+  node_id_type next[2] = {node_id_type(0), node_id_type(0)};
+  for (int i = 0; i < (other_free ? 1 : 2); ++i)
+  {
+    if (node[i]->level() != header().root_level())
+    {
+      m_parent_chain(btree_node_ptr(*node[i]));
+      parent[i] = node[i]->parent();
+      element[i] = node[i]->parent_element();
+    }
+    if (node[i]->is_leaf())
+    {
+      prior[i] = node[i]->leaf().prior_id();
+      next[i] = node[i]->leaf().next_id();
+    }
+  }
+
+  for (int i = 0; i < 2; ++i)
+  {
+    if (parent[i])
+    {
+      element[i]->node_id = new_id[i];
+      parent[i]->needs_write(true);
+    }
+    if (prior[i])
+    {
+      btree_node_ptr prior_np(m_mgr.read(prior[i]));
+      prior_np->leaf().next_id(new_id[i]);
+      prior_np->needs_write(true);
+    }
+    if (next[i])
+    {
+      btree_node_ptr next_np(m_mgr.read(next[i]));
+      next_np->leaf().prior_id(new_id[i]);
+      next_np->needs_write(true);
+    }
+  }
+
+  uint32_t a = from;
+  uint32_t b = id;
+  if (m_hdr.root_node_id() == a || m_hdr.root_node_id() == b)
+    m_hdr.root_node_id(m_hdr.root_node_id() == a ? b : a);
+  if (m_hdr.first_node_id() == a || m_hdr.first_node_id() == b)
+    m_hdr.first_node_id(m_hdr.first_node_id() == a ? b : a);
+  if (m_hdr.last_node_id() == a || m_hdr.last_node_id() == b)
+    m_hdr.last_node_id(m_hdr.last_node_id() == a ? b : a);
+
+  if (other_free)
+  {
+    std::memcpy(other->data(), np->data(), node_size());
+    np->level(0xFF);
+    np->size(0);
+    m_free.reset(id);
+    m_free_touch(id);
+    m_free.set(from);
+    m_free_touch(from);
+  }
+  else
+    std::swap_ranges(np->data(), np->data() + node_size(), other->data());
+
+  //  children of either node are left with stale parent chains; see m_parent_chain()
+  np->needs_write(true);
+  other->needs_write(true);
+  np->parent_reset();
+  other->parent_reset();
+  if (m_root->node_id() != m_hdr.root_node_id())
+  {
+    m_root = m_mgr.read(m_hdr.root_node_id());
+    m_root->parent_reset();
+    m_root->parent_element(0);
+  }
+  np = other;
+}
+
+//------------------------------- m_compact_branches() ---------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::m_compact_branches()
+//  Effects: Replaces the branches with new ones built from the leaf level, as
+//    bulk_build() does. The old branches are freed first, so the new ones take the
+//    lowest free node ids, which follow the placed leaves.
+{
+  if (m_root->is_leaf())
+    return;
+
+  std::vector<branch_value_type> level;
+  std::vector<node_id_type> branches;
+  m_leaf_level(level, &branches);
+  m_root.reset();
+  for (std::size_t i = 0; i < branches.size(); ++i)
+  {
+    btree_node_ptr np(m_mgr.read(branches[i]));
+    m_free_node(np.get());
+  }
+
+  std::size_t flush_interval = max_cache_size() / 2;
+  if (flush_interval < m_mgr.max_write_batch())
+    flush_interval = m_mgr.max_write_batch();
+  node_level_type lv = 0;
+  while (level.size() > 1)
+    m_root = m_build_level(level, ++lv, m_compact->branch_fill, flush_interval);
+  if (!lv)
+    m_root = m_mgr.read(level.front().node_id);
+  m_hdr.root_node_id(m_root->node_id());
+  m_hdr.root_level(lv);
+  m_root->parent_reset();
+  m_root->parent_element(0);
+
+  //  maintain max_cache_size() > levels() invariant
+  if (max_cache_size() < header().levels() + 1)
+    max_cache_size(header().levels() + 1);
+}
+
+//-------------------------------- m_compact_finish() ----------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::m_compact_finish()
+//  Effects: Cuts free nodes from the end of the file, and ends the compaction.
+{
+  std::size_t node_count = m_mgr.buffer_count();
+  m_truncate_free_tail();
+  if (m_mgr.buffer_count() < node_count)
+  {
+    m_free_sync();
+    m_mgr.flush();
+    m_write_header();  // flush() would skip it if no node was left dirty
+  }
+  delete m_compact;
+  m_compact = 0;
+
+  std::vector<branch_value_type> level;
+  m_leaf_level(level, 0);
+  m_compact_stats.nodes_after = m_mgr.buffer_count();
+  m_compact_stats.branches_after = header().branch_node_count();
+  m_compact_measure(level, m_compact_stats.leaves_after, m_compact_stats.fill_after,
+    m_compact_stats.sequential_after);
+}
+
+//--------------------------------- shrink_to_fit() ------------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::shrink_to_fit()
+{
+  BOOST_ASSERT_MSG(is_open(), "shrink_to_fit() on unopen btree");
+  BOOST_ASSERT_MSG((flags() & flags::read_only) == 0,
+    "shrink_to_fit() on read only btree");
+  BOOST_ASSERT_MSG(!compacting(), "shrink_to_fit() while compacting");
+
+  //  working down from the end of the file, move each node into the lowest free node,
+  //  until there is no free node below it
+  m_free_load();
+  for (std::size_t id = m_mgr.buffer_count() - 1; id > 1; --id)
+  {
+    std::size_t free_id = m_free.lowest();
+    if (!free_id || free_id > id)
+      break;
+    if (m_free.test(id))
+      continue;
+    btree_node_ptr np(m_mgr.read(id));
+    if (np->level() == 0xFF)  // lost from the free node list
+    {
+      m_free.set(id);
+      m_free_touch(id);
+      continue;
+    }
+    m_swap_nodes(np, node_id_type(free_id));
+  }
+
+  m_truncate_free_tail();
+  m_free_sync();
+  m_mgr.flush();
+  m_write_header();  // flush() would skip it if the moves were all written on eviction
+}
+
+//------------------------------ m_truncate_free_tail() --------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::m_truncate_free_tail()
+//  Effects: Cuts the free nodes at the end of the file from it, stopping at any that
+//    is still in use.
+{
+  std::size_t n = m_mgr.buffer_count();
+  while (n > 1 && m_free.test(n-1) && !m_mgr.in_use(n-1))
+  {
+    m_free.reset(--n);
+    m_free_touch(n);  // the free node before it is relinked
+  }
+  if (n < m_mgr.buffer_count())
+  {
+    m_free.resize(n);
+    m_mgr.truncate(n);
+    m_hdr.node_count(static_cast<uint32_t>(n));
+  }
+  BOOST_ASSERT(m_hdr.node_count() == m_mgr.buffer_count());
+}
+
+//---------------------------------- m_leaf_level() ------------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::m_leaf_level(std::vector<branch_value_type>& level,
+  std::vector<node_id_type>* branches) const
+//  Effects: Sets level to the node id of each leaf in key order, with the key that
+//    separates it from the prior leaf, as m_build_level() expects. If branches is not
+//    null, sets it to the node ids of the branches. Only branches are read.
+{
+  level.clear();
+  if (branches)
+    branches->clear();
+  m_leaf_level(node_id_type(m_hdr.root_node_id()), m_hdr.root_level(), 0, level,
+    branches);
+}
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::m_leaf_level(node_id_type id, unsigned lv,
+  const key_type* separator, std::vector<branch_value_type>& level,
+  std::vector<node_id_type>* branches) const
+{
+  if (!lv)
+  {
+    branch_value_type bv;
+    std::memset(static_cast<void*>(&bv), 0, sizeof(branch_value_type));
+    bv.node_id = id;
+    if (separator)
+      std::memcpy(&bv.key, separator, sizeof(key_type));
+    level.push_back(bv);
+    return;
+  }
+
+  if (branches)
+    branches->push_back(id);
+  btree_node_ptr np(m_mgr.read(id));
+  BOOST_ASSERT(np->level() == lv);
+  for (branch_value_type* bp = np->branch().begin(); bp <= np->branch().end(); ++bp)
+    m_leaf_level(bp->node_id, lv - 1,
+      bp == np->branch().begin() ? separator : &(bp-1)->key, level, branches);
+}
+
+//-------------------------------- m_compact_measure() ---------------------------------//
+
+template <class Key, class Base>
+void
+btree_base<Key,Base>::m_compact_measure(const std::vector<branch_value_type>& level,
+  boost::uint64_t& leaves, double& fill, double& sequential) const
+{
+  leaves = level.size();
+  fill = size() * 100.0 / (static_cast<double>(leaves) * m_max_leaf_elements);
+  std::size_t steps = 0;
+  for (std::size_t i = 1; i < level.size(); ++i)
+    if (level[i].node_id == level[i-1].node_id + 1)
+      ++steps;
+  sequential = leaves > 1 ? steps * 100.0 / (leaves - 1) : 100.0;
+}
+
+//----------------------------- m_special_lower_bound() --------------------------------//
+
+template <class Key, class Base>
+template <class K>
+typename btree_base<Key,Base>::const_iterator
+btree_base<Key,Base>::m_special_lower_bound(const K& k) const
+//  m_special_lower_bound() differs from lower_bound() in that if the search key is not
+//  present and the first key greater than the search key is the first key on a leaf
+//  other than the first leaf, the returned iterator points to the end element of
+//  the leaf prior to the leaf whose first element is the true lower bound.
+//
+//  Those semantics are useful because the returned iterator is pointing to the insertion
+//  point for unique inserts and does not miss the first key in a series of non-unique
+//  keys that do not begin on a node boundary.
+
+//  Analysis; consider a branch node with these entries:
+//
+//     P0, K0="B", P1, K1="D", P2, K2="F", P3, ---
 //     ----------  ----------  ----------  ------------------
 //     element 0   element 1   element 2   end pseudo-element
 //
@@ -1763,8 +3152,9 @@ btree_base<Key,Base>::m_special_lower_bound(const K& k) const
   // search branches down the tree until a leaf is reached
   while (np->is_branch())
   {
-    branch_value_type* low
-      = std::lower_bound(np->branch().begin(), np->branch().end(), k, branch_comp());
+    branch_value_type* low = detail::node_lower_bound<compare_type, search_policy>(
+      np->branch().begin(), np->branch().end(), &np->branch().begin()->key, k,
+      branch_comp());
 
     if ((header().flags() & btree::flags::unique)
       && low != np->branch().end()
@@ -1784,12 +3174,122 @@ btree_base<Key,Base>::m_special_lower_bound(const K& k) const
   }
 
   //  search leaf
-  value_type* low
-    = std::lower_bound(np->leaf().begin(), np->leaf().end(), k, value_comp());
+  value_type* low = detail::node_lower_bound<compare_type, search_policy>(
+    np->leaf().begin(), np->leaf().end(), &this->key(*np->leaf().begin()), k,
+    value_comp());
+
+  return const_iterator(np, low);
+}
+
+template <class Key, class Base>
+template <class K>
+typename btree_base<Key,Base>::const_iterator
+btree_base<Key,Base>::m_special_lower_bound(const K& k,
+  std::vector<btree_node_ptr>& path, const const_iterator& prior) const
+//  The child a branch element leads to is bounded below by the key of the element
+//  before it, which prior's key already satisfied, so k, not less than prior's key,
+//  stays on the path for as long as it is not beyond the key of the element taken.
+{
+  bool unique = (header().flags() & btree::flags::unique) != 0;
+  std::size_t depth = 0;
+  branch_value_type* from = 0;  // where the search of path[depth] starts
+
+  if (path.empty())
+    path.push_back(m_root);
+  else
+  {
+    for (; depth + 1 < path.size(); ++depth)
+    {
+      btree_node* np = path[depth].get();
+      branch_value_type* elem = path[depth+1]->parent_element();
+      if (elem != np->branch().end()
+        && (unique ? !key_comp()(k, elem->key) : key_comp()(elem->key, k)))
+      {
+        from = elem + 1;  // k goes to a later child
+        break;
+      }
+    }
+    path.resize(depth + 1);
+  }
+
+  // search branches down the tree from where k left the path
+  btree_node_ptr np = path.back();
+  while (np->is_branch())
+  {
+    if (!from)
+      from = np->branch().begin();
+    branch_value_type* low = detail::node_lower_bound<compare_type, search_policy>(
+      from, np->branch().end(), &from->key, k, branch_comp());
+
+    if (unique
+      && low != np->branch().end()
+      && !key_comp()(k, low->key)) // see m_special_lower_bound(k)
+      ++low;
+
+    btree_node_ptr child_np = m_mgr.read(low->node_id);
+    child_np->parent(np);
+    child_np->parent_element(low);
+#   ifndef NDEBUG
+    child_np->parent_node_id(np->node_id());
+#   endif
+
+    path.push_back(child_np);
+    np = child_np;
+    from = 0;
+  }
+
+  //  search leaf, from prior's element if k stayed on prior's leaf
+  value_type* begin = np == prior.m_node
+    ? const_cast<value_type*>(prior.m_element) : np->leaf().begin();
+  value_type* low = detail::node_lower_bound<compare_type, search_policy>(
+    begin, np->leaf().end(), &this->key(*begin), k, value_comp());
 
   return const_iterator(np, low);
 }
 
+//---------------------------------- m_bound_many() ------------------------------------//
+
+template <class Key, class Base>
+template <class InputIterator, class OutputIterator>
+OutputIterator
+btree_base<Key,Base>::m_bound_many(InputIterator first, InputIterator last,
+  OutputIterator result, bool find) const
+{
+  BOOST_ASSERT_MSG(is_open(), "find_many() or lower_bound_many() on unopen btree");
+
+  typedef typename std::iterator_traits<InputIterator>::value_type probe_type;
+  std::vector<probe_type> probes(first, last);
+  std::vector<std::size_t> order(probes.size());
+  for (std::size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), probe_less<probe_type>(probes, key_comp()));
+
+  std::vector<const_iterator> found(probes.size(), end());
+  std::vector<btree_node_ptr> path;
+  const_iterator prior;
+  for (std::size_t i = 0; i < order.size(); ++i)
+  {
+    const probe_type& k = probes[order[i]];
+    prior = m_special_lower_bound(k, path, prior);
+
+    //  as lower_bound(), the end of a leaf becomes the start of the next
+    const_iterator low = prior;
+    if (low.m_element == low.m_node->leaf().end())
+    {
+      if (low.m_node->leaf().begin() == low.m_node->leaf().end())
+        continue;  // empty tree
+      btree_node_ptr np = low.m_node->next_leaf();
+      if (!np)
+        continue;
+      low = const_iterator(np, np->leaf().begin());
+    }
+    if (!find || !key_comp()(k, this->key(*low)))
+      found[order[i]] = low;
+  }
+
+  return std::copy(found.begin(), found.end(), result);
+}
+
 //---------------------------------- lower_bound() -------------------------------------//
 
 template <class Key, class Base>
@@ -1811,7 +3311,7 @@ btree_base<Key,Base>::lower_bound(const K& k) const
   }
 
   // lower bound is first element on next node
-  btree_node_ptr np = low.m_node->next_node();
+  btree_node_ptr np = low.m_node->next_leaf();
   return np ? const_iterator(np, np->leaf().begin()) : end();
 }
 
@@ -1827,8 +3327,9 @@ btree_base<Key,Base>::m_special_upper_bound(const K& k) const
   // search branches down the tree until a leaf is reached
   while (np->is_branch())
   {
-    branch_value_type* up
-      = std::upper_bound(np->branch().begin(), np->branch().end(), k, branch_comp());
+    branch_value_type* up = detail::node_upper_bound<compare_type, search_policy>(
+      np->branch().begin(), np->branch().end(), &np->branch().begin()->key, k,
+      branch_comp());
 
     // create the child->parent list
     btree_node_ptr child_np = m_mgr.read(up->node_id);
@@ -1842,8 +3343,9 @@ btree_base<Key,Base>::m_special_upper_bound(const K& k) const
   }
 
   //  search leaf
-  value_type* up
-    = std::upper_bound(np->leaf().begin(), np->leaf().end(), k, value_comp());
+  value_type* up = detail::node_upper_bound<compare_type, search_policy>(
+    np->leaf().begin(), np->leaf().end(), &this->key(*np->leaf().begin()), k,
+    value_comp());
 
   return const_iterator(np, up);
 }
@@ -1863,7 +3365,7 @@ btree_base<Key,Base>::upper_bound(const K& k) const
     return up;
 
   // upper bound is first element on next node
-  btree_node_ptr np = up.m_node->next_node();
+  btree_node_ptr np = up.m_node->next_leaf();
   return np ? const_iterator(np, np->leaf().begin()) : end();
 }
 
@@ -1985,7 +3487,7 @@ btree_base<Key,Base>::iterator_type<T>::increment()
     return;
 
   btree_node_ptr np(m_node);
-  m_node = m_node->next_node();
+  m_node = m_node->next_leaf();
 
   if (m_node)
   {  
@@ -2015,7 +3517,7 @@ btree_base<Key,Base>::iterator_type<T>::decrement()
   else
   {
     btree_node_ptr np(m_node);
-    m_node = m_node->prior_node();
+    m_node = m_node->prior_leaf();
 
     if (m_node)
     {  
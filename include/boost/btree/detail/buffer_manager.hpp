@@ -14,14 +14,17 @@
 
 #include <boost/btree/detail/binary_file.hpp>
 #include <boost/filesystem/operations.hpp>
-#include <boost/intrusive/set.hpp>
 #include <boost/intrusive/list.hpp>
-#include <boost/scoped_array.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/cstdint.hpp>
 #include <boost/assert.hpp>
 #include <iosfwd>
 #include <cstddef>  // for size_t
 #include <cstring>  // for memset
+#include <list>
+#include <map>
+#include <vector>
+#include <utility>  // for pair
 #include <ostream>
 
 //#include <iostream>  // comment me out!
@@ -31,7 +34,7 @@
 #include <boost/config/abi_prefix.hpp>  // must be the last #include
 
 #ifdef BOOST_MSVC
-// for intrusive_list and intrusive_set, disable C4251, ...needs to have
+// for intrusive_list and buffer_table, disable C4251, ...needs to have
 // dll-interface to be used by clients of class ...
 #  pragma warning(push)
 #  pragma warning(disable: 4251) 
@@ -46,9 +49,9 @@
 //  relying on operating system disk caching is not sufficient.                         //
 //                                                                                      //
 //  The associated page buffer objects are owned by buffer_ptr smart pointers.          //
-//  Buffer objects are cached; the buffer_manager keeps all buffers in an intrusive     //
-//  set, buffer_manager::buffers, keyed on buffer_id, so that requests for a page_id    //
-//  are always satisfied with a buffer_ptr to the same buffer if the page is in memory. //
+//  Buffer objects are cached; the buffer_manager keeps all buffers in a hash table,    //
+//  buffer_manager::buffers, keyed on buffer_id, so that requests for a page_id are     //
+//  always satisfied with a buffer_ptr to the same buffer if the page is in memory.     //
 //                                                                                      //
 //  Pages are always kept in memory if their use count is > 0, thus meeting a useage    //
 //  requirement that iterators remain valid as long as they exist.                      //
@@ -57,6 +60,35 @@
 //  An intrusive least-recently-used list of these, buffer_manager::available_buffers,  //
 //  manages the reuse of buffers when a page is finally discarded.                      //
 //                                                                                      //
+//  Plain LRU replacement lets a single sequential scan flush the whole cache, so a     //
+//  replacement policy is chosen at open time. The scan-resistant policies split the    //
+//  pages no longer in use into a hot list (available_buffers) and a cold list          //
+//  (cold_buffers), and remember the ids of recently evicted cold pages so that a page  //
+//  that returns soon after eviction is recognized as part of the working set.          //
+//                                                                                      //
+//  A buffer may be given a priority when it becomes available, as btrees do with the   //
+//  level of branch nodes. Prioritized buffers are evicted only once they exceed a      //
+//  share of the cache, or nothing else is available, lowest priority first, so that    //
+//  the upper levels of a tree stay in memory without pinning an unbounded set.         //
+//                                                                                      //
+//  That number, max_cache_size(), may also be adjusted automatically, growing while    //
+//  too few reads are satisfied from the cache and shrinking when the system runs       //
+//  short of memory.                                                                    //
+//                                                                                      //
+//  Alternatively, several buffer_managers may attach to one buffer_pool, which then    //
+//  replaces each manager's own max_cache_size() and replacement policy with a limit    //
+//  on the memory of the pages no longer in use across all of their files, evicting     //
+//  from a single least-recently-used list. Page frames are owned by the pool, so       //
+//  memory given up by an idle file is reused by a busy one.                            //
+//                                                                                      //
+//  Page memory comes from a per-manager arena of aligned frames, and buffers           //
+//  evicted from the cache are kept on a spare list for reuse, so once the cache has    //
+//  warmed up there is no further heap traffic per page.                                //
+//                                                                                      //
+//  In the optional write-back mode, dirty buffers near the eviction end of the         //
+//  available lists are copied to a staging queue and written by a background           //
+//  thread, so that eviction rarely has to wait for a write.                            //
+//                                                                                      //
 //--------------------------------------------------------------------------------------//
 
 namespace boost
@@ -69,6 +101,27 @@ namespace boost
       typedef boost::uint32_t    use_count_type;
     }
 
+    namespace replacement
+    {
+      enum policy
+      {
+        lru,        // least recently used
+        two_queue,  // 2Q; Johnson and Shasha, VLDB 1994. A page enters a FIFO-like
+                    // probation list and is promoted to the LRU main list when it is
+                    // re-referenced, either while still cached or soon after eviction
+        clock_pro   // CLOCK-Pro; Jiang, Chen, and Zhang, USENIX 2005. Separate hot and
+                    // cold clocks with reference bits, plus an adaptive cold target
+                    // driven by re-references of recently evicted cold pages
+      };
+    }
+
+    BOOST_BTREE_DECL
+    bool memory_status(boost::uint64_t& available, boost::uint64_t& limit);
+    //  Effects: Sets limit to the memory the process may use, the lesser of physical
+    //    memory and any cgroup memory limit, and available to the part of it not in
+    //    use or reclaimable.
+    //  Returns: true if determined; false, with both set to 0, if not supported.
+
     class buffer_manager_error : public std::runtime_error
     {
     public:
@@ -78,6 +131,9 @@ namespace boost
 
     class buffer;
     class buffer_manager;
+    class buffer_pool;
+    namespace detail { class write_back_queue; class frame_keeper; }
+    class io_ring;
 
 //--------------------------------------------------------------------------------------//
 //                                                                                      //
@@ -150,8 +206,7 @@ namespace boost
 //--------------------------------------------------------------------------------------//
 
     class buffer
-      : public boost::intrusive::set_base_hook<>, 
-        public boost::intrusive::list_base_hook<> 
+      : public boost::intrusive::list_base_hook<> 
     {
     public:
       typedef detail::buffer_id_type    buffer_id_type;
@@ -159,12 +214,14 @@ namespace boost
 
       buffer()
         : m_buffer_id(-1), m_use_count(0), m_manager(0),
-          m_data(0), m_needs_write(false), m_never_free(false) {}
+          m_data(0), m_needs_write(false), m_never_free(false), m_cache_state(0),
+          m_priority(0), m_keeper(0) {}
 
       //  construct a dummy buffer w/ id only
       explicit buffer(buffer_id_type id)
         : m_buffer_id(id), m_use_count(0), m_manager(0),
-          m_data(0), m_needs_write(false), m_never_free(false) {}
+          m_data(0), m_needs_write(false), m_never_free(false), m_cache_state(0),
+          m_priority(0), m_keeper(0) {}
 
       //  construct a complete fully-managed buffer
       buffer(buffer_id_type id, buffer_manager& pm);
@@ -192,8 +249,8 @@ namespace boost
       void             needs_write(bool x)     { m_needs_write = x; }
       void             never_free(bool x)      { m_never_free = x; }
 
-      char*            data()                  { return m_data.get(); }
-      const char*      data() const            { return m_data.get(); }
+      char*            data()                  { return m_data; }
+      const char*      data() const            { return m_data; }
 
     protected:
       friend class buffer_manager;
@@ -202,10 +259,380 @@ namespace boost
       use_count_type              m_use_count;
       buffer_manager*             m_manager;       // 0 if orphaned; this happens when
                                                    // manager closed but use_count > 0
-      boost::scoped_array<char>   m_data;          // file buffer
+      char*                       m_data;          // file buffer; a frame owned by
+                                                   // the manager's page_arena or its
+                                                   // pool, or if the manager is
+                                                   // mapped(), a non-owning pointer
+                                                   // into the map
       bool                        m_needs_write;
       bool                        m_never_free;    // if page is ever loaded, always keep
                                                    // in memory 
+      unsigned char               m_cache_state;   // replacement policy state bits
+      unsigned char               m_priority;      // while available; 0 if none
+      detail::frame_keeper*       m_keeper;        // if orphaned, keeps m_data's memory
+
+      enum cache_state_bits
+      {
+        cache_hot = 1,         // 2Q: on main list; CLOCK-Pro: hot page
+        cache_referenced = 2,  // CLOCK-Pro: reference bit
+        cache_test = 4         // CLOCK-Pro: cold page in its test period
+      };
+    };
+
+    namespace detail
+    {
+//--------------------------------------------------------------------------------------//
+//                                                                                      //
+//      page_arena - aligned, fixed-size page frames allocated in large chunks          //
+//                                                                                      //
+//--------------------------------------------------------------------------------------//
+
+      class BOOST_BTREE_DECL page_arena
+      {
+        // page_arena is a non-copyable type
+        page_arena(const page_arena&);
+        page_arena& operator=(const page_arena&);
+
+      public:
+        static const std::size_t page_alignment = 4096;
+
+        page_arena() : m_frame_size(0), m_stride(0), m_next(0), m_last(0),
+          m_chunk_size(0), m_frames_allocated(0), m_huge(false) {}
+        ~page_arena()                     { clear(); }
+
+        void huge_pages(bool x)           { BOOST_ASSERT(!m_frames_allocated);
+                                            m_huge = x; }
+        //  Effects: If x, chunks are multiples of 2 MiB, mapped with MAP_HUGETLB where
+        //  the system has huge pages reserved, otherwise aligned to 2 MiB and advised
+        //  as MADV_HUGEPAGE for transparent huge pages, otherwise allocated as usual.
+        //  Reduces TLB misses when many frames are in use.
+
+        bool         huge_pages() const   { return m_huge; }
+        std::size_t  huge_page_bytes() const;
+        //  Returns: Bytes of chunks mapped with MAP_HUGETLB or advised as MADV_HUGEPAGE
+
+        void frame_size(std::size_t sz);
+        //  Requires: sz > 0, no frames allocated
+        //  Effects: Frames will be sz bytes, aligned to page_alignment, or for
+        //  small sz, to the smallest power of two not less than sz
+
+        std::size_t  frame_size() const   { return m_frame_size; }
+        std::size_t  stride() const       { return m_stride; }
+        std::size_t  frames_allocated() const  { return m_frames_allocated; }
+
+        char* allocate();
+        //  Requires: frame_size() > 0
+        //  Returns: Pointer to an uninitialized frame
+        //  Throws: std::bad_alloc if memory is exhausted
+
+        void clear();
+        //  Effects: Frees all chunks, invalidating all frames; frame_size() is retained
+
+        void transfer_chunks(page_arena& to);
+        //  Effects: Moves all chunks to to, which then frees them; frames remain valid
+        //  while to exists. This arena is left as if clear() had been called.
+
+        std::size_t  chunk_count() const  { return m_chunks.size(); }
+        io_segment   chunk(std::size_t i) const
+        //  Returns: The memory of the i-th chunk; every frame lies within one chunk
+        {
+          io_segment seg = { m_chunks[i].address, m_chunks[i].size };
+          return seg;
+        }
+
+        enum chunk_kind { heap_chunk, hugetlb_chunk, advised_chunk };
+
+      private:
+        std::size_t          m_frame_size;
+        std::size_t          m_stride;        // distance between frames
+        char*                m_next;          // next frame in the current chunk
+        char*                m_last;          // end of the current chunk
+        std::size_t          m_chunk_size;    // bytes in the next chunk to be allocated
+        std::size_t          m_frames_allocated;
+        bool                 m_huge;
+
+        struct chunk_info
+        {
+          char*        address;
+          std::size_t  size;
+          chunk_kind   kind;
+        };
+        std::vector<chunk_info>  m_chunks;
+      };
+
+//--------------------------------------------------------------------------------------//
+//                                                                                      //
+//      frame_keeper - page memory kept alive for buffers orphaned by close()           //
+//                                                                                      //
+//--------------------------------------------------------------------------------------//
+
+      class BOOST_BTREE_DECL frame_keeper
+      {
+        // frame_keeper is a non-copyable type
+        frame_keeper(const frame_keeper&);
+        frame_keeper& operator=(const frame_keeper&);
+
+      public:
+        frame_keeper() : m_map(0), m_map_size(0), m_orphans(0), m_abandoned(false) {}
+        ~frame_keeper();  // frees the adopted arenas and unmaps the adopted view
+
+        void adopt(page_arena* arena)     { m_arenas.push_back(arena); }
+        void adopt_map(char* p, std::size_t sz)  { BOOST_ASSERT(!m_map);
+                                            m_map = p; m_map_size = sz; }
+
+        void hold()                       { ++m_orphans; }
+        void release()
+        //  Effects: Deletes this if abandoned and no orphans remain
+        {
+          BOOST_ASSERT(m_orphans);
+          if (--m_orphans == 0 && m_abandoned)
+            delete this;
+        }
+        void abandon()
+        //  Effects: Called by the owner instead of deleting this; deletes this once
+        //  no orphans remain
+        {
+          if (m_orphans == 0)
+            delete this;
+          else
+            m_abandoned = true;
+        }
+
+        std::size_t  orphans() const      { return m_orphans; }
+
+      private:
+        std::vector<page_arena*>  m_arenas;
+        char*                     m_map;          // read-only view of a file, or 0
+        std::size_t               m_map_size;
+        std::size_t               m_orphans;
+        bool                      m_abandoned;
+      };
+
+//--------------------------------------------------------------------------------------//
+//                                                                                      //
+//      ghost_list - FIFO of ids of recently evicted buffers that are not in memory     //
+//                                                                                      //
+//--------------------------------------------------------------------------------------//
+
+      class ghost_list
+      {
+      public:
+        std::size_t  size() const   { return m_map.size(); }
+
+        bool push_back(buffer_id_type id, std::size_t max_sz)
+        //  Effects: Appends id, then removes the oldest ids until size() <= max_sz
+        //  Returns: true if any id other than id itself was removed
+        {
+          bool expired = false;
+          erase(id);
+          m_map[id] = m_fifo.insert(m_fifo.end(), id);
+          while (m_map.size() > max_sz)
+          {
+            expired = expired || m_fifo.front() != id;
+            m_map.erase(m_fifo.front());
+            m_fifo.pop_front();
+          }
+          return expired;
+        }
+
+        bool erase(buffer_id_type id)
+        //  Returns: true if id was present
+        {
+          map_type::iterator it = m_map.find(id);
+          if (it == m_map.end())
+            return false;
+          m_fifo.erase(it->second);
+          m_map.erase(it);
+          return true;
+        }
+
+        void clear()                { m_fifo.clear(); m_map.clear(); }
+
+      private:
+        typedef std::list<buffer_id_type>  fifo_type;
+        typedef boost::unordered_map<buffer_id_type, fifo_type::iterator>  map_type;
+
+        fifo_type  m_fifo;  // oldest first
+        map_type   m_map;
+      };
+    }
+
+//--------------------------------------------------------------------------------------//
+//                                                                                      //
+//           buffer_table - hash table of the buffers in memory, keyed on id            //
+//                                                                                      //
+//  Every node visit looks up a page id, so lookup must be cheap even when the cache    //
+//  holds hundreds of thousands of buffers. buffer_table is an open-addressed hash      //
+//  table with linear probing, holding pointers to (not copies of) buffers. Lookup,     //
+//  insert, and erase are O(1) on average, and lookup needs only the id, so no dummy    //
+//  key buffer is constructed.                                                          //
+//                                                                                      //
+//  Ids are hashed by Fibonacci (multiplicative) hashing, which spreads the dense,      //
+//  often sequential, page ids of a file evenly across the table. The table doubles     //
+//  when more than half full, keeping probe sequences short. Erase uses backward-shift  //
+//  deletion, so no tombstones accumulate.                                              //
+//                                                                                      //
+//  Iteration order is unspecified. The table must not be modified while iterating.    //
+//                                                                                      //
+//--------------------------------------------------------------------------------------//
+
+    class BOOST_BTREE_DECL buffer_table
+    {
+      // buffer_table is a non-copyable type
+      buffer_table(const buffer_table&);
+      buffer_table& operator=(const buffer_table&);
+
+    public:
+      typedef buffer::buffer_id_type  buffer_id_type;
+
+      class const_iterator
+      {
+      public:
+        const_iterator() : m_slot(0), m_end(0) {}
+        const_iterator(buffer** slot, buffer** end) : m_slot(slot), m_end(end)
+          { m_skip_empty(); }
+
+        buffer&  operator*() const              { BOOST_ASSERT(m_slot != m_end);
+                                                  return **m_slot; }
+        buffer*  operator->() const             { BOOST_ASSERT(m_slot != m_end);
+                                                  return *m_slot; }
+        const_iterator& operator++()            { ++m_slot; m_skip_empty();
+                                                  return *this; }
+        bool operator==(const const_iterator& r) const  { return m_slot == r.m_slot; }
+        bool operator!=(const const_iterator& r) const  { return m_slot != r.m_slot; }
+
+      private:
+        buffer**  m_slot;
+        buffer**  m_end;
+
+        void m_skip_empty()  { while (m_slot != m_end && !*m_slot) ++m_slot; }
+      };
+      typedef const_iterator  iterator;  // elements are pointers; iterators never modify
+                                         // the table
+
+      buffer_table() : m_slots(0), m_mask(0), m_shift(0), m_size(0) {}
+      ~buffer_table()                 { delete [] m_slots; }
+
+      std::size_t  size() const       { return m_size; }
+      bool         empty() const      { return m_size == 0; }
+      std::size_t  capacity() const   { return m_slots ? m_mask + 1 : 0; }
+
+      const_iterator begin() const    { return const_iterator(m_slots,
+                                          m_slots + capacity()); }
+      const_iterator end() const      { return const_iterator(m_slots + capacity(),
+                                          m_slots + capacity()); }
+
+      buffer* find(buffer_id_type id) const
+      //  Returns: Pointer to the buffer with buffer_id() == id, or 0 if not present
+      {
+        if (!m_slots)
+          return 0;
+        for (std::size_t i = m_home(id);; i = (i + 1) & m_mask)
+        {
+          buffer* p = m_slots[i];
+          if (!p || p->buffer_id() == id)
+            return p;
+        }
+      }
+
+      void insert(buffer& b);
+      //  Requires: No buffer with the same buffer_id() is present
+
+      void erase(buffer& b);
+      //  Requires: b is present
+
+      void clear();
+      //  Effects: Removes all buffer pointers. The buffers themselves are not affected.
+
+    private:
+      buffer**      m_slots;    // 0 if empty slot; capacity is always a power of 2
+      std::size_t   m_mask;     // capacity - 1
+      unsigned      m_shift;    // 32 - lg(capacity)
+      std::size_t   m_size;
+
+      std::size_t m_home(buffer_id_type id) const
+      {
+        return static_cast<std::size_t>(
+          static_cast<boost::uint32_t>(id * 2654435769U) >> m_shift) & m_mask;
+      }
+
+      void m_rehash(std::size_t new_capacity);
+    };
+
+//--------------------------------------------------------------------------------------//
+//                                                                                      //
+//        buffer_pool - a cache memory budget shared by several buffer_managers         //
+//                                                                                      //
+//  A buffer_manager attached to a buffer_pool does not apply its own max_cache_size()  //
+//  or replacement policy. Instead, its buffers no longer in use join the pool's single //
+//  LRU list, and when the total data size of the buffers on that list would exceed     //
+//  max_bytes(), the least recently used buffer of any attached manager is evicted,     //
+//  after being written if need be. The frame of an evicted buffer returns to the pool  //
+//  for reuse by whichever manager next needs one of the same size. Statistics other    //
+//  than those below remain per buffer_manager, and so per file.                        //
+//                                                                                      //
+//  A buffer_pool is not thread-safe; all attached managers must be used by one thread  //
+//  at a time.                                                                          //
+//                                                                                      //
+//--------------------------------------------------------------------------------------//
+
+    class BOOST_BTREE_DECL buffer_pool
+    {
+      // buffer_pool is a non-copyable type
+      buffer_pool(const buffer_pool&);
+      buffer_pool& operator=(const buffer_pool&);
+
+    public:
+      static const std::size_t default_max_bytes = 64 * 1048576;
+
+      explicit buffer_pool(std::size_t max_bytes = default_max_bytes)
+        : m_max_bytes(max_bytes), m_available_bytes(0), m_managers(0), m_evictions(0),
+          m_keeper(0) {}
+
+      ~buffer_pool();
+      //  Requires: managers() == 0
+
+      static buffer_pool& global();
+      //  Returns: The process-wide pool used by btrees opened with flags::shared_cache.
+      //    Its initial max_bytes() is default_max_bytes.
+
+      // modifiers
+      void             max_bytes(std::size_t n)        {m_max_bytes = n;}
+      //  Remarks: Takes effect as buffers are next released or loaded
+
+      // observers
+      std::size_t      max_bytes() const               {return m_max_bytes;}
+      std::size_t      managers() const                {return m_managers;}
+      std::size_t      buffers_available() const       {return m_available.size();}
+      std::size_t      available_bytes() const         {return m_available_bytes;}
+      //  Returns: Total data size of the buffers on the pool's LRU list
+      std::size_t      frames_allocated() const;
+      std::size_t      frames_free() const;
+      boost::uint64_t  evictions() const               {return m_evictions;}
+      //  Returns: Number of buffers evicted to keep within max_bytes()
+      void             clear_statistics()              {m_evictions = 0;}
+
+    private:
+      friend class buffer_manager;
+
+      typedef boost::intrusive::list<buffer>        avail_buffers_type;
+      typedef std::map<std::size_t, detail::page_arena*>      arena_map;
+      typedef std::map<std::size_t, std::vector<char*> >      free_frame_map;
+
+      avail_buffers_type  m_available;        // buffers of all attached managers with
+                                              // use_count() == 0, least recently used first
+      std::size_t         m_max_bytes;
+      std::size_t         m_available_bytes;  // total data_size() of m_available
+      std::size_t         m_managers;         // number attached
+      boost::uint64_t     m_evictions;
+      arena_map           m_arenas;           // keyed on data size
+      free_frame_map      m_free_frames;      // keyed on data size
+      detail::frame_keeper*  m_keeper;        // 0 until a manager is closed while
+                                              // some of its buffers are still in use;
+                                              // their frames are not reused
+
+      char* m_allocate_frame(std::size_t sz);
+      void  m_free_frame(std::size_t sz, char* frame)  {m_free_frames[sz].push_back(frame);}
     };
 
 //--------------------------------------------------------------------------------------//
@@ -214,6 +641,10 @@ namespace boost
 //                                                                                      //
 //--------------------------------------------------------------------------------------//
 
+    //  buffer_priority - returns the priority of a buffer that has become available;
+    //  0 for none, otherwise higher values are evicted later
+    typedef unsigned (*buffer_priority)(const buffer&);
+
     inline buffer* default_buffer_alloc(buffer::buffer_id_type pg_id, buffer_manager& mgr)
       { return new buffer(pg_id, mgr); }
 
@@ -229,10 +660,30 @@ namespace boost
       typedef std::size_t             data_size_type;
       typedef buffer* (*buffer_alloc)(buffer_id_type, buffer_manager&);
 
+      static const std::size_t default_max_write_batch = 64;
+      static const std::size_t default_max_pending_writes = 256;
+      static const unsigned    default_async_queue_depth = 64;
+      static const unsigned    default_max_priority_percent = 50;
+      static const unsigned    priority_levels = 8;  // priorities above are treated as 8
+      static const std::size_t auto_size_interval = 1024;  // reads between adjustments
+      static const std::size_t default_auto_size_min = 16;
+      static const unsigned    default_target_hit_percent = 90;
+      static const unsigned    low_memory_percent = 10;
+
       explicit buffer_manager(buffer_alloc alloc = default_buffer_alloc)
         //  alloc function pointer allows management of classes derived from buffer
         //  yet still permits separate compilation
-        : m_buffer_count(0), m_data_size(0), m_max_cache_size(0), m_owner(0), m_alloc(alloc)
+        : m_buffer_count(0), m_data_size(0), m_max_cache_size(0),
+          m_max_write_batch(default_max_write_batch), m_owner(0),
+          m_alloc(alloc), m_policy(replacement::lru), m_cold_target(1),
+          m_write_back(0), m_ring(0), m_registered_chunks(0), m_map(0), m_map_size(0),
+          m_pool(0), m_pool_available(0), m_priority_fn(0),
+          m_max_priority_percent(default_max_priority_percent), m_priority_available(0),
+          m_auto_size(false), m_auto_min(0), m_auto_max(0), m_auto_target(0),
+          m_auto_reads(0), m_auto_hits(0), m_auto_misses(0)
+#         ifdef BOOST_WINDOWS_API
+          , m_map_handle(0)
+#         endif
       {
         clear_statistics(); 
       }
@@ -242,7 +693,8 @@ namespace boost
       bool open(const boost::filesystem::path& p,
         oflag::bitmask flags,
         std::size_t max_cache_pgs=16,
-        data_size_type data_sz=4096);  // data size for new or truncated files
+        data_size_type data_sz=4096,   // data size for new or truncated files
+        replacement::policy rp=replacement::lru);
       //  Note: 4096 is choosen as the default data (I.E. disk page) size based on
       //  2010 timing tests on a current 3.5" 1.0 TB hard drive in a fairly powerful
       //  Windows 7 desktop machine, and a current 2.5" 80 GB hard drive in an
@@ -253,6 +705,15 @@ namespace boost
       //  PERFORMED.
 
       void data_size(data_size_type sz);
+      //  Throws: If direct() and sz is not a multiple of direct_alignment. open()
+      //    throws likewise for data_sz when creating a file.
+
+      bool read_header(void* target, std::size_t sz);
+      void write_header(const void* source, std::size_t sz);
+      //  Effects: As binary_file::read_at(0, target, sz) and write_at(0, source, sz),
+      //    except that if direct(), the transfer is of whole direct_alignment blocks
+      //    through an aligned staging area; write_header() then zero fills the
+      //    remainder of the last block.
 
       buffer_ptr new_buffer();
       //  Returns: Pointer to a new buffer, ready for use
@@ -262,6 +723,45 @@ namespace boost
       buffer_ptr read(buffer_id_type buffer_id);
       //  Throws: if buffer_id is not a valid (i.e. existing) buffer number
 
+      buffer_ptr overwrite(buffer_id_type buffer_id);
+      //  Requires: buffer_id < buffer_count()
+      //  Returns: As read(buffer_id), except that a buffer not in memory is zero filled
+      //    rather than read, for callers that replace its entire contents.
+      //  Postconditions: needs_write() is true
+
+      void truncate(buffer_count_type n);
+      //  Requires: n <= buffer_count(), !mapped(), and no buffer with buffer_id() >= n
+      //    is in use
+      //  Effects: Discards, without writing them, the buffers in memory with
+      //    buffer_id() >= n, then cuts the file back to n buffers.
+      //  Postconditions: buffer_count() == n
+
+      std::size_t preload(const buffer_id_type* ids, std::size_t n);
+      //  Requires: The ids are distinct
+      //  Effects: Reads into the cache, as available buffers, those of ids[0] through
+      //    ids[n-1] not already in memory, in that order of priority, until
+      //    buffers_available() reaches max_cache_size(). The chosen buffers are read
+      //    in buffer_id order, and buffers close together are read with one large
+      //    read, at the cost of reading small unwanted gaps between them.
+      //  Returns: The number of buffers read.
+
+      void save_cache_state(const boost::filesystem::path& p,
+        system::error_code& ec) const;
+      //  Effects: Writes to file p the ids of the buffers in memory, in replacement
+      //    order from the next eviction candidate to the most recently used, noting
+      //    which are on the cold list. Sets ec to the error, if any, writing p.
+
+      std::size_t restore_cache_state(const boost::filesystem::path& p,
+        system::error_code& ec);
+      //  Requires: data_size()
+      //  Effects: If p was written by save_cache_state() for a file with the same
+      //    data_size(), as if preload() is called for the ids it lists, most recently
+      //    used first, then the buffers read are put back in their saved replacement
+      //    order. Sets ec to the error, if any, reading p; a p that is not valid is
+      //    ignored, with ec set to errc::invalid_argument.
+      //  Returns: The number of buffers read.
+      //  Throws: On error reading this file.
+
       void write(buffer& pg);
 
       void clear_write_needed();
@@ -269,19 +769,107 @@ namespace boost
       bool flush();
       //  Returns: true iff any buffers written to disk
 
+      void start_write_back(std::size_t max_pending=default_max_pending_writes);
+      //  Requires: is_open() && data_size() && !write_back()
+      //  Effects: Starts a background thread that writes dirty buffers near the
+      //    eviction end of the available lists. At most max_pending buffer copies
+      //    are queued; beyond that, the foreground waits for the writer.
+      //  Remarks: Errors from background writes are reported by the next flush(),
+      //    close(), or write-back operation.
+
+      void stop_write_back();
+      //  Effects: If write_back(), waits for all queued writes, then stops the thread
+
+      bool write_back() const                          {return m_write_back != 0;}
+
+      void start_async_io(unsigned queue_depth=default_async_queue_depth);
+      //  Requires: is_open() && !async_io()
+      //  Effects: flush() queues all of its writes on an io_ring of the given depth,
+      //    so that the device sees many requests at once, then waits for them all.
+      //    Buffer frames are registered with the ring where the kernel permits.
+      //  Remarks: Where io_uring is unavailable, the ring performs each write as it
+      //    is queued, so behavior is as if async_io() were false.
+
+      void stop_async_io();
+      //  Effects: If async_io(), releases the ring
+
+      bool async_io() const                            {return m_ring != 0;}
+
+      bool map_file();
+      //  Requires: is_open() && data_size() && the file was not opened for output &&
+      //    buffers_in_memory() == 0 && buffers_spare() == 0
+      //  Effects: Maps the file into memory read-only. read() then returns buffers
+      //    whose data() points into the mapping rather than into a private frame, so
+      //    no copy is made and the operating system's page cache is the only data
+      //    cache; max_cache_size() limits only the buffer descriptors kept.
+      //  Returns: mapped(). false if the file is empty or mapping failed, in which
+      //    case buffers are read in the usual way.
+      //  Remarks: data() of a mapped buffer must not be written to.
+
+      bool mapped() const                              {return m_map != 0;}
+
+      void huge_pages(bool x)                          {m_frames.huge_pages(x);}
+      //  Requires: frames_allocated() == 0
+      //  Effects: If x, buffer frames come from huge pages where the operating
+      //    system provides them; see detail::page_arena::huge_pages().
+      bool huge_pages() const                          {return m_frames.huge_pages();}
+
+      void pool(buffer_pool* p);
+      //  Requires: !is_open()
+      //  Effects: Attaches to pool p, or if p is 0, detaches from the current pool.
+      //    While attached, max_cache_size() and replacement_policy() are not used;
+      //    the pool's budget and LRU list govern which buffers stay in memory.
+      //  Remarks: close() detaches.
+
+      buffer_pool* pool() const                        {return m_pool;}
+
+      void auto_size(std::size_t min_sz, std::size_t max_sz,
+        unsigned target_hit_percent=default_target_hit_percent);
+      //  Requires: min_sz <= max_sz
+      //  Effects: Every auto_size_interval calls to read(), adjusts max_cache_size()
+      //    within min_sz and max_sz from the percentage of those reads satisfied from
+      //    the cache. Below target_hit_percent, the cache grows by a quarter, but not
+      //    beyond buffer_count(); with under half the misses target_hit_percent
+      //    allows, it shrinks by a sixteenth. But whenever memory_status() reports
+      //    less than low_memory_percent of the limit available, it shrinks by a
+      //    quarter. On shrinking, excess available buffers are evicted and their
+      //    memory returned to the operating system where possible.
+      //  Remarks: Ignored while attached to a pool.
+
+      void stop_auto_size()                            {m_auto_size = false;}
+      bool auto_size() const                           {return m_auto_size;}
+
       // modifiers
       void             max_cache_size(std::size_t m)   {m_max_cache_size = m;}
+      void             max_write_batch(std::size_t n)  {m_max_write_batch = n;}
+      //  flush() writes runs of consecutive dirty buffers with a single call, up to n
+      //  buffers per call; n of 0 or 1 disables coalescing
+      void             priority_function(buffer_priority f)  {m_priority_fn = f;}
+      //  f, if not 0, is called for each buffer as it becomes available. Buffers given
+      //  a priority are kept in preference to others, and lower priorities are evicted
+      //  before higher ones, until they exceed max_priority_percent() of
+      //  max_cache_size(). Ignored while attached to a pool.
+      void             max_priority_percent(unsigned p)  {m_max_priority_percent = p;}
       void             clear_statistics() const
       {
+        m_clear_written_behind();
         m_active_buffers_read = m_available_buffers_read = m_never_free_buffers_read
           = m_file_buffers_read = m_file_buffers_written = m_new_buffer_requests
-          = m_buffer_allocs = m_never_free_honored = 0;
+          = m_buffer_allocs = m_never_free_honored = m_coalesced_writes
+          = m_cache_grows = m_cache_shrinks = 0;
       }
       void             clear_cache()   // use with extreme caution!
-        {buffers.clear(); available_buffers.clear();}
+        {if (m_pool) m_pool_unlink_all();
+         buffers.clear(); available_buffers.clear(); cold_buffers.clear();
+         ghost_buffers.clear(); m_clear_priority_buffers();}
 
       // observers
       std::size_t      max_cache_size() const          {return m_max_cache_size;}
+      std::size_t      max_write_batch() const         {return m_max_write_batch;}
+      buffer_priority  priority_function() const       {return m_priority_fn;}
+      unsigned         max_priority_percent() const    {return m_max_priority_percent;}
+      replacement::policy
+                       replacement_policy() const      {return m_policy;}
       buffer_count_type  buffer_count() const          {return m_buffer_count;}
       data_size_type   data_size() const               {return m_data_size;}  // on disk
                                                        
@@ -295,15 +883,32 @@ namespace boost
                                                           + m_available_buffers_read
                                                           + m_never_free_buffers_read;}
       boost::uint64_t  file_buffers_read() const       {return m_file_buffers_read;}
-      boost::uint64_t  file_buffers_written() const    {return m_file_buffers_written;}
+      boost::uint64_t  file_buffers_written() const    {return m_file_buffers_written
+                                                          + m_written_behind();}
       boost::uint64_t  new_buffer_requests() const     {return m_new_buffer_requests;}
       boost::uint64_t  buffer_allocs() const           {return m_buffer_allocs;}
       boost::uint64_t  never_free_honored() const      {return m_never_free_honored;}
+      boost::uint64_t  coalesced_writes() const        {return m_coalesced_writes;}
+                                                       // writes of more than one buffer
+      boost::uint64_t  cache_grows() const             {return m_cache_grows;}
+      boost::uint64_t  cache_shrinks() const           {return m_cache_shrinks;}
+                                                       // adjustments by auto_size()
 
       std::size_t      buffers_in_memory() const       {return buffers.size();}
-      std::size_t      buffers_available() const       {return available_buffers.size();}
+      bool             in_memory(buffer_id_type id) const  {return buffers.find(id) != 0;}
+      bool             in_use(buffer_id_type id) const
+                                                       {buffer* b = buffers.find(id);
+                                                        return b && b->use_count();}
+      std::size_t      buffers_available() const       {return available_buffers.size()
+                                                          + cold_buffers.size()
+                                                          + m_priority_available
+                                                          + m_pool_available;}
+      std::size_t      priority_buffers_available() const  {return m_priority_available;}
       std::size_t      buffers_in_use() const          {return buffers_in_memory()
                                                           - buffers_available();}
+      std::size_t      buffers_spare() const           {return spare_buffers.size();}
+      std::size_t      frames_allocated() const        {return m_frames.frames_allocated();}
+      std::size_t      huge_page_bytes() const         {return m_frames.huge_page_bytes();}
 
       void dump_buffers(std::ostream& os) const
       {
@@ -318,6 +923,20 @@ namespace boost
         for (avail_buffers_type::const_iterator it = available_buffers.begin();
              it != available_buffers.end(); ++it)
           os << " id=" << it->buffer_id() << " use-count=" << it->use_count() << std::endl;
+        if (!cold_buffers.empty())
+          os << "cold available buffers\n";
+        for (avail_buffers_type::const_iterator it = cold_buffers.begin();
+             it != cold_buffers.end(); ++it)
+          os << " id=" << it->buffer_id() << " use-count=" << it->use_count() << std::endl;
+        for (unsigned p = 0; p != priority_levels; ++p)
+        {
+          if (!priority_buffers[p].empty())
+            os << "priority " << p + 1 << " available buffers\n";
+          for (avail_buffers_type::const_iterator it = priority_buffers[p].begin();
+               it != priority_buffers[p].end(); ++it)
+            os << " id=" << it->buffer_id() << " use-count=" << it->use_count()
+               << std::endl;
+        }
       }
 
 #ifndef BOOST_BUFFER_MANAGER_TEST
@@ -326,7 +945,7 @@ namespace boost
 
       friend class buffer;
 
-      typedef boost::intrusive::set<buffer>   buffers_type;
+      typedef buffer_table                    buffers_type;
       typedef boost::intrusive::list<buffer>  avail_buffers_type;
 
       buffers_type   buffers;             // all page buffers in memory that are being
@@ -337,15 +956,57 @@ namespace boost
       avail_buffers_type  available_buffers;
                                           // page buffers in memory with use_count() == 0;
                                           // least recently used (LRU) order, begin()
-                                          // being the least recently used buffer
+                                          // being the least recently used buffer. For
+                                          // 2Q and CLOCK-Pro, the hot buffers only
+
+      avail_buffers_type  cold_buffers;   // 2Q and CLOCK-Pro only: cold buffers with
+                                          // use_count() == 0, begin() being the next
+                                          // eviction candidate
+
+      detail::ghost_list  ghost_buffers;  // 2Q and CLOCK-Pro only: ids of recently
+                                          // evicted cold buffers
+
+      avail_buffers_type  priority_buffers[priority_levels];
+                                          // buffers with use_count() == 0 given priority
+                                          // p by m_priority_fn are on priority_buffers[p-1]
+                                          // rather than the lists above; LRU order
+
+      avail_buffers_type  spare_buffers;  // buffers evicted from the cache, each still
+                                          // owning its frame unless pool(); reused before
+                                          // calling m_alloc
 
     private:
 
       buffer_count_type   m_buffer_count;     // number of buffers in the file
       data_size_type      m_data_size;        // number of bytes per disk buffer
       std::size_t         m_max_cache_size;   // maximum # buffers to cache; may be 0
+      std::size_t         m_max_write_batch;  // maximum # buffers per flush() write
       void*               m_owner;            // not used by buffer_manager itself
       buffer_alloc        m_alloc;            // memory allocation function pointer
+      detail::page_arena  m_frames;           // memory for buffer data
+      replacement::policy m_policy;
+      std::size_t         m_cold_target;      // CLOCK-Pro only: adaptive target number
+                                              // of cold buffers
+      detail::write_back_queue*  m_write_back;  // 0 unless write-back mode
+      io_ring*            m_ring;             // 0 unless async I/O mode
+      std::size_t         m_registered_chunks;  // m_frames chunks registered with m_ring
+      char*               m_map;              // 0 unless mapped()
+      std::size_t         m_map_size;
+#   ifdef BOOST_WINDOWS_API
+      void*               m_map_handle;       // file mapping object
+#   endif
+      buffer_pool*        m_pool;             // 0 unless attached to a pool
+      std::size_t         m_pool_available;   // this manager's buffers on the pool's list
+      buffer_priority     m_priority_fn;      // 0 unless buffers are prioritized
+      unsigned            m_max_priority_percent;
+      std::size_t         m_priority_available;  // buffers on priority_buffers lists
+      bool                m_auto_size;
+      std::size_t         m_auto_min;
+      std::size_t         m_auto_max;
+      unsigned            m_auto_target;      // hit percentage
+      std::size_t         m_auto_reads;       // since the last adjustment
+      boost::uint64_t     m_auto_hits;        // cached_buffers_read() at the last one
+      boost::uint64_t     m_auto_misses;      // file_buffers_read() at the last one
 
       //  activity counts
      mutable boost::uint64_t   m_active_buffers_read;
@@ -356,8 +1017,46 @@ namespace boost
      mutable boost::uint64_t   m_new_buffer_requests;
      mutable boost::uint64_t   m_buffer_allocs;
      mutable boost::uint64_t   m_never_free_honored;
+     mutable boost::uint64_t   m_coalesced_writes;
+     mutable boost::uint64_t   m_cache_grows;
+     mutable boost::uint64_t   m_cache_shrinks;
 
       buffer* m_prepare_buffer(buffer_id_type pg_id);
+      char*   m_new_frame();            // 0 if mapped()
+      std::size_t  m_cache_room() const;  // buffers that may become available without
+                                          // an eviction
+      void    m_unmap_file();
+      void    m_flush_async(const std::vector<buffer*>& dirty);
+      void    m_auto_adjust();          // auto_size() sampling point
+      void    m_trim();                 // evict until within max_cache_size()
+
+      //  replacement policy operations on buffers with use_count() == 0
+      void    m_release(buffer& buf);   // use_count() has become 0
+      void    m_link(buffer& buf);      // add to the appropriate available list
+      void    m_unlink(buffer& buf);    // remove from its available list
+      buffer* m_victim();               // choose, unlink, and return a buffer to evict
+      void    m_loaded(buffer& buf);    // buf now holds a page not previously cached
+      void    m_referenced(buffer& buf);// buf was found in memory
+      void    m_demote_hot();           // CLOCK-Pro hot hand
+      buffer* m_priority_victim();      // lowest priority, least recently used
+      void    m_clear_priority_buffers();
+      std::size_t  m_priority_max() const  // prioritized buffers kept in preference
+        {return m_max_cache_size / 100 * m_max_priority_percent
+           + m_max_cache_size % 100 * m_max_priority_percent / 100;}
+
+      //  pool mode
+      void    m_pool_make_room(std::size_t sz);  // evict until sz more bytes fit
+      void    m_pool_evict(buffer& buf);  // buf, unlinked, leaves the cache; its frame
+                                          // returns to the pool
+      void    m_pool_unlink_all();
+      std::size_t  m_available_max() const
+        {return m_max_cache_size ? m_max_cache_size : 1;}
+
+      //  write-back mode
+      void    m_write_behind();         // stage dirty buffers near the eviction end
+      void    m_write_behind(avail_buffers_type& list, std::size_t n);
+      boost::uint64_t  m_written_behind() const;
+      void    m_clear_written_behind() const;
     };
 
     BOOST_BTREE_DECL
@@ -398,7 +1097,9 @@ namespace boost
 
     inline buffer::buffer(buffer_id_type id, boost::btree::buffer_manager& pm)
       : m_buffer_id(id), m_use_count(0), m_manager(&pm),
-        m_data(new char[pm.data_size()]), m_needs_write(false), m_never_free(false) {}
+        m_data(pm.m_new_frame()), m_needs_write(false),
+        m_never_free(false),
+        m_cache_state(0), m_priority(0), m_keeper(0) {}
 
     inline void buffer::dec_use_count()
     {
@@ -410,6 +1111,8 @@ namespace boost
         if (!manager())  // buffer is orphaned; it has outlived its manager
         {
           BOOST_ASSERT(!needs_write());
+          if (m_keeper)
+            m_keeper->release();
           delete this;
         }
         else if (never_free())
@@ -418,20 +1121,7 @@ namespace boost
         }
         else
         {
-          if (manager()->available_buffers.size()
-            && manager()->available_buffers.size() >= manager()->max_cache_size())
-          {
-            // release a buffer
-            buffer* lru = &*manager()->available_buffers.begin();
-            manager()->available_buffers.pop_front();
-            manager()->buffers.erase(manager()->buffers.iterator_to(*lru));
-            if (lru->needs_write())
-            {
-              manager()->write(*lru);
-            }
-            delete lru;
-          }
-          manager()->available_buffers.push_back(*this);
+          manager()->m_release(*this);
         }
       }
     }
@@ -0,0 +1,169 @@
+//  boost/btree/detail/free_map.hpp  ---------------------------------------------------//
+
+//  Copyright agent 2026
+
+//  Distributed under the Boost Software License, Version 1.0.
+//  See http://www.boost.org/LICENSE_1_0.txt
+
+//  See http://www.boost.org/libs/btree for documentation.
+
+//--------------------------------------------------------------------------------------//
+
+//  A bitmap of free node ids, with a count of the free ids in each region of
+//  region_ids consecutive ids. Searches skip regions with no free ids, so finding the
+//  free id nearest a given id costs little more than a scan of the region counts,
+//  however large the file.
+
+//--------------------------------------------------------------------------------------//
+
+#ifndef BOOST_BTREE_FREE_MAP_HPP
+#define BOOST_BTREE_FREE_MAP_HPP
+
+#include <boost/cstdint.hpp>
+#include <boost/assert.hpp>
+#include <vector>
+#include <cstddef>
+
+namespace boost
+{
+namespace btree
+{
+namespace detail
+{
+
+class free_map
+{
+public:
+  static const std::size_t region_ids = 4096;  // ids per region
+
+  free_map() : m_size(0), m_count(0) {}
+
+  std::size_t  size() const   { return m_size; }   // ids [0, size()) are mapped
+  std::size_t  count() const  { return m_count; }  // free ids
+
+  void         clear()        { m_size = m_count = 0; m_word.clear(); m_region.clear(); }
+  void         resize(std::size_t n)
+  //  Ids added are not free; ids removed must not be free.
+  {
+    BOOST_ASSERT(n >= m_size || !n || !next(n - 1));
+    m_size = n;
+    m_word.resize((n + 63) / 64, 0);
+    m_region.resize((n + region_ids - 1) / region_ids, 0);
+  }
+
+  bool         test(std::size_t id) const
+  {
+    BOOST_ASSERT(id < m_size);
+    return (m_word[id / 64] & bit(id)) != 0;
+  }
+  void         set(std::size_t id)    // mark free
+  {
+    BOOST_ASSERT(id < m_size);
+    if (test(id))
+      return;
+    m_word[id / 64] |= bit(id);
+    ++m_region[id / region_ids];
+    ++m_count;
+  }
+  void         reset(std::size_t id)  // mark in use
+  {
+    BOOST_ASSERT(id < m_size);
+    if (!test(id))
+      return;
+    m_word[id / 64] &= ~bit(id);
+    --m_region[id / region_ids];
+    --m_count;
+  }
+
+  //  Id 0 is the header, and never free, so 0 indicates none found
+
+  std::size_t  next(std::size_t id) const   // lowest free id > id
+  {
+    for (std::size_t i = id + 1; i < m_size;)
+    {
+      if (!m_region[i / region_ids])
+      {
+        i = (i / region_ids + 1) * region_ids;
+        continue;
+      }
+      uint64_t bits = m_word[i / 64] & (~uint64_t(0) << (i % 64));
+      if (bits)
+        return (i / 64) * 64 + low_bit(bits);
+      i = (i / 64 + 1) * 64;
+    }
+    return 0;
+  }
+
+  std::size_t  prior(std::size_t id) const  // highest free id < id
+  {
+    if (!id || !m_size)
+      return 0;
+    for (std::size_t i = (id <= m_size ? id : m_size) - 1;;)
+    {
+      if (!m_region[i / region_ids])
+      {
+        if (i < region_ids)
+          return 0;
+        i = (i / region_ids) * region_ids - 1;
+        continue;
+      }
+      uint64_t bits = m_word[i / 64] & (~uint64_t(0) >> (63 - i % 64));
+      if (bits)
+        return (i / 64) * 64 + high_bit(bits);
+      if (i < 64)
+        return 0;
+      i = (i / 64) * 64 - 1;
+    }
+  }
+
+  std::size_t  lowest() const               { return next(0); }
+
+  std::size_t  nearest(std::size_t id) const
+  //  Returns: The free id nearest id, preferring one after id on a tie, or 0 if none.
+  {
+    std::size_t after = next(id);
+    std::size_t before = test_or_prior(id);
+    if (before == id)
+      return id;
+    if (!after)
+      return before;
+    return before && id - before < after - id ? before : after;
+  }
+
+private:
+  std::size_t            m_size;
+  std::size_t            m_count;
+  std::vector<uint64_t>  m_word;    // bit id % 64 of word id / 64 is set if id is free
+  std::vector<uint32_t>  m_region;  // count of free ids in each region
+
+  static uint64_t  bit(std::size_t id)  { return uint64_t(1) << (id % 64); }
+
+  static unsigned  low_bit(uint64_t bits)
+  {
+    BOOST_ASSERT(bits);
+    unsigned n = 0;
+    for (; !(bits & 0xFFFFFFFF); bits >>= 32) n += 32;
+    for (; !(bits & 1); bits >>= 1) ++n;
+    return n;
+  }
+
+  static unsigned  high_bit(uint64_t bits)
+  {
+    BOOST_ASSERT(bits);
+    unsigned n = 63;
+    for (; !(bits & (uint64_t(0xFFFFFFFF) << 32)); bits <<= 32) n -= 32;
+    for (; !(bits & (uint64_t(1) << 63)); bits <<= 1) --n;
+    return n;
+  }
+
+  std::size_t  test_or_prior(std::size_t id) const
+  {
+    return id && id < m_size && test(id) ? id : prior(id);
+  }
+};
+
+}  // namespace detail
+}  // namespace btree
+}  // namespace boost
+
+#endif  // BOOST_BTREE_FREE_MAP_HPP
@@ -448,6 +448,8 @@ public:
                                             {m_index_btree.max_cache_size(m);}
   void              max_cache_megabytes(std::size_t mb)
                                             {m_index_btree.max_cache_megabytes(mb);}
+  void              min_fill_percent(unsigned pct)  // 0 indicates no rebalancing
+                                            {m_index_btree.min_fill_percent(pct);}
   // file operations
   // TODO: what about flat file flush/close?
   void              flush()                 {m_index_btree.flush();}
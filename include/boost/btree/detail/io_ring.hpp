@@ -0,0 +1,136 @@
+//  io_ring.hpp - queued asynchronous file I/O  ----------------------------------------//
+
+//  Copyright agent 2026
+
+//  Distributed under the Boost Software License, Version 1.0.
+//  See http://www.boost.org/LICENSE_1_0.txt
+
+//--------------------------------------------------------------------------------------//
+
+//  The io_ring class queues positioned reads and writes on a binary_file and reports
+//  their completions. On Linux it is implemented with io_uring, using the raw system
+//  calls so that no external library is needed; many operations can then be in flight
+//  at once. Where io_uring is not available (other operating systems, older kernels,
+//  or a seccomp policy that forbids it), each operation is performed synchronously by
+//  binary_file::read_at or write_at when it is queued, and its completion is reported
+//  in the same way, so callers need only one code path.
+//
+//  Define BOOST_BTREE_NO_IO_URING to always use the synchronous implementation.
+
+//--------------------------------------------------------------------------------------//
+
+#ifndef BOOST_BTREE_IO_RING_HPP
+#define BOOST_BTREE_IO_RING_HPP
+
+#include <boost/btree/detail/config.hpp>
+#include <boost/btree/detail/binary_file.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/cstdint.hpp>
+#include <vector>
+#include <cstddef>  // for size_t
+
+#include <boost/config/abi_prefix.hpp>  // must be the last #include
+
+namespace boost
+{
+  namespace btree
+  {
+    namespace detail { struct io_ring_impl; }
+
+    //  class io_ring  -----------------------------------------------------------------//
+
+    class BOOST_BTREE_DECL io_ring // noncopyable
+    {
+    private:
+      io_ring(const io_ring&);
+      const io_ring& operator=(const io_ring&);
+
+    public:
+      typedef binary_file::offset_type  offset_type;
+
+      struct completion
+      {
+        boost::uint64_t     user_data;  // as passed to read() or write()
+        std::size_t         size;       // bytes transferred; 0 if error or if a
+                                        // read was at or beyond end-of-file
+        system::error_code  ec;
+      };
+
+      io_ring() : m_file(0), m_impl(0), m_depth(0), m_in_flight(0) {}
+     ~io_ring()                            { close(); }
+
+      void open(binary_file& f, unsigned queue_depth=64, bool allow_native=true);
+      // Requires: f.is_open() && queue_depth > 0 && !is_open()
+      // Effects: Prepares to queue operations on f. Uses io_uring if allow_native
+      //   and it is available, otherwise the synchronous implementation.
+
+      void close();
+      // Effects: If is_open(), waits for all operations in flight, discarding
+      //   their completions, then releases resources.
+
+      bool is_open() const                 { return m_file != 0; }
+      bool native() const                  { return m_impl != 0; }
+      unsigned queue_depth() const         { return m_depth; }
+      std::size_t in_flight() const        { return m_in_flight; }
+      // Returns: Number of operations queued but whose completions have not yet
+      //   been returned by wait()
+
+      void register_buffers(const io_segment* regions, std::size_t n);
+      // Requires: is_open() && in_flight() == 0
+      // Effects: Replaces the set of registered buffers. Operations on memory that
+      //   lies entirely within a registered region avoid per-operation page pinning.
+      //   Registration is an optimization only; if the kernel refuses it, or the
+      //   synchronous implementation is in use, nothing is registered.
+
+      std::size_t registered_buffers() const;
+
+      void read(offset_type offset, void* target, std::size_t sz,
+        boost::uint64_t user_data);
+      void write(offset_type offset, const void* source, std::size_t sz,
+        boost::uint64_t user_data);
+      void write(offset_type offset, const io_segment* segments, std::size_t n,
+        boost::uint64_t user_data);
+      // Requires: is_open(). Memory, including the segments array, must remain
+      //   valid until the completion is returned by wait().
+      // Effects: Queues the operation. If queue_depth() operations are already in
+      //   flight, first waits for one of them to complete.
+      // Remarks: Short transfers are completed synchronously before the completion
+      //   is reported.
+
+      std::size_t submit();
+      // Effects: Passes queued operations to the kernel without waiting.
+      // Returns: Number of operations passed.
+
+      std::size_t wait(std::vector<completion>& results, std::size_t min_complete=1);
+      // Effects: Submits queued operations, waits until at least
+      //   min(min_complete, in_flight()) have completed, then appends every
+      //   available completion to results.
+      // Returns: Number of completions appended.
+      // Throws: On error from the io_uring system calls themselves; errors of
+      //   individual operations are reported in completion::ec.
+
+    private:
+      binary_file*              m_file;
+      detail::io_ring_impl*     m_impl;      // 0 if synchronous implementation
+      unsigned                  m_depth;
+      std::size_t               m_in_flight;
+      std::vector<completion>   m_ready;     // completed, not yet returned by wait()
+      std::vector<io_segment>   m_registered;
+
+      void m_queue(offset_type offset, const io_segment* segments, std::size_t n,
+        bool is_read, boost::uint64_t user_data);
+      void m_reap(std::size_t min_ready);
+      void m_sync_read(offset_type offset, void* target, std::size_t sz,
+        boost::uint64_t user_data);
+      void m_sync_write(offset_type offset, const io_segment* segments, std::size_t n,
+        boost::uint64_t user_data);
+    }; // io_ring
+
+  } // namespace btree
+} // namespace boost
+
+//--------------------------------------------------------------------------------------//
+
+#include <boost/config/abi_suffix.hpp> // pops abi_prefix.hpp pragmas
+
+#endif  // BOOST_BTREE_IO_RING_HPP
@@ -0,0 +1,465 @@
+//  boost/btree/detail/node_search.hpp  ------------------------------------------------//
+
+//  Copyright agent 2026
+
+//  Distributed under the Boost Software License, Version 1.0.
+//  See http://www.boost.org/LICENSE_1_0.txt
+
+//  See http://www.boost.org/libs/btree for documentation.
+
+//--------------------------------------------------------------------------------------//
+
+//  Searches the elements of a single node for the lower or upper bound of a key.
+//
+//  When the key type is a built-in 32 or 64-bit integer or floating point type, the
+//  search key converts to it exactly, and the comparison is btree::less or std::less,
+//  a k-ary search narrows the node to a window of a few elements, comparing the search
+//  key against four evenly spaced pivots at a time, and the window is then counted
+//  rather than bisected. Both steps use SSE2 or, for 64-bit integers, AVX2 where the
+//  CPU supports it (detected at run time), so there are no data dependent branches
+//  for the CPU to mispredict. Keys are read with the element stride, so the same code
+//  serves set leaves, map leaves, and branches.
+//
+//  Other key types, including the endian types, user-defined types, and heterogeneous
+//  search keys, use the generic search named by the traits' node_search_type: either
+//  a branch-free binary search that prefetches both candidate midpoints of the next
+//  step (branchless_node_search, the default), or std::lower_bound and
+//  std::upper_bound (std_node_search).
+//
+//  Define BOOST_BTREE_NO_SIMD to use only portable code; the k-ary search is still
+//  used for eligible keys, but each pivot and window element is compared in turn.
+
+//--------------------------------------------------------------------------------------//
+
+#ifndef BOOST_BTREE_NODE_SEARCH_HPP
+#define BOOST_BTREE_NODE_SEARCH_HPP
+
+#include <boost/btree/helpers.hpp>
+#include <boost/mpl/has_xxx.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include <boost/type_traits/is_integral.hpp>
+#include <boost/type_traits/is_signed.hpp>
+#include <boost/type_traits/is_floating_point.hpp>
+#include <boost/cstdint.hpp>
+#include <cstddef>     // for size_t, ptrdiff_t
+#include <cstring>     // for memcpy
+#include <functional>  // for less
+#include <algorithm>
+
+#if defined(__GNUC__) || defined(__clang__)
+# define BOOST_BTREE_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# include <xmmintrin.h>
+# define BOOST_BTREE_PREFETCH(p) \
+    _mm_prefetch(reinterpret_cast<const char*>(p), _MM_HINT_T0)
+#else
+# define BOOST_BTREE_PREFETCH(p)
+#endif
+
+#if !defined(BOOST_BTREE_NO_SIMD) \
+  && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+# define BOOST_BTREE_SSE2
+# include <emmintrin.h>
+# if (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))) \
+    || defined(__clang__)
+#   define BOOST_BTREE_AVX2_DISPATCH
+#   include <immintrin.h>
+# endif
+#endif
+
+namespace boost
+{
+namespace btree
+{
+namespace detail
+{
+
+  //  node_search_policy  --------------------------------------------------------------//
+
+  //  Traits::node_search_type if present, otherwise branchless_node_search
+
+  BOOST_MPL_HAS_XXX_TRAIT_DEF(node_search_type)
+
+  template <class Traits, bool = has_node_search_type<Traits>::value>
+  struct node_search_policy { typedef branchless_node_search type; };
+
+  template <class Traits>
+  struct node_search_policy<Traits, true>
+    { typedef typename Traits::node_search_type type; };
+
+  //  node_key_kind  -------------------------------------------------------------------//
+
+  enum node_key_kind
+    { generic_key, int32_key, uint32_key, int64_key, uint64_key, float_key, double_key };
+
+  template <class Key>
+  struct node_key_kind_of
+  {
+    static const node_key_kind value =
+      is_integral<Key>::value && sizeof(Key) == 4
+        ? (is_signed<Key>::value ? int32_key : uint32_key)
+      : is_integral<Key>::value && sizeof(Key) == 8
+        ? (is_signed<Key>::value ? int64_key : uint64_key)
+      : is_floating_point<Key>::value && sizeof(Key) == 4 ? float_key
+      : is_floating_point<Key>::value && sizeof(Key) == 8 ? double_key
+      : generic_key;
+  };
+
+  //  A search key of another type qualifies if converting it to Key cannot change
+  //  the result of any comparison, as with an int search key for a long long key.
+
+  template <class Key, class K>
+  struct node_key_widens
+  {
+    static const bool value = is_same<Key, K>::value
+      || (is_integral<Key>::value && is_integral<K>::value
+        && is_signed<Key>::value == is_signed<K>::value && sizeof(K) <= sizeof(Key))
+      || (is_floating_point<Key>::value && is_floating_point<K>::value
+        && sizeof(K) <= sizeof(Key));
+  };
+
+  template <class Key, class Compare, class K>
+  struct node_search_kind
+  {
+    static const node_key_kind value =
+      node_key_widens<Key, K>::value
+        && (is_same<Compare, btree::less>::value
+          || is_same<Compare, std::less<Key> >::value)
+      ? node_key_kind_of<Key>::value : generic_key;
+  };
+
+  //  count4  --------------------------------------------------------------------------//
+
+  //  Returns the number of the four keys at p, p+step, p+2*step, p+3*step that are
+  //  less than k or, if Inclusive, less than or equal to k.
+
+  template <class T>
+  inline T load_key(const char* p)
+  {
+    T v;
+    std::memcpy(&v, p, sizeof(T));
+    return v;
+  }
+
+  template <bool Inclusive, class T>
+  inline unsigned count4_portable(const char* p, std::ptrdiff_t step, T k)
+  {
+    unsigned n = 0;
+    for (int i = 0; i < 4; ++i, p += step)
+      n += Inclusive ? !(k < load_key<T>(p)) : load_key<T>(p) < k;
+    return n;
+  }
+
+#ifdef BOOST_BTREE_SSE2
+
+  inline unsigned mask_count(int mask)  // mask has at most four bits
+  {
+    static const unsigned char bits[16] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4};
+    return bits[mask];
+  }
+
+  inline __m128i load4_epi32(const char* p, std::ptrdiff_t step)
+  {
+    return step == 4
+      ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))
+      : _mm_set_epi32(load_key<int32_t>(p+3*step), load_key<int32_t>(p+2*step),
+          load_key<int32_t>(p+step), load_key<int32_t>(p));
+  }
+
+  template <bool Inclusive>
+  inline unsigned count4_epi32(__m128i keys, __m128i k)
+  {
+    __m128i mask = Inclusive ? _mm_cmpgt_epi32(keys, k) : _mm_cmpgt_epi32(k, keys);
+    unsigned n = mask_count(_mm_movemask_ps(_mm_castsi128_ps(mask)));
+    return Inclusive ? 4 - n : n;
+  }
+
+  template <bool Inclusive>
+  inline unsigned count4(const char* p, std::ptrdiff_t step, int32_t k)
+  {
+    return count4_epi32<Inclusive>(load4_epi32(p, step), _mm_set1_epi32(k));
+  }
+
+  template <bool Inclusive>
+  inline unsigned count4(const char* p, std::ptrdiff_t step, uint32_t k)
+  {
+    // flip the sign bit so that the signed comparison orders unsigned values
+    const __m128i bias = _mm_set1_epi32(static_cast<int32_t>(0x80000000u));
+    return count4_epi32<Inclusive>(_mm_xor_si128(load4_epi32(p, step), bias),
+      _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(k)), bias));
+  }
+
+  template <bool Inclusive>
+  inline unsigned count4(const char* p, std::ptrdiff_t step, float k)
+  {
+    __m128 keys = step == 4
+      ? _mm_loadu_ps(reinterpret_cast<const float*>(p))
+      : _mm_set_ps(load_key<float>(p+3*step), load_key<float>(p+2*step),
+          load_key<float>(p+step), load_key<float>(p));
+    __m128 kv = _mm_set1_ps(k);
+    return mask_count(_mm_movemask_ps(
+      Inclusive ? _mm_cmple_ps(keys, kv) : _mm_cmplt_ps(keys, kv)));
+  }
+
+  template <bool Inclusive>
+  inline unsigned count4(const char* p, std::ptrdiff_t step, double k)
+  {
+    __m128d lo = _mm_set_pd(load_key<double>(p+step), load_key<double>(p));
+    __m128d hi = _mm_set_pd(load_key<double>(p+3*step), load_key<double>(p+2*step));
+    __m128d kv = _mm_set1_pd(k);
+    return Inclusive
+      ? mask_count(_mm_movemask_pd(_mm_cmple_pd(lo, kv)))
+        + mask_count(_mm_movemask_pd(_mm_cmple_pd(hi, kv)))
+      : mask_count(_mm_movemask_pd(_mm_cmplt_pd(lo, kv)))
+        + mask_count(_mm_movemask_pd(_mm_cmplt_pd(hi, kv)));
+  }
+
+  //  SSE2 has no 64-bit integer compare, so these need AVX2
+
+# ifdef BOOST_BTREE_AVX2_DISPATCH
+
+  inline bool cpu_has_avx2()
+  {
+    static const bool has = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+    return has;
+  }
+
+  template <bool Inclusive>
+  __attribute__((target("avx2")))
+  inline unsigned count4_epi64(const char* p, std::ptrdiff_t step, int64_t k,
+    int64_t bias)
+  {
+    __m256i keys = step == 8
+      ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))
+      : _mm256_set_epi64x(load_key<int64_t>(p+3*step), load_key<int64_t>(p+2*step),
+          load_key<int64_t>(p+step), load_key<int64_t>(p));
+    __m256i b = _mm256_set1_epi64x(bias);
+    keys = _mm256_xor_si256(keys, b);
+    __m256i kv = _mm256_xor_si256(_mm256_set1_epi64x(k), b);
+    __m256i mask = Inclusive ? _mm256_cmpgt_epi64(keys, kv) : _mm256_cmpgt_epi64(kv, keys);
+    unsigned n = mask_count(_mm256_movemask_pd(_mm256_castsi256_pd(mask)));
+    return Inclusive ? 4 - n : n;
+  }
+
+  template <bool Inclusive>
+  inline unsigned count4(const char* p, std::ptrdiff_t step, int64_t k)
+  {
+    return cpu_has_avx2()
+      ? count4_epi64<Inclusive>(p, step, k, 0)
+      : count4_portable<Inclusive>(p, step, k);
+  }
+
+  template <bool Inclusive>
+  inline unsigned count4(const char* p, std::ptrdiff_t step, uint64_t k)
+  {
+    return cpu_has_avx2()
+      ? count4_epi64<Inclusive>(p, step, static_cast<int64_t>(k),
+          static_cast<int64_t>(0x8000000000000000ull))
+      : count4_portable<Inclusive>(p, step, k);
+  }
+
+# else
+
+  template <bool Inclusive>
+  inline unsigned count4(const char* p, std::ptrdiff_t step, int64_t k)
+    { return count4_portable<Inclusive>(p, step, k); }
+
+  template <bool Inclusive>
+  inline unsigned count4(const char* p, std::ptrdiff_t step, uint64_t k)
+    { return count4_portable<Inclusive>(p, step, k); }
+
+# endif
+
+#else  // no SSE2
+
+  template <bool Inclusive, class T>
+  inline unsigned count4(const char* p, std::ptrdiff_t step, T k)
+    { return count4_portable<Inclusive>(p, step, k); }
+
+#endif
+
+  //  kary_bound  ----------------------------------------------------------------------//
+
+  //  Returns the index of the first of the n keys at first, first+stride, ... that is
+  //  not less than k or, if Inclusive, is greater than k.
+
+  template <bool Inclusive, class T>
+  std::size_t kary_bound(const char* first, std::size_t stride, std::size_t n, T k)
+  {
+    const std::size_t window = 16;
+    const char* base = first;
+
+    //  Invariant: the bound is in [base, base+n], and every key before base is
+    //  counted. Each step compares the four pivots at base + i*s, i = 1..4, and keeps
+    //  only the gap between the last pivot counted and the first one not counted.
+    while (n > window)
+    {
+      std::size_t s = n / 5;
+      unsigned c = count4<Inclusive>(base + s * stride,
+        static_cast<std::ptrdiff_t>(s * stride), k);
+      std::size_t lo = c * s + (c != 0);
+      std::size_t hi = c < 4 ? (c + 1) * s : n;
+      base += lo * stride;
+      n = hi - lo;
+    }
+
+    std::size_t bound = (base - first) / stride;
+    for (; n >= 4; n -= 4, base += 4 * stride)
+      bound += count4<Inclusive>(base, static_cast<std::ptrdiff_t>(stride), k);
+    for (; n; --n, base += stride)
+      bound += Inclusive ? !(k < load_key<T>(base)) : load_key<T>(base) < k;
+    return bound;
+  }
+
+  //  generic_node_search  -------------------------------------------------------------//
+
+  template <class Policy> struct generic_node_search;
+
+  template <>
+  struct generic_node_search<std_node_search>
+  {
+    template <class Element, class K, class Comp>
+    static Element* lower_bound(Element* first, Element* last, const K& k, Comp comp)
+      { return std::lower_bound(first, last, k, comp); }
+
+    template <class Element, class K, class Comp>
+    static Element* upper_bound(Element* first, Element* last, const K& k, Comp comp)
+      { return std::upper_bound(first, last, k, comp); }
+  };
+
+  template <class Element, class K, class Comp>
+  struct element_less       // is the element before the lower bound?
+  {
+    const K& k; Comp comp;
+    element_less(const K& key, Comp c) : k(key), comp(c) {}
+    bool operator()(const Element& e) const { return comp(e, k); }
+  };
+
+  template <class Element, class K, class Comp>
+  struct element_not_greater  // is the element before the upper bound?
+  {
+    const K& k; Comp comp;
+    element_not_greater(const K& key, Comp c) : k(key), comp(c) {}
+    bool operator()(const Element& e) const { return !comp(k, e); }
+  };
+
+  template <>
+  struct generic_node_search<branchless_node_search>
+  {
+    //  Invariant: the bound is in [first, first+n], and pred is true for every element
+    //  before first. The comparison result only selects how far first moves, so the
+    //  loop has no data dependent branch; since the next midpoint is one of two known
+    //  addresses, both are prefetched while the current comparison is in progress.
+    template <class Element, class Pred>
+    static Element* bound(Element* first, std::size_t n, Pred pred)
+    {
+      if (n == 0)
+        return first;
+      while (n > 1)
+      {
+        std::size_t half = n / 2;
+        BOOST_BTREE_PREFETCH(first + (n - half) / 2);
+        BOOST_BTREE_PREFETCH(first + half + (n - half) / 2);
+        first += half * static_cast<std::size_t>(pred(first[half]));
+        n -= half;
+      }
+      return first + static_cast<std::size_t>(pred(*first));
+    }
+
+    template <class Element, class K, class Comp>
+    static Element* lower_bound(Element* first, Element* last, const K& k, Comp comp)
+    {
+      return bound(first, last - first, element_less<Element, K, Comp>(k, comp));
+    }
+
+    template <class Element, class K, class Comp>
+    static Element* upper_bound(Element* first, Element* last, const K& k, Comp comp)
+    {
+      return bound(first, last - first, element_not_greater<Element, K, Comp>(k, comp));
+    }
+  };
+
+  //  node_search  ---------------------------------------------------------------------//
+
+  template <node_key_kind Kind, class Policy>
+  struct node_search
+  {
+    template <class Key, class Element, class K, class Comp>
+    static Element* lower_bound(Element* first, Element* last, const Key*,
+      const K& k, Comp comp)
+      { return generic_node_search<Policy>::lower_bound(first, last, k, comp); }
+
+    template <class Key, class Element, class K, class Comp>
+    static Element* upper_bound(Element* first, Element* last, const Key*,
+      const K& k, Comp comp)
+      { return generic_node_search<Policy>::upper_bound(first, last, k, comp); }
+  };
+
+  //  node_search_simd  ----------------------------------------------------------------//
+
+  template <node_key_kind Kind> struct node_key_lane;
+  template <> struct node_key_lane<int32_key>  { typedef int32_t type; };
+  template <> struct node_key_lane<uint32_key> { typedef uint32_t type; };
+  template <> struct node_key_lane<int64_key>  { typedef int64_t type; };
+  template <> struct node_key_lane<uint64_key> { typedef uint64_t type; };
+  template <> struct node_key_lane<float_key>  { typedef float type; };
+  template <> struct node_key_lane<double_key> { typedef double type; };
+
+  template <node_key_kind Kind>
+  struct node_search_simd
+  {
+    typedef typename node_key_lane<Kind>::type lane_type;  // same representation as Key
+
+    template <bool Inclusive, class Key, class Element>
+    static Element* bound(Element* first, Element* last, const Key* first_key, Key k)
+    {
+      const char* keys = reinterpret_cast<const char*>(first_key);
+      return first + kary_bound<Inclusive>(keys, sizeof(Element), last - first,
+        static_cast<lane_type>(k));
+    }
+
+    template <class Key, class Element, class K, class Comp>
+    static Element* lower_bound(Element* first, Element* last, const Key* first_key,
+      const K& k, Comp)
+      { return bound<false>(first, last, first_key, static_cast<Key>(k)); }
+
+    template <class Key, class Element, class K, class Comp>
+    static Element* upper_bound(Element* first, Element* last, const Key* first_key,
+      const K& k, Comp)
+      { return bound<true>(first, last, first_key, static_cast<Key>(k)); }
+  };
+
+  template <class P> struct node_search<int32_key, P>  : node_search_simd<int32_key> {};
+  template <class P> struct node_search<uint32_key, P> : node_search_simd<uint32_key> {};
+  template <class P> struct node_search<int64_key, P>  : node_search_simd<int64_key> {};
+  template <class P> struct node_search<uint64_key, P> : node_search_simd<uint64_key> {};
+  template <class P> struct node_search<float_key, P>  : node_search_simd<float_key> {};
+  template <class P> struct node_search<double_key, P> : node_search_simd<double_key> {};
+
+  //  node_lower_bound, node_upper_bound  ----------------------------------------------//
+
+  //  first_key points to the key of *first; it need not be dereferenceable if
+  //  first == last. comp compares an Element and a K, and is only used by the generic
+  //  search. Policy selects the generic search; see node_search_policy.
+
+  template <class Compare, class Policy, class Key, class Element, class K, class Comp>
+  inline Element* node_lower_bound(Element* first, Element* last, const Key* first_key,
+    const K& k, Comp comp)
+  {
+    return node_search<node_search_kind<Key, Compare, K>::value, Policy>::lower_bound(
+      first, last, first_key, k, comp);
+  }
+
+  template <class Compare, class Policy, class Key, class Element, class K, class Comp>
+  inline Element* node_upper_bound(Element* first, Element* last, const Key* first_key,
+    const K& k, Comp comp)
+  {
+    return node_search<node_search_kind<Key, Compare, K>::value, Policy>::upper_bound(
+      first, last, first_key, k, comp);
+  }
+
+}  // namespace detail
+}  // namespace btree
+}  // namespace boost
+
+#endif  // BOOST_BTREE_NODE_SEARCH_HPP
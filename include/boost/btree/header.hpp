@@ -72,7 +72,8 @@ namespace boost
       node_id_type        m_leaf_node_count;     // active only; free nodes not include
       node_id_type        m_branch_node_count;   // active only; free nodes not include
       node_id_type        m_free_node_list_head_id;  // list of recycleable nodes
-      node_id_type        m_unassigned[2];
+      node_id_type        m_first_node_id;       // first leaf
+      node_id_type        m_unassigned;
       version_type        m_major_version;   
       version_type        m_minor_version; 
 
@@ -112,6 +113,7 @@ namespace boost
       //  "updated" members that change as the file changes
       uint64_t         element_count() const         { return m_element_count; }
       node_id_type     root_node_id() const          { return m_root_node_id; }
+      node_id_type     first_node_id() const         { return m_first_node_id; }
       node_id_type     last_node_id() const          { return m_last_node_id; }
       node_id_type     node_count() const            { return m_node_count; }
       node_id_type     leaf_node_count() const       { return m_leaf_node_count; }
@@ -148,6 +150,7 @@ namespace boost
       void  increment_element_count()                { ++m_element_count; }
       void  decrement_element_count()                { --m_element_count; }
       void  root_node_id(node_id_type id)            { m_root_node_id = id; }
+      void  first_node_id(node_id_type id)           { m_first_node_id = id; }
       void  last_node_id(node_id_type id)            { m_last_node_id = id; }
       void  node_count(node_id_type value)           { m_node_count = value; }
       void  increment_node_count()                   { ++m_node_count; }
@@ -180,6 +183,7 @@ namespace boost
           endian::reverse(m_signature);
           endian::reverse(m_flags);
           endian::reverse(m_root_node_id);
+          endian::reverse(m_first_node_id);
           endian::reverse(m_last_node_id);
           endian::reverse(m_node_count);
           endian::reverse(m_leaf_node_count);
@@ -33,7 +33,7 @@ namespace btree
 //--------------------------------------------------------------------------------------//
 
     static const uint16_t major_version = 0;  // version identification
-    static const uint16_t minor_version = 1;
+    static const uint16_t minor_version = 2;  // 2: leaf sibling links
 
     static const std::size_t default_node_size = 4096;
 
@@ -59,12 +59,26 @@ namespace btree
 //                                                                                      //
 //--------------------------------------------------------------------------------------//
 
+//--------------------------------------------------------------------------------------//
+//                                 node search policies                                 //
+//                                                                                      //
+//  A traits class may name one of these as its node_search_type to choose how a key    //
+//  is located within a node. Built-in arithmetic keys compared by btree::less use a    //
+//  SIMD search regardless; the policy applies to all other keys. Traits without a      //
+//  node_search_type get branchless_node_search.                                        //
+//                                                                                      //
+//--------------------------------------------------------------------------------------//
+
+struct branchless_node_search {};  // branch-free binary search, prefetching ahead
+struct std_node_search {};         // std::lower_bound and std::upper_bound
+
 struct big_endian_traits
 {
   typedef endian::big_uint32_t  node_id_type;            // node ids are page numbers
   typedef uint8_t               node_level_type;         // level of node; 0 for leaf node
   typedef endian::big_uint24_t  node_size_type;          // permits large node sizes
   typedef endian::big_uint48_t  index_position_type;     // allows large flat files
+  typedef branchless_node_search  node_search_type;      // see node search policies
   static const BOOST_SCOPED_ENUM(endian::order) header_endianness
     = endian::order::big;
 };
@@ -75,6 +89,7 @@ struct little_endian_traits
   typedef uint8_t                  node_level_type;      // level of node; 0 for leaf node
   typedef endian::little_uint24_t  node_size_type;       // permits large node sizes
   typedef endian::little_uint48_t  index_position_type;  // allows large flat files
+  typedef branchless_node_search   node_search_type;     // see node search policies
   static const BOOST_SCOPED_ENUM(endian::order) header_endianness
     = endian::order::little;
 };
@@ -85,6 +100,7 @@ struct native_endian_traits
   typedef uint8_t                  node_level_type;      // level of node; 0 for leaf node
   typedef endian::native_uint24_t  node_size_type;       // permits large node sizes
   typedef endian::native_uint48_t  index_position_type;  // allows large flat files
+  typedef branchless_node_search   node_search_type;     // see node search policies
   static const BOOST_SCOPED_ENUM(endian::order) header_endianness
 #   ifdef BOOST_BIG_ENDIAN
     = endian::order::big;
@@ -115,10 +131,18 @@ namespace flags
     truncate       = 0x400,   // same as read_write except existing file truncated
 
     // bitmask options set by user; not present in header:
-    preload        = 0x1000, // existing file read to preload O/S external memory cache
-    cache_branches = 0x2000, // enable permanent cache of all branch pages touched;
-                             // otherwise make branch pages available when use count
-                             // becomes 0, just like leaf pages.
+    direct_io      = 0x800,  // bypass the O/S disk cache, so that only the btree cache
+                             // holds nodes; node size must be a multiple of 4096
+    preload        = 0x1000, // existing file read to preload O/S external memory cache,
+                             // then btree cache loaded breadth-first from the root
+    cache_branches = 0x2000, // branch pages are kept in the cache in preference to
+                             // leaf pages, upper levels longest, up to a share of
+                             // max_cache_size(); otherwise branch pages are evicted
+                             // just like leaf pages.
+    write_back     = 0x4000, // write dirty pages in a background thread ahead of
+                             // eviction
+    async_io       = 0x8000, // flush() queues all its writes at once, via io_uring
+                             // where available
 
      // optimization hints; choose one. not present in header
      least_memory  = 0x10000,
@@ -126,6 +150,24 @@ namespace flags
      balanced      = 0,
      fast          = 0x30000,
      fastest       = 0x40000,
+
+     // cache replacement policy; choose one. not present in header
+     lru           = 0,         // least recently used
+     two_queue     = 0x100000,  // 2Q; a single sequential scan won't flush hot pages
+     clock_pro     = 0x200000,  // CLOCK-Pro; scan resistant and adaptive
+     replacement_mask = 0x300000,  // selects the policy bits above
+
+    // more bitmask options set by user; not present in header:
+    memory_map     = 0x400000, // read_only only: nodes point directly into a
+                               // read-only memory mapping of the file
+    persist_cache  = 0x800000, // close() saves the ids of cached nodes to a sidecar
+                               // file; open() reads those nodes back into the cache
+    shared_cache   = 0x1000000, // cache nodes in buffer_pool::global(), whose memory
+                                // budget and LRU list span all btrees so opened
+    auto_cache     = 0x2000000, // max_cache_size() adjusted automatically from the
+                                // cache hit ratio and system memory pressure
+    huge_pages     = 0x4000000, // cache memory comes from huge pages where available,
+                                // reducing TLB misses with large caches
   };
 
   BOOST_BITMASK(bitmask);
@@ -144,6 +186,32 @@ const uint32_t KB = 1024;
 const uint32_t MB = 1048576;  // 1024 * 1024
 const uint32_t GB = 1073741824;  // 1024 * 1024 * 1024
 
+//--------------------------------------------------------------------------------------//
+//                                compaction statistics                                 //
+//--------------------------------------------------------------------------------------//
+
+//  Reported by compaction_stats(). The "after" members are set when compaction ends.
+
+struct compact_stats
+{
+  uint64_t  leaves_done;        // leaves repacked and placed so far, of leaves_before
+  uint64_t  nodes_before;       // nodes in the file, including the header and free nodes
+  uint64_t  nodes_after;
+  uint64_t  leaves_before;
+  uint64_t  leaves_after;
+  uint64_t  branches_before;
+  uint64_t  branches_after;
+  double    fill_before;        // elements as a percentage of total leaf capacity
+  double    fill_after;
+  double    sequential_before;  // percentage of steps from a leaf to the next leaf in
+  double    sequential_after;   //   key order that go to the next node id
+
+  compact_stats()
+    : leaves_done(0), nodes_before(0), nodes_after(0), leaves_before(0),
+      leaves_after(0), branches_before(0), branches_after(0), fill_before(0.0),
+      fill_after(0.0), sequential_before(0.0), sequential_after(0.0) {}
+};
+
 //--------------------------------------------------------------------------------------//
 //                               hint based defaults                                    //
 //--------------------------------------------------------------------------------------//
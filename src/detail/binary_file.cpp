@@ -40,6 +40,11 @@ using boost::system::system_category;
 #   include <sys/types.h>
 #   include "unistd.h"
 #   include "fcntl.h"
+#   if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) \
+      || defined(__OpenBSD__) || defined(__DragonFly__)
+#     include <sys/uio.h>
+#     define BOOST_BTREE_HAS_PWRITEV
+#   endif
 # endif
 // #include <iostream>    // for debugging only; comment out when not in use
 
@@ -77,6 +82,8 @@ namespace boost
       = reinterpret_cast<binary_file::handle_type>(-1);
 #   endif
 
+    const std::size_t binary_file::direct_alignment;
+
 //  -----------------------------------  open  ----------------------------------------  //
 
     const oflag::bitmask omask(oflag::in | oflag::out | oflag::truncate);
@@ -124,10 +131,13 @@ namespace boost
         flags_and_attributes |= FILE_FLAG_RANDOM_ACCESS;
       if ((flags & oflag::sequential) != 0)
         flags_and_attributes |= FILE_FLAG_SEQUENTIAL_SCAN;
+      if ((flags & oflag::direct) != 0)
+        flags_and_attributes |= FILE_FLAG_NO_BUFFERING;
 
       HANDLE h (::CreateFileW(p.c_str(), desired_access,
         FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
         creation_disposition, flags_and_attributes, 0));
+      m_direct = (flags & oflag::direct) != 0;
 
       if (h == INVALID_HANDLE_VALUE)
       {
@@ -154,13 +164,29 @@ namespace boost
 
       ::mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
 
-      m_handle = ::open(p.c_str(), openflag, mode);
+      m_direct = false;
+#     ifdef O_DIRECT
+      if (flags & oflag::direct)
+      {
+        m_handle = ::open(p.c_str(), openflag | O_DIRECT, mode);
+        m_direct = m_handle >= 0;
+        if (m_handle < 0 && errno == EINVAL)  // file system does not support O_DIRECT
+          m_handle = ::open(p.c_str(), openflag, mode);
+      }
+      else
+#     endif
+        m_handle = ::open(p.c_str(), openflag, mode);
 
       if (m_handle < 0)
       {
         ec.assign(errno, system_category());
         return false;
       }
+
+#     if defined(F_NOCACHE) && !defined(O_DIRECT)
+      if (flags & oflag::direct)
+        m_direct = ::fcntl(m_handle, F_NOCACHE, 1) != -1;
+#     endif
 #   endif
 
       ec.clear();
@@ -194,6 +220,7 @@ namespace boost
 //std::cout << "*** close " << m_path.string() << std::endl;
       bool ok (::CloseHandle(m_handle) != 0);
       m_handle = INVALID_HANDLE_VALUE;
+      m_direct = false;
       if (ok)
         return true;
       ec.assign(::GetLastError(), system_category());
@@ -204,6 +231,7 @@ namespace boost
         return false;
       bool ok (::close(m_handle) == 0);
       m_handle = -1;
+      m_direct = false;
       if (ok)
         return true;
       ec.assign(errno, system_category());
@@ -417,6 +445,210 @@ namespace boost
         BOOST_BTREE_THROW(filesystem::filesystem_error("binary_file::write", path(), ec));
     }
 
+//  ---------------------------------  read_at  --------------------------------------  //
+
+    bool binary_file::read_at(offset_type offset, void* target, std::size_t sz,
+      system::error_code& ec)
+    {
+      BOOST_ASSERT(is_open());
+//std::cout << "*** read_at " << m_path.string() << " offset " << offset
+//  << " into " << target << " size " << sz << std::endl;
+#   ifdef BOOST_WINDOWS_API
+      OVERLAPPED ov = OVERLAPPED();
+      ov.Offset = static_cast<DWORD>(offset);
+      ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+      DWORD sz_read;
+      if (!::ReadFile(handle(), target, DWORD(sz), &sz_read, &ov))
+      {
+        DWORD err = ::GetLastError();
+        if (err == ERROR_HANDLE_EOF)  // positioned read at or beyond end-of-file
+        {
+          ec.clear();
+          return false;
+        }
+        ec.assign(err, system_category());
+        return false;
+      }
+      // As with m_read(), consider a partial read an error.
+      if (sz_read != 0 && sz_read != sz)
+      {
+        ec = error_code(ERROR_READ_FAULT, system_category());
+        return false;
+      }
+      ec.clear();
+      return sz_read != 0;
+
+#   else  // BOOST_POSIX_API
+      //  Allow for partial reads
+      ssize_t sz_read=0;
+      ssize_t sz_to_read=sz;
+      do
+      {
+        sz_read = ::pread(handle(), target, sz_to_read, static_cast<off_t>(offset));
+        if (sz_read < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          ec.assign(errno, system_category());
+          return false;
+        }
+        if (sz_read == 0)
+        {
+          if (sz_to_read == static_cast<ssize_t>(sz)) // no bytes read, so it is a normal eof
+            ec.clear();
+          else  // premature eof
+            ec.assign(EIO, system_category());
+          return false;
+        }
+        target = static_cast<char*>(target) + sz_read;
+        offset += sz_read;
+        sz_to_read -= sz_read;
+
+      } while (sz_to_read); // more to read
+
+      ec.clear();
+      return true;
+
+#   endif
+    }
+
+    bool binary_file::read_at(offset_type offset, void* target, std::size_t sz)
+    {
+      BOOST_ASSERT(is_open());
+      error_code ec;
+      bool result(read_at(offset, target, sz, ec));
+      if (ec)
+        BOOST_BTREE_THROW(filesystem::filesystem_error("binary_file::read_at",
+          path(), ec));
+      return result;
+    }
+
+//  ---------------------------------  write_at  -------------------------------------  //
+
+    void binary_file::write_at(offset_type offset, const void* source, std::size_t sz,
+      system::error_code& ec)
+    {
+      BOOST_ASSERT(is_open());
+//std::cout << "*** write_at " << m_path.string() << " offset " << offset
+//  << " from " << source << " size " << sz << std::endl;
+#   ifdef BOOST_WINDOWS_API
+      OVERLAPPED ov = OVERLAPPED();
+      ov.Offset = static_cast<DWORD>(offset);
+      ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+      DWORD sz_written;
+      if (!::WriteFile(handle(), source, DWORD(sz), &sz_written, &ov))
+        ec.assign(::GetLastError(), system_category());
+      // As with m_write(), consider a partial write an error.
+      else if (sz_written != sz)
+        ec.assign(ERROR_WRITE_FAULT, system_category());
+      else
+        ec.clear();
+
+#   else // BOOST_POSIX_API
+      //  Allow for partial writes
+      ssize_t sz_write = 0;
+      ssize_t sz_written = 0;
+      do
+      {
+        if ((sz_write = ::pwrite(handle(), static_cast<const char*>(source) + sz_written,
+          sz - sz_written, static_cast<off_t>(offset + sz_written))) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          ec.assign(errno, system_category());
+          return;
+        }
+        sz_written += sz_write;
+      } while (sz_written < static_cast<ssize_t>(sz));
+      ec.clear();
+
+#   endif
+    }
+
+    void binary_file::write_at(offset_type offset, const void* source, std::size_t sz)
+    {
+      error_code ec;
+      write_at(offset, source, sz, ec);
+      if (ec)
+        BOOST_BTREE_THROW(filesystem::filesystem_error("binary_file::write_at",
+          path(), ec));
+    }
+
+//  ------------------------------  gather_write_at  ---------------------------------  //
+
+    void binary_file::gather_write_at(offset_type offset, const io_segment* segments,
+      std::size_t n, system::error_code& ec)
+    {
+      BOOST_ASSERT(is_open());
+      ec.clear();
+#   ifdef BOOST_BTREE_HAS_PWRITEV
+      const std::size_t max_iov = 64;  // well below any IOV_MAX
+      ::iovec iov[max_iov];
+      while (n)
+      {
+        std::size_t count = n < max_iov ? n : max_iov;
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+          iov[i].iov_base = const_cast<void*>(segments[i].data);
+          iov[i].iov_len = segments[i].size;
+          total += segments[i].size;
+        }
+        ssize_t sz_written = ::pwritev(handle(), iov, static_cast<int>(count),
+          static_cast<off_t>(offset));
+        if (sz_written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          ec.assign(errno, system_category());
+          return;
+        }
+        offset += sz_written;
+        if (static_cast<std::size_t>(sz_written) != total)
+        {
+          //  partial write; skip completed segments, then finish the partial one
+          std::size_t done = sz_written;
+          while (done >= segments->size)
+          {
+            done -= segments->size;
+            ++segments;
+            --n;
+          }
+          write_at(offset, static_cast<const char*>(segments->data) + done,
+            segments->size - done, ec);
+          if (ec)
+            return;
+          offset += segments->size - done;
+          ++segments;
+          --n;
+          continue;
+        }
+        segments += count;
+        n -= count;
+      }
+
+#   else
+      for (; n; --n, ++segments)
+      {
+        write_at(offset, segments->data, segments->size, ec);
+        if (ec)
+          return;
+        offset += segments->size;
+      }
+
+#   endif
+    }
+
+    void binary_file::gather_write_at(offset_type offset, const io_segment* segments,
+      std::size_t n)
+    {
+      error_code ec;
+      gather_write_at(offset, segments, n, ec);
+      if (ec)
+        BOOST_BTREE_THROW(filesystem::filesystem_error("binary_file::gather_write_at",
+          path(), ec));
+    }
+
 //  -----------------------------------  seek  ---------------------------------------  //
 
     binary_file::offset_type
@@ -473,5 +705,41 @@ namespace boost
         BOOST_BTREE_THROW(filesystem::filesystem_error("binary_file::seek", path(), ec));
       return result;
     }
+
+//  ---------------------------------  truncate  -------------------------------------  //
+
+    void binary_file::truncate(offset_type sz, system::error_code& ec)
+    {
+      BOOST_ASSERT(is_open());
+
+#   ifdef BOOST_WINDOWS_API
+      //  SetEndOfFile() works at the file pointer, so save and restore it
+      LARGE_INTEGER zero, here, target;
+      zero.QuadPart = 0;
+      target.QuadPart = sz;
+      if (::SetFilePointerEx(m_handle, zero, &here, FILE_CURRENT) == 0
+        || ::SetFilePointerEx(m_handle, target, 0, FILE_BEGIN) == 0
+        || ::SetEndOfFile(m_handle) == 0
+        || ::SetFilePointerEx(m_handle, here, 0, FILE_BEGIN) == 0)
+        ec.assign(::GetLastError(), system_category());
+      else
+        ec.clear();
+
+#   else  // BOOST_POSIX_API
+      if (::ftruncate(handle(), static_cast<off_t>(sz)) == -1)
+        ec.assign(errno, system_category());
+      else
+        ec.clear();
+#   endif
+    }
+
+    void binary_file::truncate(offset_type sz)
+    {
+      error_code ec;
+      truncate(sz, ec);
+      if (ec)
+        BOOST_BTREE_THROW(filesystem::filesystem_error("binary_file::truncate",
+          path(), ec));
+    }
   } // namespace btree
 } // namespace boost
@@ -12,43 +12,742 @@
 #define BOOST_BTREE_SOURCE 
 
 #include <boost/btree/detail/buffer_manager.hpp>
+#include <boost/btree/detail/io_ring.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/bind/bind.hpp>
+#include <deque>
 #include <ostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+#ifdef BOOST_WINDOWS_API
+#  include <malloc.h>  // for _aligned_malloc
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#endif
+
+namespace
+{
+  const std::size_t min_table_capacity = 64;  // must be a power of 2
+  const std::size_t min_chunk_size = 64 * 1024;
+  const std::size_t max_chunk_size = 4 * 1024 * 1024;
+  const std::size_t huge_page_size = 2 * 1024 * 1024;  // x86-64 and AArch64 default
+  const std::size_t max_huge_chunk_size = 64 * 1024 * 1024;
+  const std::size_t max_preload_read = 1024 * 1024;  // bytes per preload() read
+  const std::size_t max_preload_gap = 8;  // unwanted buffers preload() will read through
+
+  //  save_cache_state() file format: a cache_state_header, then count buffer ids in
+  //  native byte order. The file describes only this machine's cache, so portability
+  //  is not a concern; a file that doesn't match is simply ignored.
+  struct cache_state_header
+  {
+    char             marker[8];
+    boost::uint32_t  data_size;
+    boost::uint32_t  count;       // number of ids following the header
+    boost::uint32_t  cold_count;  // the first cold_count ids were on the cold list
+    boost::uint32_t  reserved;
+  };
+  const char cache_state_marker[8] = {'b', 't', 'h', 'o', 't', 's', 'e', 't'};
+
+  struct buffer_id_less
+  {
+    bool operator()(const boost::btree::buffer* x, const boost::btree::buffer* y) const
+      { return x->buffer_id() < y->buffer_id(); }
+  };
+
+  void* allocate_aligned(std::size_t sz, std::size_t alignment)
+  {
+#   ifdef BOOST_WINDOWS_API
+    void* p = ::_aligned_malloc(sz, alignment);
+#   else
+    void* p;
+    if (::posix_memalign(&p, alignment, sz))
+      p = 0;
+#   endif
+    if (!p)
+      throw std::bad_alloc();
+    return p;
+  }
+
+  void free_aligned(void* p)
+  {
+#   ifdef BOOST_WINDOWS_API
+    ::_aligned_free(p);
+#   else
+    std::free(p);
+#   endif
+  }
+
+  typedef boost::btree::detail::page_arena  page_arena;
+
+  char* allocate_huge(std::size_t sz, page_arena::chunk_kind& kind)
+  //  Requires: sz is a multiple of huge_page_size
+  {
+#   ifndef BOOST_WINDOWS_API
+#     ifdef MAP_HUGETLB
+    //  explicit huge pages; fails unless the administrator has reserved some
+    void* p = ::mmap(0, sz, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+    {
+      kind = page_arena::hugetlb_chunk;
+      return static_cast<char*>(p);
+    }
+#     endif
+#     ifdef MADV_HUGEPAGE
+    //  transparent huge pages; map an extra huge page so that the chunk can be
+    //  aligned to a huge page boundary, then unmap the unused ends
+    char* q = static_cast<char*>(::mmap(0, sz + huge_page_size,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (q != MAP_FAILED)
+    {
+      std::size_t head = (huge_page_size
+        - reinterpret_cast<std::size_t>(q) % huge_page_size) % huge_page_size;
+      if (head)
+        ::munmap(q, head);
+      if (huge_page_size - head)
+        ::munmap(q + head + sz, huge_page_size - head);
+      ::madvise(q + head, sz, MADV_HUGEPAGE);  // only advice; failure is harmless
+      kind = page_arena::advised_chunk;
+      return q + head;
+    }
+#     endif
+#   endif
+    kind = page_arena::heap_chunk;
+    return static_cast<char*>(allocate_aligned(sz, page_arena::page_alignment));
+  }
+
+# ifdef __linux__
+  bool read_number(const char* path, boost::uint64_t& n)
+  //  Returns: true if the file begins with a number; cgroup files say "max" instead
+  //    of a number for no limit
+  {
+    std::ifstream f(path);
+    return !(f >> n).fail();
+  }
+
+  bool read_field(const char* path, const std::string& key, boost::uint64_t& n)
+  //  Returns: true if a line of the file begins with key followed by a number,
+  //    which is then put in n
+  {
+    std::ifstream f(path);
+    std::string line, k;
+    while (std::getline(f, line))
+    {
+      std::istringstream is(line);
+      if (is >> k && k == key && !(is >> n).fail())
+        return true;
+    }
+    return false;
+  }
+# endif
+}
 
 namespace boost
 {
 namespace btree
 {
+
+//--------------------------------------------------------------------------------------//
+//                                     buffer_table                                     //
+//--------------------------------------------------------------------------------------//
+
+//------------------------------------- insert() ---------------------------------------//
+
+void buffer_table::insert(buffer& b)
+{
+  BOOST_ASSERT(!find(b.buffer_id()));
+  if ((m_size + 1) * 2 > capacity())  // keep load factor <= 1/2
+    m_rehash(capacity() ? capacity() * 2 : min_table_capacity);
+  std::size_t i = m_home(b.buffer_id());
+  while (m_slots[i])
+    i = (i + 1) & m_mask;
+  m_slots[i] = &b;
+  ++m_size;
+}
+
+//-------------------------------------- erase() ---------------------------------------//
+
+void buffer_table::erase(buffer& b)
+{
+  BOOST_ASSERT(m_slots);
+  std::size_t i = m_home(b.buffer_id());
+  while (m_slots[i] != &b)
+  {
+    BOOST_ASSERT(m_slots[i]);  // b must be present
+    i = (i + 1) & m_mask;
+  }
+
+  //  backward-shift deletion: move later members of the probe sequence into the hole
+  //  so that find() never stops early at an empty slot
+  for (std::size_t j = (i + 1) & m_mask; m_slots[j]; j = (j + 1) & m_mask)
+  {
+    std::size_t home = m_home(m_slots[j]->buffer_id());
+    //  the entry at j may fill hole i only if its home is not cyclically in (i, j]
+    bool movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+    if (movable)
+    {
+      m_slots[i] = m_slots[j];
+      i = j;
+    }
+  }
+  m_slots[i] = 0;
+  --m_size;
+}
+
+//-------------------------------------- clear() ---------------------------------------//
+
+void buffer_table::clear()
+{
+  delete [] m_slots;
+  m_slots = 0;
+  m_mask = 0;
+  m_shift = 0;
+  m_size = 0;
+}
+
+//------------------------------------- m_rehash() -------------------------------------//
+
+void buffer_table::m_rehash(std::size_t new_capacity)
+{
+  BOOST_ASSERT((new_capacity & (new_capacity - 1)) == 0);  // power of 2
+  buffer** old_slots = m_slots;
+  std::size_t old_capacity = capacity();
+
+  m_slots = new buffer*[new_capacity];
+  std::memset(m_slots, 0, new_capacity * sizeof(buffer*));
+  m_mask = new_capacity - 1;
+  m_shift = 32;
+  for (std::size_t c = new_capacity; c > 1; c >>= 1)
+    --m_shift;
+
+  for (std::size_t k = 0; k < old_capacity; ++k)
+  {
+    if (old_slots[k])
+    {
+      std::size_t i = m_home(old_slots[k]->buffer_id());
+      while (m_slots[i])
+        i = (i + 1) & m_mask;
+      m_slots[i] = old_slots[k];
+    }
+  }
+  delete [] old_slots;
+}
+
+//--------------------------------------------------------------------------------------//
+//                                      page_arena                                      //
+//--------------------------------------------------------------------------------------//
+
+const std::size_t buffer_manager::default_max_write_batch;
+const std::size_t buffer_manager::default_max_pending_writes;
+const unsigned    buffer_manager::default_async_queue_depth;
+const unsigned    buffer_manager::default_max_priority_percent;
+const unsigned    buffer_manager::priority_levels;
+const std::size_t buffer_manager::auto_size_interval;
+const std::size_t buffer_manager::default_auto_size_min;
+const unsigned    buffer_manager::default_target_hit_percent;
+const unsigned    buffer_manager::low_memory_percent;
+const std::size_t buffer_pool::default_max_bytes;
+
+namespace detail
+{
+  const std::size_t page_arena::page_alignment;
+
+//----------------------------------- frame_size() -------------------------------------//
+
+  void page_arena::frame_size(std::size_t sz)
+  {
+    BOOST_ASSERT(sz);
+    BOOST_ASSERT(!m_frames_allocated);
+    std::size_t alignment = page_alignment;
+    while (alignment / 2 >= sz && alignment > sizeof(void*))
+      alignment /= 2;
+    m_frame_size = sz;
+    m_stride = (sz + alignment - 1) & ~(alignment - 1);
+    m_chunk_size = m_stride > min_chunk_size ? m_stride : min_chunk_size;
+    m_next = m_last = 0;
+  }
+
+//------------------------------------- allocate() -------------------------------------//
+
+  char* page_arena::allocate()
+  {
+    BOOST_ASSERT(m_stride);
+    if (m_next == m_last)
+    {
+      chunk_info chunk;
+      chunk.size = m_chunk_size;
+      chunk.kind = heap_chunk;
+      m_chunks.reserve(m_chunks.size() + 1);
+      if (m_huge)
+      {
+        chunk.size = (chunk.size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        chunk.address = allocate_huge(chunk.size, chunk.kind);
+      }
+      else
+        chunk.address = static_cast<char*>(allocate_aligned(chunk.size, page_alignment));
+      m_chunks.push_back(chunk);
+      // frames in a chunk are m_stride apart, so only whole strides are used
+      m_next = chunk.address;
+      m_last = m_next + chunk.size / m_stride * m_stride;
+      if (m_chunk_size < (m_huge ? max_huge_chunk_size : max_chunk_size))
+        m_chunk_size *= 2;  // geometric growth keeps the chunk count small
+    }
+    char* frame = m_next;
+    m_next += m_stride;
+    ++m_frames_allocated;
+    return frame;
+  }
+
+//---------------------------------- huge_page_bytes() ---------------------------------//
+
+  std::size_t page_arena::huge_page_bytes() const
+  {
+    std::size_t n = 0;
+    for (std::vector<chunk_info>::const_iterator it = m_chunks.begin();
+      it != m_chunks.end(); ++it)
+      if (it->kind != heap_chunk)
+        n += it->size;
+    return n;
+  }
+
+//--------------------------------------- clear() --------------------------------------//
+
+  void page_arena::clear()
+  {
+    for (std::vector<chunk_info>::iterator it = m_chunks.begin();
+      it != m_chunks.end(); ++it)
+    {
+#     ifndef BOOST_WINDOWS_API
+      if (it->kind != heap_chunk)
+      {
+        ::munmap(it->address, it->size);
+        continue;
+      }
+#     endif
+      free_aligned(it->address);
+    }
+    m_chunks.clear();
+    m_next = m_last = 0;
+    m_frames_allocated = 0;
+    if (m_stride)
+      m_chunk_size = m_stride > min_chunk_size ? m_stride : min_chunk_size;
+  }
+
+//---------------------------------- transfer_chunks() ---------------------------------//
+
+  void page_arena::transfer_chunks(page_arena& to)
+  {
+    to.m_chunks.insert(to.m_chunks.end(), m_chunks.begin(), m_chunks.end());
+    m_chunks.clear();
+    clear();
+  }
+
+//--------------------------------------------------------------------------------------//
+//                                     frame_keeper                                     //
+//--------------------------------------------------------------------------------------//
+
+  frame_keeper::~frame_keeper()
+  {
+    BOOST_ASSERT(m_orphans == 0);
+    for (std::vector<page_arena*>::iterator it = m_arenas.begin();
+      it != m_arenas.end(); ++it)
+      delete *it;
+    if (m_map)
+    {
+#   ifdef BOOST_WINDOWS_API
+      ::UnmapViewOfFile(m_map);
+#   else
+      ::munmap(m_map, m_map_size);
+#   endif
+    }
+  }
+}  // namespace detail
+
+//--------------------------------------------------------------------------------------//
+//                                  write_back_queue                                    //
+//--------------------------------------------------------------------------------------//
+
+//  The foreground copies each dirty buffer into a staging frame and queues it; the
+//  background thread writes the queued copies in order. A job stays at the front of
+//  the queue until its write completes, so a buffer_id with a queued job always has
+//  its most recent contents available in the queue.
+
+namespace detail
+{
+  class write_back_queue
+  {
+  public:
+    write_back_queue(binary_file& f, std::size_t data_sz, std::size_t max_pending)
+      : m_file(f), m_data_size(data_sz), m_max_pending(max_pending ? max_pending : 1),
+        m_stop(false), m_written(0)
+    {
+      m_frames.frame_size(data_sz);
+      m_thread = boost::thread(boost::bind(&write_back_queue::run, this));
+    }
+
+    ~write_back_queue()
+    {
+      {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_stop = true;
+      }
+      m_work.notify_one();
+      m_thread.join();  // run() only returns once the queue is empty
+    }
+
+    void stage(buffer::buffer_id_type id, binary_file::offset_type offset,
+      const char* data)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (m_jobs.size() >= m_max_pending)  // backpressure
+        m_done.wait(lock);
+      m_throw_if_error();
+      job j;
+      j.id = id;
+      j.offset = offset;
+      if (m_free_frames.empty())
+        j.frame = m_frames.allocate();
+      else
+      {
+        j.frame = m_free_frames.back();
+        m_free_frames.pop_back();
+      }
+      std::memcpy(j.frame, data, m_data_size);
+      m_jobs.push_back(j);
+      ++m_pending[id];
+      lock.unlock();
+      m_work.notify_one();
+    }
+
+    bool copy_pending(buffer::buffer_id_type id, char* target)
+    //  Effects: If a write of id is queued, copies its most recent contents to target
+    //  Returns: true if copied
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      if (m_pending.find(id) == m_pending.end())
+        return false;
+      for (std::deque<job>::reverse_iterator it = m_jobs.rbegin();; ++it)
+      {
+        BOOST_ASSERT(it != m_jobs.rend());
+        if (it->id == id)
+        {
+          std::memcpy(target, it->frame, m_data_size);
+          return true;
+        }
+      }
+    }
+
+    void wait_for(buffer::buffer_id_type id)
+    //  Effects: Waits until no write of id is queued
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (m_pending.find(id) != m_pending.end())
+        m_done.wait(lock);
+      m_throw_if_error();
+    }
+
+    void drain()
+    //  Effects: Waits until all queued writes are complete
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      while (!m_jobs.empty())
+        m_done.wait(lock);
+      m_throw_if_error();
+    }
+
+    boost::uint64_t written()
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      return m_written;
+    }
+
+    void clear_written()
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_written = 0;
+    }
+
+  private:
+    struct job
+    {
+      buffer::buffer_id_type     id;
+      binary_file::offset_type   offset;
+      char*                      frame;
+    };
+
+    binary_file&                m_file;
+    std::size_t                 m_data_size;
+    std::size_t                 m_max_pending;
+    boost::mutex                m_mutex;
+    boost::condition_variable   m_work;      // jobs queued or stop requested
+    boost::condition_variable   m_done;      // a job has completed
+    std::deque<job>             m_jobs;      // front is being, or is next to be, written
+    boost::unordered_map<buffer::buffer_id_type, std::size_t>
+                                m_pending;   // number of queued jobs for each id
+    page_arena                  m_frames;
+    std::vector<char*>          m_free_frames;
+    bool                        m_stop;
+    system::error_code          m_error;     // first background write error
+    boost::uint64_t             m_written;
+    boost::thread               m_thread;
+
+    void m_throw_if_error()  // Requires: m_mutex locked
+    {
+      if (m_error)
+      {
+        system::error_code ec(m_error);
+        m_error.clear();
+        BOOST_BTREE_THROW(filesystem::filesystem_error(
+          "buffer_manager write-back", m_file.path(), ec));
+      }
+    }
+
+    void run()
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      for (;;)
+      {
+        while (m_jobs.empty() && !m_stop)
+          m_work.wait(lock);
+        if (m_jobs.empty())
+          return;
+        job j = m_jobs.front();
+        lock.unlock();
+        system::error_code ec;
+        m_file.write_at(j.offset, j.frame, m_data_size, ec);
+        lock.lock();
+        if (ec && !m_error)
+          m_error = ec;
+        m_jobs.pop_front();
+        if (--m_pending[j.id] == 0)
+          m_pending.erase(j.id);
+        m_free_frames.push_back(j.frame);
+        ++m_written;
+        m_done.notify_all();
+      }
+    }
+  };
+}  // namespace detail
+
+//--------------------------------------------------------------------------------------//
+//                                    memory_status                                     //
+//--------------------------------------------------------------------------------------//
+
+BOOST_BTREE_DECL
+bool memory_status(boost::uint64_t& available, boost::uint64_t& limit)
+{
+  available = limit = 0;
+# if defined(__linux__)
+  boost::uint64_t kb;
+  if (!read_field("/proc/meminfo", "MemTotal:", kb))
+    return false;
+  limit = kb * 1024;
+  if (read_field("/proc/meminfo", "MemAvailable:", kb)  // since Linux 3.14
+    || read_field("/proc/meminfo", "MemFree:", kb))
+    available = kb * 1024;
+
+  //  A container's limit is that of its cgroup, v2 or else v1; the root of the
+  //  cgroup file system is the container's own group. Usage includes page cache that
+  //  is easily reclaimed, so inactive file pages are not counted as in use.
+  boost::uint64_t cg_limit, cg_usage, inactive = 0;
+  bool v2 = read_number("/sys/fs/cgroup/memory.max", cg_limit)
+    && read_number("/sys/fs/cgroup/memory.current", cg_usage);
+  if (v2)
+    read_field("/sys/fs/cgroup/memory.stat", "inactive_file", inactive);
+  else if (read_number("/sys/fs/cgroup/memory/memory.limit_in_bytes", cg_limit)
+    && read_number("/sys/fs/cgroup/memory/memory.usage_in_bytes", cg_usage))
+    read_field("/sys/fs/cgroup/memory/memory.stat", "total_inactive_file", inactive);
+  else
+    cg_limit = limit;  // no cgroup limit; v1 reports none as a huge number
+
+  if (cg_limit < limit)
+  {
+    limit = cg_limit;
+    cg_usage = cg_usage > inactive ? cg_usage - inactive : 0;
+    boost::uint64_t cg_available = cg_limit > cg_usage ? cg_limit - cg_usage : 0;
+    if (cg_available < available)
+      available = cg_available;
+  }
+  if (available > limit)
+    available = limit;
+  return true;
+# elif defined(BOOST_WINDOWS_API)
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (!::GlobalMemoryStatusEx(&status))
+    return false;
+  available = status.ullAvailPhys;
+  limit = status.ullTotalPhys;
+  return true;
+# else
+  return false;
+# endif
+}
+
+//--------------------------------------------------------------------------------------//
+//                                     buffer_pool                                      //
+//--------------------------------------------------------------------------------------//
+
+buffer_pool::~buffer_pool()
+{
+  BOOST_ASSERT_MSG(m_managers == 0, "buffer_pool destroyed while managers attached");
+  for (arena_map::iterator it = m_arenas.begin(); it != m_arenas.end(); ++it)
+  {
+    if (m_keeper && m_keeper->orphans())
+      m_keeper->adopt(it->second);  // orphaned buffers still point into it
+    else
+      delete it->second;
+  }
+  if (m_keeper)
+    m_keeper->abandon();
+}
+
+//-------------------------------------- global() --------------------------------------//
+
+buffer_pool& buffer_pool::global()
+{
+  static buffer_pool pool;
+  return pool;
+}
+
+//------------------------------ frames_allocated(), etc. ------------------------------//
+
+std::size_t buffer_pool::frames_allocated() const
+{
+  std::size_t n = 0;
+  for (arena_map::const_iterator it = m_arenas.begin(); it != m_arenas.end(); ++it)
+    n += it->second->frames_allocated();
+  return n;
+}
+
+std::size_t buffer_pool::frames_free() const
+{
+  std::size_t n = 0;
+  for (free_frame_map::const_iterator it = m_free_frames.begin();
+    it != m_free_frames.end(); ++it)
+    n += it->second.size();
+  return n;
+}
+
+//--------------------------------- m_allocate_frame() ---------------------------------//
+
+char* buffer_pool::m_allocate_frame(std::size_t sz)
+{
+  std::vector<char*>& free_frames = m_free_frames[sz];
+  if (!free_frames.empty())
+  {
+    char* frame = free_frames.back();
+    free_frames.pop_back();
+    return frame;
+  }
+  detail::page_arena*& arena = m_arenas[sz];
+  if (!arena)
+  {
+    arena = new detail::page_arena;
+    arena->frame_size(sz);
+  }
+  return arena->allocate();
+}
+
+//--------------------------------------------------------------------------------------//
+//                                    buffer_manager                                    //
+//--------------------------------------------------------------------------------------//
+
 //------------------------------------ close() -----------------------------------------//
 
 void buffer_manager::close()
 {
   BOOST_ASSERT(is_open());
 
+  stop_write_back();
+
+  if (m_pool)
+    m_pool_unlink_all();
   available_buffers.clear();
+  cold_buffers.clear();
+  ghost_buffers.clear();
+  m_clear_priority_buffers();
+  while (!spare_buffers.empty())
+  {
+    buffer* buf = &*spare_buffers.begin();
+    spare_buffers.pop_front();
+    if (m_pool && buf->m_data && !m_map)
+      m_pool->m_free_frame(data_size(), buf->m_data);
+    delete buf;
+  }
 
   // clear buffers, deleting those with use_count() == 0
-  for (buffers_type::iterator itr = buffers.begin(); itr != buffers.end();)
+  detail::frame_keeper* keeper = 0;
+  for (buffers_type::iterator itr = buffers.begin(); itr != buffers.end(); ++itr)
   {
-    if (itr->needs_write())
+    buffer* buf = &*itr;
+    if (buf->needs_write())
     {
-      write(*itr);
-      itr->needs_write(false);
+      write(*buf);
+      buf->needs_write(false);
     }
-    buffers_type::iterator cur = itr++;
-    buffer* buf = &*cur;
-    buffers.erase(cur);
     if (buf->use_count() == 0)
     {
+      if (m_pool && !m_map)
+        m_pool->m_free_frame(data_size(), buf->m_data);
       //std::cout << "   deleting buffer " << buf->buffer_id() << " at " << buf << std::endl;
       delete buf;
     }
     else
-      cur->manager(0);  // mark buffer as orphaned; it has outlived its manager
+    {
+      // mark buffer as orphaned; it has outlived its manager, but iterators may
+      // still point into its frame, so the frame's memory is kept until it is deleted
+      if (!keeper)
+      {
+        if (m_pool && !m_map)
+        {
+          if (!m_pool->m_keeper)
+            m_pool->m_keeper = new detail::frame_keeper;
+          keeper = m_pool->m_keeper;
+        }
+        else
+          keeper = new detail::frame_keeper;
+      }
+      keeper->hold();
+      buf->m_keeper = keeper;
+      buf->manager(0);
+    }
   }
+  buffers.clear();  // table holds only pointers, so clearing after the deletes is safe
+  stop_async_io();  // unregisters m_frames
+  if (keeper && (!m_pool || m_map))
+  {
+    if (m_map)
+    {
+      keeper->adopt_map(m_map, m_map_size);
+      m_map = 0;  // so m_unmap_file() leaves the view to keeper
+    }
+    else
+    {
+      detail::page_arena* arena = new detail::page_arena;
+      m_frames.transfer_chunks(*arena);
+      keeper->adopt(arena);
+    }
+    keeper->abandon();
+  }
+  m_frames.clear();
+  m_unmap_file();
   BOOST_ASSERT(buffers.empty());
   BOOST_ASSERT(available_buffers.empty());
+  BOOST_ASSERT(m_pool_available == 0);
   //std::cout << " all buffers deleted" << std::endl;
   binary_file::close();
+  pool(0);
   m_buffer_count = 0;
   m_data_size = 0;
 }
@@ -61,12 +760,160 @@ buffer_manager::~buffer_manager()
   {
     close();
   }
+  pool(0);
+}
+
+//-------------------------------- start_write_back() ----------------------------------//
+
+void buffer_manager::start_write_back(std::size_t max_pending)
+{
+  BOOST_ASSERT(is_open());
+  BOOST_ASSERT(data_size());
+  BOOST_ASSERT(!write_back());
+  m_write_back = new detail::write_back_queue(*this, data_size(), max_pending);
+}
+
+//-------------------------------- stop_write_back() -----------------------------------//
+
+void buffer_manager::stop_write_back()
+{
+  if (!m_write_back)
+    return;
+  detail::write_back_queue* q = m_write_back;
+  m_write_back = 0;
+  try { q->drain(); }
+  catch (...)
+  {
+    m_file_buffers_written += q->written();
+    delete q;
+    throw;
+  }
+  m_file_buffers_written += q->written();
+  delete q;
+}
+
+//--------------------------------- start_async_io() -----------------------------------//
+
+void buffer_manager::start_async_io(unsigned queue_depth)
+{
+  BOOST_ASSERT(is_open());
+  BOOST_ASSERT(!async_io());
+  io_ring* ring = new io_ring;
+  try { ring->open(*this, queue_depth); }
+  catch (...) { delete ring; throw; }
+  m_ring = ring;
+  m_registered_chunks = 0;
+}
+
+//---------------------------------- stop_async_io() -----------------------------------//
+
+void buffer_manager::stop_async_io()
+{
+  delete m_ring;  // closes the ring, waiting for anything in flight
+  m_ring = 0;
+  m_registered_chunks = 0;
+}
+
+//------------------------------------ map_file() --------------------------------------//
+
+bool buffer_manager::map_file()
+{
+  BOOST_ASSERT(is_open());
+  BOOST_ASSERT(data_size());
+  BOOST_ASSERT(!mapped());
+  BOOST_ASSERT(buffers.empty());
+  BOOST_ASSERT(spare_buffers.empty());
+
+  boost::uint64_t sz = static_cast<boost::uint64_t>(buffer_count()) * data_size();
+  if (sz == 0 || sz != static_cast<std::size_t>(sz))  // empty, or too large to map
+    return false;
+
+# ifdef BOOST_WINDOWS_API
+  m_map_handle = ::CreateFileMappingW(handle(), 0, PAGE_READONLY, 0, 0, 0);
+  if (!m_map_handle)
+    return false;
+  void* p = ::MapViewOfFile(m_map_handle, FILE_MAP_READ, 0, 0, 0);
+  if (!p)
+  {
+    ::CloseHandle(m_map_handle);
+    m_map_handle = 0;
+    return false;
+  }
+# else
+  void* p = ::mmap(0, static_cast<std::size_t>(sz), PROT_READ, MAP_SHARED, handle(), 0);
+  if (p == MAP_FAILED)
+    return false;
+# endif
+  m_map = static_cast<char*>(p);
+  m_map_size = static_cast<std::size_t>(sz);
+  return true;
+}
+
+//---------------------------------- m_unmap_file() ------------------------------------//
+
+void buffer_manager::m_unmap_file()
+{
+# ifdef BOOST_WINDOWS_API
+  if (m_map)
+    ::UnmapViewOfFile(m_map);
+  if (m_map_handle)
+  {
+    ::CloseHandle(m_map_handle);
+    m_map_handle = 0;
+  }
+# else
+  if (m_map)
+    ::munmap(m_map, m_map_size);
+# endif
+  m_map = 0;
+  m_map_size = 0;
+}
+
+//-------------------------------- m_written_behind() ----------------------------------//
+
+boost::uint64_t buffer_manager::m_written_behind() const
+{
+  return m_write_back ? m_write_back->written() : 0;
+}
+
+void buffer_manager::m_clear_written_behind() const
+{
+  if (m_write_back)
+    m_write_back->clear_written();
+}
+
+//--------------------------------- m_write_behind() -----------------------------------//
+
+void buffer_manager::m_write_behind()
+{
+  //  keep the next few eviction candidates clean; with the default policy that is
+  //  the least recently used end of available_buffers
+  std::size_t n = max_cache_size() / 8;
+  if (n < 1)
+    n = 1;
+  else if (n > 16)
+    n = 16;
+  m_write_behind(cold_buffers, n);
+  m_write_behind(available_buffers, n);
+}
+
+void buffer_manager::m_write_behind(avail_buffers_type& list, std::size_t n)
+{
+  for (avail_buffers_type::iterator it = list.begin(); n && it != list.end(); ++it, --n)
+  {
+    if (it->needs_write())
+    {
+      m_write_back->stage(it->buffer_id(),
+        static_cast<offset_type>(it->buffer_id()) * data_size(), it->data());
+      it->needs_write(false);
+    }
+  }
 }
  
 //------------------------------------- open() -----------------------------------------//
 
 bool buffer_manager::open(const boost::filesystem::path& p, oflag::bitmask flags,
-  std::size_t max_cache_pgs, data_size_type data_sz)
+  std::size_t max_cache_pgs, data_size_type data_sz, replacement::policy rp)
 //  Returns: true if existing non-trucated file.
 //  NOTE: IF true IS RETURNED, IT IS REQUIRED THAT data_size() BE CALLED WITH
 //  AN ARGUMENT OF THE ACTUAL DATA SIZE BEFORE ANY BUFFER RELATED OPERATIONS ARE
@@ -76,10 +923,13 @@ bool buffer_manager::open(const boost::filesystem::path& p, oflag::bitmask flags
   BOOST_ASSERT(data_sz);
   BOOST_ASSERT(buffers.empty());
   BOOST_ASSERT(available_buffers.empty());
+  BOOST_ASSERT(cold_buffers.empty());
 
   m_buffer_count = 0;
   m_data_size = data_sz;
   m_max_cache_size = max_cache_pgs;
+  m_policy = rp;
+  m_cold_target = 1;
 
   clear_statistics();
 
@@ -90,8 +940,16 @@ bool buffer_manager::open(const boost::filesystem::path& p, oflag::bitmask flags
 
   if (boost::filesystem::exists(p) && !(flags & oflag::truncate)) // existing file
     m_data_size = 0;  // as yet unknown
+  else
+    m_frames.frame_size(m_data_size);
 
   binary_file::open(p, flags);
+  if (m_data_size && direct() && m_data_size % direct_alignment)
+  {
+    binary_file::close();
+    BOOST_BUFFER_FILE_THROW(buffer_manager_error(
+      "buffer_manager_error: direct I/O requires data size multiple of 4096: ", p));
+  }
   return m_data_size == 0;
 }
 
@@ -101,7 +959,12 @@ void buffer_manager::data_size(data_size_type sz)
 {
   BOOST_ASSERT(sz);
   BOOST_ASSERT(!data_size());
+  if (direct() && sz % direct_alignment)
+    BOOST_BUFFER_FILE_THROW(buffer_manager_error(
+      "buffer_manager_error: direct I/O requires data size multiple of 4096: ",
+      binary_file::path()));
   m_data_size = sz;
+  m_frames.frame_size(sz);
   offset_type file_size = binary_file::seek(0, seekdir::end);
   m_buffer_count = static_cast<buffer_count_type>(file_size / sz);
   if (m_buffer_count * sz != file_size)
@@ -110,29 +973,82 @@ void buffer_manager::data_size(data_size_type sz)
       binary_file::path()));
 }
 
+//---------------------------------- read_header() -------------------------------------//
+
+bool buffer_manager::read_header(void* target, std::size_t sz)
+{
+  BOOST_ASSERT(is_open());
+  if (!direct())
+    return binary_file::read_at(0, target, sz);
+
+  std::size_t block_sz = (sz + direct_alignment - 1) & ~(direct_alignment - 1);
+  void* block = allocate_aligned(block_sz, direct_alignment);
+  bool result;
+  try { result = binary_file::read_at(0, block, block_sz); }
+  catch (...) { free_aligned(block); throw; }
+  if (result)
+    std::memcpy(target, block, sz);
+  free_aligned(block);
+  return result;
+}
+
+//---------------------------------- write_header() ------------------------------------//
+
+void buffer_manager::write_header(const void* source, std::size_t sz)
+{
+  BOOST_ASSERT(is_open());
+  if (!direct())
+  {
+    binary_file::write_at(0, source, sz);
+    return;
+  }
+
+  std::size_t block_sz = (sz + direct_alignment - 1) & ~(direct_alignment - 1);
+  void* block = allocate_aligned(block_sz, direct_alignment);
+  std::memcpy(block, source, sz);
+  std::memset(static_cast<char*>(block) + sz, 0, block_sz - sz);
+  try { binary_file::write_at(0, block, block_sz); }
+  catch (...) { free_aligned(block); throw; }
+  free_aligned(block);
+}
+
 //------------------------------- m_prepare_buffer() -----------------------------------//
 
 buffer* buffer_manager::m_prepare_buffer(buffer_id_type pg_id)
 {
   buffer* pg;
 
-  if (available_buffers.empty()
-    || available_buffers.size() < max_cache_size())
+  if (m_pool)
+    m_pool_make_room(data_size());
+
+  if (m_pool
+    || buffers_available() == 0
+    || buffers_available() < max_cache_size())
   {
-    // allocate a new buffer
-    pg = m_alloc(pg_id, *this);
-    //std::cout << " allocated buffer " << reinterpret_cast<void*>(pg)
-    //  << " buffer.data() at " << reinterpret_cast<void*>(pg->data())
-    //   << std::endl;
-    ++m_buffer_allocs;
+    if (!spare_buffers.empty())
+    {
+      // recycle a buffer previously evicted by m_release() or m_pool_evict()
+      pg = &*spare_buffers.begin();
+      if (!pg->m_data)
+        pg->m_data = m_new_frame();  // the pool took its frame
+      spare_buffers.pop_front();
+      pg->reuse(pg_id);
+    }
+    else
+    {
+      // allocate a new buffer
+      pg = m_alloc(pg_id, *this);
+      //std::cout << " allocated buffer " << reinterpret_cast<void*>(pg)
+      //  << " buffer.data() at " << reinterpret_cast<void*>(pg->data())
+      //   << std::endl;
+      ++m_buffer_allocs;
+    }
   }
   else
   {
     // reuse an existing buffer
-    BOOST_ASSERT(!available_buffers.empty());
-    pg = &*available_buffers.begin();
-    available_buffers.pop_front();
-    buffers.erase(buffers.iterator_to(*pg));
+    pg = m_victim();
+    buffers.erase(*pg);
     if (pg->needs_write())
     {
       write(*pg);
@@ -140,9 +1056,389 @@ buffer* buffer_manager::m_prepare_buffer(buffer_id_type pg_id)
     }
     pg->reuse(pg_id);
   }
+  if (m_map)
+    pg->m_data = m_map + static_cast<std::size_t>(pg_id) * data_size();
   buffers.insert(*pg);
+  m_loaded(*pg);
   return pg;
 }
+
+//------------------------------------ m_new_frame() -----------------------------------//
+
+char* buffer_manager::m_new_frame()
+{
+  if (m_map)
+    return 0;
+  return m_pool ? m_pool->m_allocate_frame(data_size()) : m_frames.allocate();
+}
+
+//------------------------------------ m_cache_room() ----------------------------------//
+
+std::size_t buffer_manager::m_cache_room() const
+{
+  if (m_pool)
+    return m_pool->available_bytes() < m_pool->max_bytes()
+      ? (m_pool->max_bytes() - m_pool->available_bytes()) / data_size() : 0;
+  return buffers_available() < max_cache_size()
+    ? max_cache_size() - buffers_available() : 0;
+}
+
+//------------------------------------ m_release() -------------------------------------//
+
+void buffer_manager::m_release(buffer& buf)
+{
+  BOOST_ASSERT(buf.use_count() == 0);
+  BOOST_ASSERT(!buf.never_free());
+
+  if (m_pool)
+    m_pool_make_room(data_size());
+  else if (buffers_available() && buffers_available() >= max_cache_size())
+  {
+    // release a buffer
+    buffer* victim = m_victim();
+    buffers.erase(*victim);
+    if (victim->needs_write())
+    {
+      write(*victim);
+      victim->m_needs_write = false;
+    }
+    spare_buffers.push_back(*victim);  // keep the descriptor and frame for reuse
+  }
+  m_link(buf);
+  if (m_write_back)
+    m_write_behind();
+}
+
+//--------------------------------- m_link(), m_unlink() -------------------------------//
+
+//  Buffers marked hot live on available_buffers, others on cold_buffers. For LRU, all
+//  buffers are on available_buffers since the hot bit is never set. Buffers given a
+//  priority live on priority_buffers instead. When attached to a pool, all buffers are
+//  on the pool's list.
+
+void buffer_manager::m_link(buffer& buf)
+{
+  buf.m_priority = m_priority_fn && !m_pool
+    ? static_cast<unsigned char>((std::min)(m_priority_fn(buf), priority_levels)) : 0;
+  if (m_pool)
+  {
+    m_pool->m_available.push_back(buf);
+    m_pool->m_available_bytes += data_size();
+    ++m_pool_available;
+  }
+  else if (buf.m_priority)
+  {
+    priority_buffers[buf.m_priority - 1].push_back(buf);
+    ++m_priority_available;
+  }
+  else if (buf.m_cache_state & buffer::cache_hot || m_policy == replacement::lru)
+    available_buffers.push_back(buf);
+  else
+    cold_buffers.push_back(buf);
+}
+
+void buffer_manager::m_unlink(buffer& buf)
+{
+  if (m_pool)
+  {
+    m_pool->m_available.erase(m_pool->m_available.iterator_to(buf));
+    m_pool->m_available_bytes -= data_size();
+    --m_pool_available;
+  }
+  else if (buf.m_priority)
+  {
+    avail_buffers_type& list = priority_buffers[buf.m_priority - 1];
+    list.erase(list.iterator_to(buf));
+    --m_priority_available;
+  }
+  else if (buf.m_cache_state & buffer::cache_hot || m_policy == replacement::lru)
+    available_buffers.erase(available_buffers.iterator_to(buf));
+  else
+    cold_buffers.erase(cold_buffers.iterator_to(buf));
+}
+
+//------------------------------------- m_loaded() -------------------------------------//
+
+void buffer_manager::m_loaded(buffer& buf)
+{
+  buf.m_cache_state = 0;
+  if (m_policy == replacement::lru || m_pool)
+    return;
+
+  if (ghost_buffers.erase(buf.buffer_id()))
+  {
+    // re-referenced soon after eviction from the cold list, so part of the working set
+    buf.m_cache_state = buffer::cache_hot;
+    if (m_policy == replacement::clock_pro && m_cold_target < m_available_max())
+      ++m_cold_target;
+  }
+  else if (m_policy == replacement::clock_pro)
+    buf.m_cache_state = buffer::cache_test;
+}
+
+//----------------------------------- m_referenced() -----------------------------------//
+
+void buffer_manager::m_referenced(buffer& buf)
+{
+  if (m_policy == replacement::two_queue)
+    buf.m_cache_state = buffer::cache_hot;  // promote from A1in to Am
+  else if (m_policy == replacement::clock_pro)
+    buf.m_cache_state |= buffer::cache_referenced;
+}
+
+//----------------------------------- m_demote_hot() -----------------------------------//
+
+void buffer_manager::m_demote_hot()
+{
+  // CLOCK-Pro hot hand: referenced hot buffers get another revolution, the first
+  // unreferenced hot buffer becomes cold
+  BOOST_ASSERT(m_policy == replacement::clock_pro);
+  while (!available_buffers.empty())
+  {
+    buffer* buf = &*available_buffers.begin();
+    available_buffers.pop_front();
+    if (buf->m_cache_state & buffer::cache_referenced)
+    {
+      buf->m_cache_state &= ~buffer::cache_referenced;
+      available_buffers.push_back(*buf);
+    }
+    else
+    {
+      buf->m_cache_state = 0;
+      cold_buffers.push_back(*buf);
+      return;
+    }
+  }
+}
+
+//------------------------------ auto_size(), m_auto_adjust() -------------------------//
+
+void buffer_manager::auto_size(std::size_t min_sz, std::size_t max_sz,
+  unsigned target_hit_percent)
+{
+  BOOST_ASSERT(min_sz <= max_sz);
+  m_auto_size = true;
+  m_auto_min = min_sz;
+  m_auto_max = max_sz;
+  m_auto_target = target_hit_percent;
+  m_auto_reads = 0;
+  m_auto_hits = cached_buffers_read();
+  m_auto_misses = file_buffers_read();
+}
+
+void buffer_manager::m_auto_adjust()
+{
+  m_auto_reads = 0;
+  boost::uint64_t hits = cached_buffers_read() - m_auto_hits;
+  boost::uint64_t misses = file_buffers_read() - m_auto_misses;
+  m_auto_hits = cached_buffers_read();
+  m_auto_misses = file_buffers_read();
+  if (m_pool)
+    return;
+
+  std::size_t sz = max_cache_size();
+  boost::uint64_t available, limit;
+  if (memory_status(available, limit) && available < limit / 100 * low_memory_percent)
+    sz -= sz / 4;  // back off before the system has to reclaim memory by force
+  else if (hits * 100 < (hits + misses) * m_auto_target)
+  {
+    std::size_t step = sz / 4 > 16 ? sz / 4 : 16;
+    std::size_t ceiling = (std::min)(m_auto_max,
+      static_cast<std::size_t>(buffer_count()));
+    if (sz < ceiling)
+      sz = ceiling - sz > step ? sz + step : ceiling;
+  }
+  else if (misses * 200 < (hits + misses) * (100 - m_auto_target))
+  {
+    std::size_t step = sz / 16 ? sz / 16 : 1;
+    sz -= sz > step ? step : sz;
+  }
+  if (sz < m_auto_min)
+    sz = m_auto_min;
+  else if (sz > m_auto_max)
+    sz = m_auto_max;
+
+  if (sz > max_cache_size())
+    ++m_cache_grows;
+  else if (sz < max_cache_size())
+    ++m_cache_shrinks;
+  max_cache_size(sz);
+  m_trim();
+}
+
+//--------------------------------------- m_trim() -------------------------------------//
+
+void buffer_manager::m_trim()
+{
+  while (buffers_available() > max_cache_size())
+  {
+    buffer* victim = m_victim();
+    buffers.erase(*victim);
+    if (victim->needs_write())
+    {
+      write(*victim);
+      victim->m_needs_write = false;
+    }
+#   if !defined(BOOST_WINDOWS_API) && defined(MADV_DONTNEED)
+    //  Give whole pages of the frame back to the operating system; they read as zero
+    //  when next touched. Not for frames registered with an io_ring, since the ring
+    //  would go on using the discarded pages, nor for frames from huge pages, where
+    //  discarding part of a huge page splits it or, for hugetlb pages, frees it whole.
+    if (!m_map && !m_registered_chunks && !huge_pages()
+      && data_size() >= detail::page_arena::page_alignment)
+      ::madvise(victim->m_data,
+        data_size() / detail::page_arena::page_alignment
+          * detail::page_arena::page_alignment, MADV_DONTNEED);
+#   endif
+    spare_buffers.push_back(*victim);
+  }
+}
+
+//---------------------------------- m_priority_victim() -------------------------------//
+
+buffer* buffer_manager::m_priority_victim()
+{
+  BOOST_ASSERT(m_priority_available);
+  unsigned p = 0;
+  while (priority_buffers[p].empty())
+    ++p;
+  buffer* buf = &*priority_buffers[p].begin();
+  priority_buffers[p].pop_front();
+  buf->m_priority = 0;
+  --m_priority_available;
+  return buf;
+}
+
+void buffer_manager::m_clear_priority_buffers()
+{
+  for (unsigned p = 0; p != priority_levels; ++p)
+    priority_buffers[p].clear();
+  m_priority_available = 0;
+}
+
+//--------------------------------- pool(), m_pool_*() --------------------------------//
+
+void buffer_manager::pool(buffer_pool* p)
+{
+  BOOST_ASSERT(!is_open());
+  if (m_pool)
+    --m_pool->m_managers;
+  m_pool = p;
+  if (m_pool)
+    ++m_pool->m_managers;
+}
+
+void buffer_manager::m_pool_make_room(std::size_t sz)
+{
+  //  the least recently used buffer may belong to any attached manager
+  while (!m_pool->m_available.empty()
+    && m_pool->m_available_bytes + sz > m_pool->m_max_bytes)
+  {
+    buffer* victim = &*m_pool->m_available.begin();
+    buffer_manager* owner = victim->manager();
+    owner->m_unlink(*victim);
+    owner->m_pool_evict(*victim);
+    ++m_pool->m_evictions;
+  }
+}
+
+void buffer_manager::m_pool_evict(buffer& buf)
+{
+  buffers.erase(buf);
+  if (buf.needs_write())
+  {
+    write(buf);
+    buf.m_needs_write = false;
+  }
+  if (!m_map)
+    m_pool->m_free_frame(data_size(), buf.m_data);
+  buf.m_data = 0;
+  spare_buffers.push_back(buf);  // keep only the descriptor for reuse
+}
+
+void buffer_manager::m_pool_unlink_all()
+{
+  for (buffers_type::iterator it = buffers.begin(); it != buffers.end(); ++it)
+    if (it->use_count() == 0 && !it->never_free())
+      m_unlink(*it);
+  BOOST_ASSERT(m_pool_available == 0);
+}
+
+//------------------------------------- m_victim() -------------------------------------//
+
+buffer* buffer_manager::m_victim()
+{
+  BOOST_ASSERT(buffers_available());
+  buffer* buf;
+
+  //  prioritized buffers are kept in preference to others, but only up to their share
+  if (m_priority_available
+    && (m_priority_available > m_priority_max()
+      || m_priority_available == buffers_available()))
+    return m_priority_victim();
+
+  switch (m_policy)
+  {
+  case replacement::two_queue:
+    {
+      std::size_t in_max = m_available_max() / 4 ? m_available_max() / 4 : 1;
+      if (!cold_buffers.empty()
+        && (cold_buffers.size() > in_max || available_buffers.empty()))
+      {
+        buf = &*cold_buffers.begin();
+        cold_buffers.pop_front();
+        ghost_buffers.push_back(buf->buffer_id(),
+          m_available_max() / 2 ? m_available_max() / 2 : 1);
+      }
+      else
+      {
+        buf = &*available_buffers.begin();
+        available_buffers.pop_front();
+      }
+    }
+    break;
+
+  case replacement::clock_pro:
+    for (;;)
+    {
+      if (cold_buffers.empty())
+        m_demote_hot();
+      buf = &*cold_buffers.begin();
+      cold_buffers.pop_front();
+      if (buf->m_cache_state & buffer::cache_referenced)
+      {
+        if (buf->m_cache_state & buffer::cache_test)
+        {
+          // re-referenced during its test period, so promote to hot
+          buf->m_cache_state = buffer::cache_hot;
+          available_buffers.push_back(*buf);
+          if (m_cold_target < m_available_max())
+            ++m_cold_target;
+          if (available_buffers.size() > m_available_max() - m_cold_target)
+            m_demote_hot();
+        }
+        else
+        {
+          buf->m_cache_state = buffer::cache_test;
+          cold_buffers.push_back(*buf);
+        }
+        continue;
+      }
+      if (buf->m_cache_state & buffer::cache_test
+        && ghost_buffers.push_back(buf->buffer_id(), m_available_max())
+        && m_cold_target > 1)
+        --m_cold_target;  // a test period expired without a re-reference
+      break;
+    }
+    break;
+
+  default:
+    buf = &*available_buffers.begin();
+    available_buffers.pop_front();
+  }
+
+  return buf;
+}
  
 //----------------------------------- new_buffer() -------------------------------------//
 
@@ -150,6 +1446,7 @@ buffer_ptr buffer_manager::new_buffer()
 {
   BOOST_ASSERT(is_open());
   BOOST_ASSERT(data_size());
+  BOOST_ASSERT(!mapped());  // mapping is read-only
   ++m_new_buffer_requests;
   buffer* pg = m_prepare_buffer(m_buffer_count++);
   // clear the memory; this makes troubleshooting ever so much easier
@@ -166,16 +1463,20 @@ buffer_ptr buffer_manager::read(buffer_id_type pg_id)
   BOOST_ASSERT(data_size());
   BOOST_ASSERT(pg_id < buffer_count());
 
-  buffer key(pg_id);   // TODO: move the key buffer to buffer_manager to avoid construction
+  if (m_auto_size && ++m_auto_reads == auto_size_interval)
+    m_auto_adjust();
 
-  buffers_type::iterator found = buffers.find(key);
+  buffer* found = buffers.find(pg_id);
 
-  if (found == buffers.end()) // the buffer is not in memory
+  if (!found) // the buffer is not in memory
   {
     ++m_file_buffers_read;
     buffer* pg = m_prepare_buffer(pg_id);
-    binary_file::seek(pg_id * data_size());
-    binary_file::read(pg->data(), data_size());
+    if (m_map)  // data() already points into the mapping
+      return buffer_ptr(*pg);
+    if (!m_write_back || !m_write_back->copy_pending(pg_id, pg->data()))
+      binary_file::read_at(static_cast<offset_type>(pg_id) * data_size(), pg->data(),
+        data_size());
     return buffer_ptr(*pg);
   }
   else // the buffer is in memory
@@ -184,8 +1485,9 @@ buffer_ptr buffer_manager::read(buffer_id_type pg_id)
     { 
       if (!found->never_free())  // but is in available_buffers
       {
-        // remove from available_buffers
-        available_buffers.erase(available_buffers.iterator_to(*found));
+        // remove from available_buffers or cold_buffers
+        m_unlink(*found);
+        m_referenced(*found);
         ++m_available_buffers_read;
       }
       else
@@ -197,14 +1499,277 @@ buffer_ptr buffer_manager::read(buffer_id_type pg_id)
   }
 }
  
+//------------------------------------- overwrite() ------------------------------------//
+
+buffer_ptr buffer_manager::overwrite(buffer_id_type pg_id)
+{
+  BOOST_ASSERT(is_open());
+  BOOST_ASSERT(data_size());
+  BOOST_ASSERT(!mapped());  // mapping is read-only
+  BOOST_ASSERT(pg_id < buffer_count());
+
+  buffer* found = buffers.find(pg_id);
+  if (found)
+  {
+    buffer_ptr p(read(pg_id));  // counts as a cache hit, as read() would
+    p->needs_write(true);
+    return p;
+  }
+
+  buffer* pg = m_prepare_buffer(pg_id);
+  std::memset(pg->data(), 0, data_size());
+  pg->needs_write(true);
+  return buffer_ptr(*pg);
+}
+
+//------------------------------------- truncate() -------------------------------------//
+
+void buffer_manager::truncate(buffer_count_type n)
+{
+  BOOST_ASSERT(is_open());
+  BOOST_ASSERT(!mapped());
+  BOOST_ASSERT(n <= buffer_count());
+
+  //  a queued copy written after the cut would extend the file again
+  if (m_write_back)
+    m_write_back->drain();
+
+  std::vector<buffer*> doomed;
+  for (buffers_type::iterator itr = buffers.begin(); itr != buffers.end(); ++itr)
+    if (itr->buffer_id() >= n)
+      doomed.push_back(&*itr);
+
+  for (std::vector<buffer*>::iterator it = doomed.begin(); it != doomed.end(); ++it)
+  {
+    buffer* buf = *it;
+    BOOST_ASSERT_MSG(buf->use_count() == 0, "truncate() of a buffer in use");
+    if (!buf->never_free())
+      m_unlink(*buf);
+    buffers.erase(*buf);
+    buf->m_needs_write = false;
+    buf->m_never_free = false;
+    if (m_pool)
+    {
+      m_pool->m_free_frame(data_size(), buf->m_data);
+      buf->m_data = 0;
+    }
+    spare_buffers.push_back(*buf);
+    ghost_buffers.erase(buf->buffer_id());
+  }
+
+  m_buffer_count = n;
+  binary_file::truncate(static_cast<offset_type>(n) * data_size());
+}
+
+//------------------------------------- preload() --------------------------------------//
+
+std::size_t buffer_manager::preload(const buffer_id_type* ids, std::size_t n)
+{
+  BOOST_ASSERT(is_open());
+  BOOST_ASSERT(data_size());
+
+  //  choose, in priority order, the ids that fit in the cache
+  std::size_t room = m_cache_room();
+  std::vector<buffer_id_type> wanted;
+  for (std::size_t i = 0; i != n && wanted.size() < room; ++i)
+  {
+    BOOST_ASSERT(ids[i] < buffer_count());
+    if (!buffers.find(ids[i]))
+      wanted.push_back(ids[i]);
+  }
+  std::sort(wanted.begin(), wanted.end());
+
+  std::size_t max_span = max_preload_read / data_size();
+  if (max_span == 0)
+    max_span = 1;
+  char* staging = 0;
+  std::vector<buffer*> run;
+  for (std::vector<buffer_id_type>::size_type first = 0; first != wanted.size();)
+  {
+    std::vector<buffer_id_type>::size_type last = first + 1;
+    while (last != wanted.size()
+      && wanted[last] - wanted[last-1] <= max_preload_gap + 1
+      && wanted[last] - wanted[first] < max_span)
+      ++last;
+
+    run.clear();
+    try
+    {
+      for (std::vector<buffer_id_type>::size_type i = first; i != last; ++i)
+        run.push_back(m_prepare_buffer(wanted[i]));
+
+      if (!m_map)
+      {
+        offset_type offset = static_cast<offset_type>(wanted[first]) * data_size();
+        if (last - first == 1)
+          binary_file::read_at(offset, run[0]->data(), data_size());
+        else
+        {
+          if (!staging)
+            staging = static_cast<char*>(
+              allocate_aligned(max_span * data_size(), direct_alignment));
+          std::size_t span = wanted[last-1] - wanted[first] + 1;
+          binary_file::read_at(offset, staging, span * data_size());
+          for (std::vector<buffer*>::size_type i = 0; i != run.size(); ++i)
+            std::memcpy(run[i]->data(),
+              staging + (run[i]->buffer_id() - wanted[first]) * data_size(),
+              data_size());
+        }
+        if (m_write_back)
+          for (std::vector<buffer*>::size_type i = 0; i != run.size(); ++i)
+            m_write_back->copy_pending(run[i]->buffer_id(), run[i]->data());
+      }
+    }
+    catch (...)
+    {
+      //  buffers not read must not be found by read()
+      for (std::vector<buffer*>::size_type i = 0; i != run.size(); ++i)
+      {
+        buffers.erase(*run[i]);
+        spare_buffers.push_back(*run[i]);
+      }
+      if (staging)
+        free_aligned(staging);
+      throw;
+    }
+
+    m_file_buffers_read += run.size();
+    for (std::vector<buffer*>::size_type i = 0; i != run.size(); ++i)
+      buffer_ptr(*run[i]).reset();  // use_count() becomes 0, so makes it available
+    first = last;
+  }
+  if (staging)
+    free_aligned(staging);
+  return wanted.size();
+}
+
+//--------------------------------- save_cache_state() ---------------------------------//
+
+void buffer_manager::save_cache_state(const boost::filesystem::path& p,
+  system::error_code& ec) const
+{
+  BOOST_ASSERT(is_open());
+
+  //  coldest first; buffers that are in use or never_free are not on an available
+  //  list, so are treated as the most recently used
+  std::vector<buffer_id_type> ids;
+  ids.reserve(buffers.size());
+  if (m_pool)
+    for (avail_buffers_type::const_iterator it = m_pool->m_available.begin();
+      it != m_pool->m_available.end(); ++it)
+      if (it->manager() == this)
+        ids.push_back(it->buffer_id());
+  for (avail_buffers_type::const_iterator it = cold_buffers.begin();
+    it != cold_buffers.end(); ++it)
+    ids.push_back(it->buffer_id());
+  std::size_t cold_count = ids.size();
+  for (avail_buffers_type::const_iterator it = available_buffers.begin();
+    it != available_buffers.end(); ++it)
+    ids.push_back(it->buffer_id());
+  for (unsigned p = 0; p != priority_levels; ++p)
+    for (avail_buffers_type::const_iterator it = priority_buffers[p].begin();
+      it != priority_buffers[p].end(); ++it)
+      ids.push_back(it->buffer_id());
+  for (buffers_type::const_iterator it = buffers.begin(); it != buffers.end(); ++it)
+    if (it->use_count() || it->never_free())
+      ids.push_back(it->buffer_id());
+
+  cache_state_header hdr;
+  std::memcpy(hdr.marker, cache_state_marker, sizeof(hdr.marker));
+  hdr.data_size = static_cast<boost::uint32_t>(data_size());
+  hdr.count = static_cast<boost::uint32_t>(ids.size());
+  hdr.cold_count = static_cast<boost::uint32_t>(cold_count);
+  hdr.reserved = 0;
+
+  binary_file f(p, oflag::out | oflag::truncate, ec);
+  if (ec)
+    return;
+  f.write(hdr, ec);
+  if (!ec && !ids.empty())
+    f.write(&ids[0], ids.size(), ec);
+}
+
+//------------------------------- restore_cache_state() --------------------------------//
+
+std::size_t buffer_manager::restore_cache_state(const boost::filesystem::path& p,
+  system::error_code& ec)
+{
+  BOOST_ASSERT(is_open());
+  BOOST_ASSERT(data_size());
+
+  binary_file f(p, oflag::in, ec);
+  if (ec)
+    return 0;
+  binary_file::offset_type file_sz = f.seek(0, seekdir::end, ec);
+  if (!ec)
+    f.seek(0, seekdir::begin, ec);
+  if (ec)
+    return 0;
+  cache_state_header hdr;
+  std::vector<buffer_id_type> ids;
+  bool valid = f.read(hdr, ec)
+    && std::memcmp(hdr.marker, cache_state_marker, sizeof(hdr.marker)) == 0
+    && hdr.data_size == data_size()
+    && hdr.cold_count <= hdr.count
+    //  checked before ids is sized from it, so a damaged count can't allocate more
+    //  than the file holds
+    && file_sz == static_cast<binary_file::offset_type>(sizeof(hdr))
+         + static_cast<binary_file::offset_type>(hdr.count) * sizeof(buffer_id_type);
+  if (valid && hdr.count)
+  {
+    ids.resize(hdr.count);
+    valid = f.read(&ids[0], ids.size(), ec);
+  }
+  if (ec)
+    return 0;
+  if (!valid)
+  {
+    ec = system::errc::make_error_code(system::errc::invalid_argument);
+    return 0;
+  }
+
+  //  preload() takes the most recently used first; ids that no longer exist, because
+  //  the file has shrunk, and duplicates, which only a damaged file could have, are
+  //  skipped
+  std::vector<buffer_id_type> priority;
+  priority.reserve(ids.size());
+  std::vector<bool> seen(buffer_count());
+  for (std::vector<buffer_id_type>::reverse_iterator it = ids.rbegin();
+    it != ids.rend(); ++it)
+  {
+    if (*it < buffer_count() && !seen[*it])
+    {
+      seen[*it] = true;
+      priority.push_back(*it);
+    }
+  }
+  std::size_t n = priority.empty() ? 0 : preload(&priority[0], priority.size());
+
+  //  relink coldest first, so the most recently used ends up last
+  for (std::vector<buffer_id_type>::size_type i = 0; i != ids.size(); ++i)
+  {
+    buffer* buf = ids[i] < buffer_count() ? buffers.find(ids[i]) : 0;
+    if (!buf || buf->use_count() || buf->never_free())
+      continue;
+    m_unlink(*buf);
+    if (m_policy != replacement::lru)
+      buf->m_cache_state = i < hdr.cold_count ? 0 : buffer::cache_hot;
+    m_link(*buf);
+  }
+  return n;
+}
+
 //-------------------------------------- write() ----------------------------------------//
 
 void buffer_manager::write(buffer& pg)
 {
   BOOST_ASSERT(is_open());
   BOOST_ASSERT(pg.buffer_id() < buffer_count());
-  seek(pg.buffer_id()*data_size());
-  binary_file::write(pg.data(), data_size());
+  BOOST_ASSERT(!mapped());
+  if (m_write_back)
+    m_write_back->wait_for(pg.buffer_id());  // an older queued copy must not win
+  binary_file::write_at(static_cast<offset_type>(pg.buffer_id()) * data_size(),
+    pg.data(), data_size());
   pg.needs_write(false);
   ++m_file_buffers_written;
 }
@@ -226,19 +1791,126 @@ void buffer_manager::clear_write_needed()
 bool buffer_manager::flush()
 {
   BOOST_ASSERT(is_open());
-  bool buffer_written = false;
+
+  if (m_write_back)
+    m_write_back->drain();
+
+  std::vector<buffer*> dirty;
   for (buffers_type::iterator itr = buffers.begin();
     itr != buffers.end();
     ++itr)
   {
     if (itr->needs_write())
+      dirty.push_back(&*itr);
+  }
+  if (dirty.empty())
+    return false;
+
+  //  write in buffer_id order, coalescing runs of consecutive ids so that pages
+  //  appended by a large insert run go to disk as a few large sequential writes
+  std::sort(dirty.begin(), dirty.end(), buffer_id_less());
+  if (m_ring)
+  {
+    m_flush_async(dirty);
+    return true;
+  }
+  std::vector<io_segment> segments;
+  for (std::vector<buffer*>::size_type first = 0; first != dirty.size();)
+  {
+    std::vector<buffer*>::size_type last = first + 1;
+    while (last != dirty.size() && last - first < m_max_write_batch
+      && dirty[last]->buffer_id() == dirty[last-1]->buffer_id() + 1)
+      ++last;
+
+    if (last - first == 1)
+      write(*dirty[first]);
+    else
+    {
+      segments.clear();
+      for (std::vector<buffer*>::size_type i = first; i != last; ++i)
+      {
+        io_segment seg = { dirty[i]->data(), data_size() };
+        segments.push_back(seg);
+      }
+      binary_file::gather_write_at(
+        static_cast<offset_type>(dirty[first]->buffer_id()) * data_size(),
+        &segments[0], segments.size());
+      for (std::vector<buffer*>::size_type i = first; i != last; ++i)
+        dirty[i]->needs_write(false);
+      m_file_buffers_written += last - first;
+      ++m_coalesced_writes;
+    }
+    first = last;
+  }
+  return true;
+}
+
+//----------------------------------- m_flush_async() ----------------------------------//
+
+void buffer_manager::m_flush_async(const std::vector<buffer*>& dirty)
+//  Requires: dirty is sorted by buffer_id
+//  Effects: As the synchronous part of flush(), except that every write is queued
+//    before waiting for any of them. The user_data of each write is the index in
+//    dirty of the first buffer it covers.
+{
+  BOOST_ASSERT(m_ring);
+  BOOST_ASSERT(!m_ring->in_flight());
+
+  //  frames are allocated in chunks that are never moved, so registering each chunk
+  //  once covers every buffer's data
+  if (m_registered_chunks != m_frames.chunk_count())
+  {
+    std::vector<io_segment> chunks;
+    for (std::size_t i = 0; i != m_frames.chunk_count(); ++i)
+      chunks.push_back(m_frames.chunk(i));
+    m_ring->register_buffers(chunks.empty() ? 0 : &chunks[0], chunks.size());
+    m_registered_chunks = chunks.size();
+  }
+
+  //  segments must not be reallocated while writes are in flight
+  std::vector<io_segment> segments(dirty.size());
+  for (std::vector<buffer*>::size_type i = 0; i != dirty.size(); ++i)
+  {
+    segments[i].data = dirty[i]->data();
+    segments[i].size = data_size();
+  }
+
+  std::vector<io_ring::completion> done;
+  for (std::vector<buffer*>::size_type first = 0; first != dirty.size();)
+  {
+    std::vector<buffer*>::size_type last = first + 1;
+    while (last != dirty.size() && last - first < m_max_write_batch
+      && dirty[last]->buffer_id() == dirty[last-1]->buffer_id() + 1)
+      ++last;
+    m_ring->write(static_cast<offset_type>(dirty[first]->buffer_id()) * data_size(),
+      &segments[first], last - first, first);
+    first = last;
+  }
+  while (m_ring->in_flight())
+    m_ring->wait(done, m_ring->in_flight());
+
+  //  buffers whose writes failed remain dirty, so a later flush() retries them
+  system::error_code ec;
+  for (std::vector<io_ring::completion>::const_iterator it = done.begin();
+    it != done.end(); ++it)
+  {
+    if (it->ec)
     {
-      write(*itr);
-      itr->needs_write(false);
-      buffer_written = true;
+      if (!ec)
+        ec = it->ec;
+      continue;
     }
+    std::vector<buffer*>::size_type first = static_cast<std::size_t>(it->user_data);
+    std::size_t n = it->size / data_size();
+    for (std::vector<buffer*>::size_type i = first; i != first + n; ++i)
+      dirty[i]->needs_write(false);
+    m_file_buffers_written += n;
+    if (n > 1)
+      ++m_coalesced_writes;
   }
-  return buffer_written;
+  if (ec)
+    BOOST_BTREE_THROW(filesystem::filesystem_error("buffer_manager::flush",
+      path(), ec));
 }
   
 //------------------------------------ operator<<() ------------------------------------//
@@ -253,7 +1925,10 @@ std::ostream& operator<<(std::ostream& os, const buffer_manager& pm)
     << "  buffer allocs ------------: " << pm.buffer_allocs() << "\n"
     << "  new buffer requests ------: " << pm.new_buffer_requests() << "\n"  
     << "  never-free honored -------: " << pm.never_free_honored() << "\n"  
-    << "  file buffers written -----: " << pm.file_buffers_written() << "\n\n"  
+    << "  file buffers written -----: " << pm.file_buffers_written() << "\n"
+    << "  coalesced writes ---------: " << pm.coalesced_writes() << "\n"
+    << "  cache grows --------------: " << pm.cache_grows() << "\n"
+    << "  cache shrinks ------------: " << pm.cache_shrinks() << "\n\n"
     << "  cached buffers read ------: " << pm.cached_buffers_read() << "\n"  
     << "  file buffers read --------: " << pm.file_buffers_read() << "\n"
     << "  total buffers read -------: " << pm.active_buffers_read() + pm.cached_buffers_read()
@@ -265,6 +1940,9 @@ std::ostream& operator<<(std::ostream& os, const buffer_manager& pm)
     << "  cache size ---------------: " << pm.buffers_in_memory() << "\n"
     << "  cache buffers in use -----: " << pm.buffers_in_use() << "\n"
     << "  cache buffers available --: " << pm.buffers_available() << "\n"
+    << "  spare buffers ------------: " << pm.buffers_spare() << "\n"
+    << "  page frames allocated ----: " << pm.frames_allocated() << "\n"
+    << "  huge page bytes ----------: " << pm.huge_page_bytes() << "\n"
       ;
   return os;
 }
@@ -0,0 +1,513 @@
+//  io_ring.cpp  -----------------------------------------------------------------------//
+
+//  Copyright agent 2026
+
+//  Distributed under the Boost Software License, Version 1.0.
+//  See http://www.boost.org/LICENSE_1_0.txt
+
+//--------------------------------------------------------------------------------------//
+
+// define BOOST_BTREE_SOURCE so that <boost/filesystem/config.hpp> knows
+// the library is being built (possibly exporting rather than importing code)
+#define BOOST_BTREE_SOURCE
+
+#include <boost/btree/detail/io_ring.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <cstring>
+#include <cerrno>
+
+using boost::system::error_code;
+using boost::system::system_category;
+
+#if defined(__linux__) && !defined(BOOST_BTREE_NO_IO_URING) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#   define BOOST_BTREE_HAS_IO_URING
+# endif
+#endif
+
+#ifdef BOOST_BTREE_HAS_IO_URING
+# include <linux/io_uring.h>
+# include <sys/syscall.h>
+# include <sys/mman.h>
+# include <sys/uio.h>
+# include "unistd.h"
+//  io_uring system call numbers are the same on all architectures except alpha
+# ifndef __NR_io_uring_setup
+#   define __NR_io_uring_setup 425
+# endif
+# ifndef __NR_io_uring_enter
+#   define __NR_io_uring_enter 426
+# endif
+# ifndef __NR_io_uring_register
+#   define __NR_io_uring_register 427
+# endif
+#endif
+
+namespace boost
+{
+  namespace btree
+  {
+
+#ifdef BOOST_BTREE_HAS_IO_URING
+
+//--------------------------------------------------------------------------------------//
+//                                    io_ring_impl                                      //
+//--------------------------------------------------------------------------------------//
+
+    namespace detail
+    {
+      struct io_ring_impl
+      {
+        struct slot  // one operation in the kernel
+        {
+          boost::uint64_t           user_data;
+          binary_file::offset_type  offset;
+          bool                      is_read;
+          std::size_t               expected;   // total bytes requested
+          std::vector<io_segment>   segments;   // for completing short transfers
+          std::vector< ::iovec>     iov;
+        };
+
+        int                   fd;
+        unsigned              entries;
+        void*                 sq_ptr;
+        std::size_t           sq_size;
+        void*                 cq_ptr;        // may equal sq_ptr
+        std::size_t           cq_size;
+        ::io_uring_sqe*       sqes;
+        std::size_t           sqes_size;
+        unsigned*             sq_head;
+        unsigned*             sq_tail;
+        unsigned*             sq_mask;
+        unsigned*             sq_array;
+        unsigned*             cq_head;
+        unsigned*             cq_tail;
+        unsigned*             cq_mask;
+        ::io_uring_cqe*       cqes;
+        unsigned              to_submit;     // queued in the SQ but not yet entered
+        std::vector<slot>     slots;
+        std::vector<unsigned> free_slots;
+
+        io_ring_impl() : fd(-1), sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED),
+          sqes(static_cast< ::io_uring_sqe*>(MAP_FAILED)), to_submit(0) {}
+
+        ~io_ring_impl()
+        {
+          if (sqes != MAP_FAILED)
+            ::munmap(sqes, sqes_size);
+          if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+            ::munmap(cq_ptr, cq_size);
+          if (sq_ptr != MAP_FAILED)
+            ::munmap(sq_ptr, sq_size);
+          if (fd >= 0)
+            ::close(fd);
+        }
+
+        bool setup(unsigned depth)
+        {
+          ::io_uring_params p;
+          std::memset(&p, 0, sizeof(p));
+          fd = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &p));
+          if (fd < 0)
+            return false;
+          entries = p.sq_entries;
+
+          sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+          cq_size = p.cq_off.cqes + p.cq_entries * sizeof(::io_uring_cqe);
+          if (p.features & IORING_FEAT_SINGLE_MMAP)
+            sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+          sq_ptr = ::mmap(0, sq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+          if (sq_ptr == MAP_FAILED)
+            return false;
+          if (p.features & IORING_FEAT_SINGLE_MMAP)
+            cq_ptr = sq_ptr;
+          else
+          {
+            cq_ptr = ::mmap(0, cq_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED)
+              return false;
+          }
+          sqes_size = p.sq_entries * sizeof(::io_uring_sqe);
+          sqes = static_cast< ::io_uring_sqe*>(::mmap(0, sqes_size,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+          if (sqes == MAP_FAILED)
+            return false;
+
+          char* sq = static_cast<char*>(sq_ptr);
+          char* cq = static_cast<char*>(cq_ptr);
+          sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+          sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+          sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+          sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+          cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+          cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+          cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+          cqes = reinterpret_cast< ::io_uring_cqe*>(cq + p.cq_off.cqes);
+
+          //  the kernel may round entries up; never have more in flight than fit in
+          //  the SQ, and the CQ is always at least as large
+          slots.resize(entries);
+          for (unsigned i = entries; i; --i)
+            free_slots.push_back(i - 1);
+          return true;
+        }
+
+        int enter(unsigned submit, unsigned min_complete)
+        {
+          for (;;)
+          {
+            long ret = ::syscall(__NR_io_uring_enter, fd, submit, min_complete,
+              min_complete ? IORING_ENTER_GETEVENTS : 0u, 0, 0);
+            if (ret >= 0)
+            {
+              to_submit -= static_cast<unsigned>(ret);
+              return 0;
+            }
+            if (errno != EINTR)
+              return errno;
+          }
+        }
+
+        ::io_uring_sqe* next_sqe(unsigned slot_index)
+        {
+          //  only called when a slot is free, so the SQ cannot be full
+          unsigned tail = *sq_tail;
+          unsigned index = tail & *sq_mask;
+          ::io_uring_sqe* sqe = &sqes[index];
+          std::memset(sqe, 0, sizeof(*sqe));
+          sqe->user_data = slot_index;
+          sq_array[index] = index;
+          __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+          ++to_submit;
+          return sqe;
+        }
+      };
+    }  // namespace detail
+
+#else
+    namespace detail { struct io_ring_impl {}; }
+#endif
+
+//--------------------------------------------------------------------------------------//
+//                                       io_ring                                        //
+//--------------------------------------------------------------------------------------//
+
+//  -----------------------------------  open  ---------------------------------------  //
+
+    void io_ring::open(binary_file& f, unsigned queue_depth, bool allow_native)
+    {
+      BOOST_ASSERT(f.is_open());
+      BOOST_ASSERT(queue_depth);
+      BOOST_ASSERT(!is_open());
+      m_file = &f;
+      m_depth = queue_depth;
+      m_in_flight = 0;
+#   ifdef BOOST_BTREE_HAS_IO_URING
+      if (allow_native)
+      {
+        m_impl = new detail::io_ring_impl;
+        if (m_impl->setup(queue_depth))
+          m_depth = m_impl->entries;
+        else
+        {
+          delete m_impl;
+          m_impl = 0;
+        }
+      }
+#   endif
+    }
+
+//  -----------------------------------  close  --------------------------------------  //
+
+    void io_ring::close()
+    {
+      if (!is_open())
+        return;
+      if (m_impl)
+      {
+        std::vector<completion> discard;
+        try { while (m_in_flight) wait(discard, m_in_flight); }
+        catch (...) {}  // the kernel completes or cancels whatever remains on close
+        delete m_impl;
+        m_impl = 0;
+      }
+      m_ready.clear();
+      m_registered.clear();
+      m_in_flight = 0;
+      m_file = 0;
+    }
+
+//  ------------------------------  register_buffers  --------------------------------  //
+
+    void io_ring::register_buffers(const io_segment* regions, std::size_t n)
+    {
+      BOOST_ASSERT(is_open());
+      BOOST_ASSERT(!m_in_flight);
+      m_registered.clear();
+#   ifdef BOOST_BTREE_HAS_IO_URING
+      if (!m_impl)
+        return;
+      ::syscall(__NR_io_uring_register, m_impl->fd, IORING_UNREGISTER_BUFFERS, 0, 0);
+      if (!n)
+        return;
+      std::vector< ::iovec> iov(n);
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        iov[i].iov_base = const_cast<void*>(regions[i].data);
+        iov[i].iov_len = regions[i].size;
+      }
+      if (::syscall(__NR_io_uring_register, m_impl->fd, IORING_REGISTER_BUFFERS,
+            &iov[0], static_cast<unsigned>(n)) == 0)
+        m_registered.assign(regions, regions + n);
+#   else
+      (void)regions; (void)n;
+#   endif
+    }
+
+    std::size_t io_ring::registered_buffers() const  { return m_registered.size(); }
+
+//  -----------------------------------  read  ---------------------------------------  //
+
+    void io_ring::read(offset_type offset, void* target, std::size_t sz,
+      boost::uint64_t user_data)
+    {
+      BOOST_ASSERT(is_open());
+      if (!m_impl)
+        m_sync_read(offset, target, sz, user_data);
+      else
+      {
+        io_segment seg = { target, sz };
+        m_queue(offset, &seg, 1, true, user_data);
+      }
+    }
+
+//  -----------------------------------  write  --------------------------------------  //
+
+    void io_ring::write(offset_type offset, const void* source, std::size_t sz,
+      boost::uint64_t user_data)
+    {
+      io_segment seg = { source, sz };
+      write(offset, &seg, 1, user_data);
+    }
+
+    void io_ring::write(offset_type offset, const io_segment* segments, std::size_t n,
+      boost::uint64_t user_data)
+    {
+      BOOST_ASSERT(is_open());
+      BOOST_ASSERT(n);
+      if (!m_impl)
+        m_sync_write(offset, segments, n, user_data);
+      else
+        m_queue(offset, segments, n, false, user_data);
+    }
+
+//  -----------------------------------  submit  -------------------------------------  //
+
+    std::size_t io_ring::submit()
+    {
+      BOOST_ASSERT(is_open());
+#   ifdef BOOST_BTREE_HAS_IO_URING
+      if (m_impl && m_impl->to_submit)
+      {
+        unsigned n = m_impl->to_submit;
+        if (int err = m_impl->enter(n, 0))
+          BOOST_BTREE_THROW(filesystem::filesystem_error("io_ring::submit",
+            m_file->path(), error_code(err, system_category())));
+        return n - m_impl->to_submit;
+      }
+#   endif
+      return 0;
+    }
+
+//  ------------------------------------  wait  --------------------------------------  //
+
+    std::size_t io_ring::wait(std::vector<completion>& results, std::size_t min_complete)
+    {
+      BOOST_ASSERT(is_open());
+      if (min_complete > m_in_flight)
+        min_complete = m_in_flight;
+      if (m_impl)
+        m_reap(min_complete);
+
+      std::size_t n = m_ready.size();
+      results.insert(results.end(), m_ready.begin(), m_ready.end());
+      m_ready.clear();
+      m_in_flight -= n;
+      return n;
+    }
+
+//  -----------------------------------  m_queue  ------------------------------------  //
+
+    void io_ring::m_queue(offset_type offset, const io_segment* segments, std::size_t n,
+      bool is_read, boost::uint64_t user_data)
+    {
+#   ifdef BOOST_BTREE_HAS_IO_URING
+      if (m_impl->free_slots.empty())  // queue is full, so make room
+        m_reap(m_ready.size() + 1);
+
+      unsigned index = m_impl->free_slots.back();
+      m_impl->free_slots.pop_back();
+      detail::io_ring_impl::slot& s = m_impl->slots[index];
+      s.user_data = user_data;
+      s.offset = offset;
+      s.is_read = is_read;
+      s.segments.assign(segments, segments + n);
+      s.iov.resize(n);
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        s.iov[i].iov_base = const_cast<void*>(segments[i].data);
+        s.iov[i].iov_len = segments[i].size;
+      }
+
+      ::io_uring_sqe* sqe = m_impl->next_sqe(index);
+      sqe->fd = m_file->handle();
+      sqe->off = static_cast<boost::uint64_t>(offset);
+
+      //  a single segment within a registered buffer uses the fixed-buffer opcodes
+      std::size_t buf_index = m_registered.size();
+      if (n == 1)
+      {
+        const char* p = static_cast<const char*>(segments[0].data);
+        for (std::size_t i = 0; i < m_registered.size(); ++i)
+        {
+          const char* base = static_cast<const char*>(m_registered[i].data);
+          if (p >= base && p + segments[0].size <= base + m_registered[i].size)
+          {
+            buf_index = i;
+            break;
+          }
+        }
+      }
+      if (buf_index != m_registered.size())
+      {
+        sqe->opcode = is_read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->addr = reinterpret_cast<boost::uint64_t>(segments[0].data);
+        sqe->len = static_cast<boost::uint32_t>(segments[0].size);
+        sqe->buf_index = static_cast<boost::uint16_t>(buf_index);
+      }
+      else
+      {
+        sqe->opcode = is_read ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->addr = reinterpret_cast<boost::uint64_t>(&s.iov[0]);
+        sqe->len = static_cast<boost::uint32_t>(n);
+      }
+      ++m_in_flight;
+#   else
+      (void)offset; (void)segments; (void)n; (void)is_read; (void)user_data;
+#   endif
+    }
+
+//  -----------------------------------  m_reap  -------------------------------------  //
+
+    void io_ring::m_reap(std::size_t min_ready)
+    //  Submits anything queued and moves kernel completions to m_ready until it holds
+    //  at least min_ready entries.
+    {
+#   ifdef BOOST_BTREE_HAS_IO_URING
+      detail::io_ring_impl& r = *m_impl;
+      for (;;)
+      {
+        unsigned head = *r.cq_head;
+        unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+          const ::io_uring_cqe& cqe = r.cqes[head & *r.cq_mask];
+          unsigned index = static_cast<unsigned>(cqe.user_data);
+          detail::io_ring_impl::slot& s = r.slots[index];
+          completion c;
+          c.user_data = s.user_data;
+          c.size = 0;
+          if (cqe.res < 0)
+            c.ec.assign(-cqe.res, system_category());
+          else
+          {
+            //  complete a short transfer synchronously
+            std::size_t done = static_cast<std::size_t>(cqe.res);
+            for (std::size_t i = 0; i < s.segments.size(); ++i)
+            {
+              std::size_t seg_sz = s.segments[i].size;
+              if (done >= seg_sz)
+              {
+                done -= seg_sz;
+                c.size += seg_sz;
+                continue;
+              }
+              offset_type off = s.offset + static_cast<offset_type>(c.size + done);
+              if (s.is_read)
+              {
+                if (!m_file->read_at(off,
+                  static_cast<char*>(const_cast<void*>(s.segments[i].data)) + done,
+                  seg_sz - done, c.ec))
+                {
+                  //  as with binary_file::read_at(), end-of-file part way through is
+                  //  an error
+                  if (!c.ec && c.size + done)
+                    c.ec.assign(EIO, system_category());
+                  c.size = 0;
+                  break;
+                }
+              }
+              else
+              {
+                m_file->write_at(off, static_cast<const char*>(s.segments[i].data)
+                  + done, seg_sz - done, c.ec);
+                if (c.ec)
+                  break;
+              }
+              c.size += seg_sz;
+              done = 0;
+            }
+          }
+          m_ready.push_back(c);
+          r.free_slots.push_back(index);
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+
+        if (m_ready.size() >= min_ready && !r.to_submit)
+          return;
+        unsigned want = m_ready.size() >= min_ready
+          ? 0 : static_cast<unsigned>(min_ready - m_ready.size());
+        if (int err = r.enter(r.to_submit, want))
+        {
+          if (err != EBUSY && err != EAGAIN)
+            BOOST_BTREE_THROW(filesystem::filesystem_error("io_ring::wait",
+              m_file->path(), error_code(err, system_category())));
+        }
+        else if (!want)
+          return;
+      }
+#   else
+      (void)min_ready;
+#   endif
+    }
+
+//  --------------------------  synchronous implementation  --------------------------  //
+
+    void io_ring::m_sync_read(offset_type offset, void* target, std::size_t sz,
+      boost::uint64_t user_data)
+    {
+      completion c;
+      c.user_data = user_data;
+      c.size = m_file->read_at(offset, target, sz, c.ec) ? sz : 0;
+      m_ready.push_back(c);
+      ++m_in_flight;
+    }
+
+    void io_ring::m_sync_write(offset_type offset, const io_segment* segments,
+      std::size_t n, boost::uint64_t user_data)
+    {
+      completion c;
+      c.user_data = user_data;
+      c.size = 0;
+      m_file->gather_write_at(offset, segments, n, c.ec);
+      if (!c.ec)
+        for (std::size_t i = 0; i < n; ++i)
+          c.size += segments[i].size;
+      m_ready.push_back(c);
+      ++m_in_flight;
+    }
+
+  } // namespace btree
+} // namespace boost
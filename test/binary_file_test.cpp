@@ -13,6 +13,7 @@
 
 #include <iostream>
 #include <boost/btree/detail/binary_file.hpp>
+#include <boost/btree/detail/io_ring.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/detail/lightweight_main.hpp>
 #include <boost/detail/lightweight_test.hpp> 
@@ -83,6 +84,156 @@ namespace
     fs::remove(p);
     std::cout << "  completed open flag tests" << std::endl;
   }
+
+  void positioned_io_tests()
+  {
+    std::cout << "positioned I/O tests..." << std::endl;
+
+    fs::path p("test.txt");
+    bt::binary_file f(p, bt::oflag::in | bt::oflag::out | bt::oflag::truncate);
+    boost::system::error_code ec;
+
+    f.write_at(10, "klmno", 5);
+    BOOST_TEST_EQ(fs::file_size(p), 15U);
+    f.write_at(0, "abcde", 5, ec);
+    BOOST_TEST(!ec);
+    f.write_at(5, "fghij", 5);
+    BOOST_TEST_EQ(fs::file_size(p), 15U);
+
+    char buf[16] = "";
+    BOOST_TEST(f.read_at(0, buf, 15));
+    BOOST_TEST(std::memcmp(buf, "abcdefghijklmno", 15) == 0);
+    BOOST_TEST(f.read_at(7, buf, 3, ec));
+    BOOST_TEST(!ec);
+    BOOST_TEST(std::memcmp(buf, "hij", 3) == 0);
+
+    char c;
+    BOOST_TEST(f.read_at(14, c));
+    BOOST_TEST_EQ(c, 'o');
+    BOOST_TEST(!f.read_at(15, buf, 1, ec));  // end-of-file
+    BOOST_TEST(!ec);
+
+    bt::io_segment segs[3] = { {"12", 2}, {"345", 3}, {"6", 1} };
+    f.gather_write_at(12, segs, 3);
+    BOOST_TEST_EQ(fs::file_size(p), 18U);
+    BOOST_TEST(f.read_at(10, buf, 8));
+    BOOST_TEST(std::memcmp(buf, "kl123456", 8) == 0);
+    f.gather_write_at(0, segs, 0, ec);  // no segments is a no-op
+    BOOST_TEST(!ec);
+
+#ifndef BOOST_WINDOWS_API
+    //  positioned I/O neither uses nor changes the file offset
+    BOOST_TEST_EQ(f.seek(2), 2);
+    f.read_at(10, buf, 5);
+    f.write_at(0, "A", 1);
+    BOOST_TEST(f.read(c));
+    BOOST_TEST_EQ(c, 'c');
+#endif
+
+    //  truncate() cuts the file back, or extends it with zeros
+    f.truncate(8);
+    BOOST_TEST_EQ(fs::file_size(p), 8U);
+    BOOST_TEST(!f.read_at(8, buf, 1, ec));
+    BOOST_TEST(f.read_at(4, buf, 4));
+    BOOST_TEST(std::memcmp(buf, "efgh", 4) == 0);
+    f.truncate(10, ec);
+    BOOST_TEST(!ec);
+    BOOST_TEST_EQ(fs::file_size(p), 10U);
+    BOOST_TEST(f.read_at(8, buf, 2));
+    BOOST_TEST(buf[0] == 0 && buf[1] == 0);
+
+    f.close();
+    fs::remove(p);
+  }
+
+  void io_ring_tests(bool allow_native)
+  {
+    std::cout << "io_ring tests, allow_native " << allow_native << "..." << std::endl;
+
+    fs::path p("test.txt");
+    bt::binary_file f(p, bt::oflag::in | bt::oflag::out | bt::oflag::truncate);
+    bt::io_ring ring;
+    BOOST_TEST(!ring.is_open());
+    ring.open(f, 4);  // shallow, so a full queue is exercised
+    BOOST_TEST(ring.is_open());
+    if (!allow_native)
+    {
+      ring.close();
+      ring.open(f, 4, false);
+      BOOST_TEST(!ring.native());
+    }
+    std::cout << "  native: " << ring.native() << std::endl;
+    BOOST_TEST(ring.queue_depth() >= 4U);
+
+    static char pages[10][64];
+    bt::io_segment region = { pages, sizeof(pages) };
+    ring.register_buffers(&region, 1);  // may legitimately register nothing
+    for (int i = 0; i < 8; ++i)
+    {
+      std::memset(pages[i], 'a' + i, 64);
+      ring.write(i * 64, pages[i], 64, i);
+    }
+    std::vector<bt::io_ring::completion> done;
+    while (ring.in_flight())
+      ring.wait(done, ring.in_flight());
+    BOOST_TEST_EQ(done.size(), 8U);
+    unsigned seen = 0;
+    for (std::size_t i = 0; i < done.size(); ++i)
+    {
+      BOOST_TEST(!done[i].ec);
+      BOOST_TEST_EQ(done[i].size, 64U);
+      seen |= 1u << done[i].user_data;
+    }
+    BOOST_TEST_EQ(seen, 0xffU);
+    BOOST_TEST_EQ(fs::file_size(p), 8U * 64);
+
+    //  vectored write from memory that is not registered
+    char x[32], y[32];
+    std::memset(x, 'x', 32);
+    std::memset(y, 'y', 32);
+    bt::io_segment segs[2] = { {x, 32}, {y, 32} };
+    ring.write(8 * 64, segs, 2, 100);
+    done.clear();
+    BOOST_TEST_EQ(ring.wait(done), 1U);
+    BOOST_TEST_EQ(done[0].user_data, 100U);
+    BOOST_TEST_EQ(done[0].size, 64U);
+
+    //  reads, including one at end-of-file and one that is cut short by it
+    ring.read(3 * 64, pages[8], 64, 1);
+    ring.read(8 * 64, pages[9], 64, 2);
+    char tail[64];
+    ring.read(9 * 64, tail, 64, 3);
+    ring.read(9 * 64 - 16, tail, 64, 4);
+    done.clear();
+    while (ring.in_flight())
+      ring.wait(done, ring.in_flight());
+    BOOST_TEST_EQ(done.size(), 4U);
+    for (std::size_t i = 0; i < done.size(); ++i)
+    {
+      switch (done[i].user_data)
+      {
+      case 1: case 2:
+        BOOST_TEST(!done[i].ec);
+        BOOST_TEST_EQ(done[i].size, 64U);
+        break;
+      case 3:
+        BOOST_TEST(!done[i].ec);
+        BOOST_TEST_EQ(done[i].size, 0U);
+        break;
+      default:
+        BOOST_TEST(done[i].ec);
+        BOOST_TEST_EQ(done[i].size, 0U);
+      }
+    }
+    BOOST_TEST(std::memcmp(pages[8], pages[3], 64) == 0);
+    BOOST_TEST_EQ(pages[9][31], 'x');
+    BOOST_TEST_EQ(pages[9][32], 'y');
+
+    ring.close();
+    BOOST_TEST(!ring.is_open());
+    f.close();
+    fs::remove(p);
+  }
 }
 
 //  cpp_main  --------------------------------------------------------------------------//
@@ -95,6 +246,9 @@ int cpp_main(int argc, char * argv[])
     static_cast<bt::binary_file::offset_type>(std::atol(argv[1])) * 1024;
 
   open_flag_tests();
+  positioned_io_tests();
+  io_ring_tests(true);
+  io_ring_tests(false);
 
   char buf[128] = "0123456789abcdef";
 
@@ -30,7 +30,14 @@
 #include <utility>
 #include <map>
 #include <set>
+#include <vector>
+#include <iterator>
 #include <algorithm>
+#ifndef BOOST_WINDOWS_API
+# include <fcntl.h>     // for direct_io_supported()
+# include <unistd.h>
+# include <sys/mman.h>  // for MAP_HUGETLB and MADV_HUGEPAGE
+#endif
 
 using namespace boost;
 namespace fs = boost::filesystem;
@@ -1030,6 +1037,25 @@ void find_and_bounds_tests(BTree& bt)
 //    cout << "      i = " << i << ", bt.count(i) = " << bt.count(i) <<endl;
   }
 
+  //  batched lookups, with probes out of order and repeated
+  {
+    std::vector<int> probes;
+    for (int i = 18; i >= 0; --i)
+      probes.push_back(i);
+    probes.push_back(7);
+    probes.push_back(15);
+    std::vector<typename BTree::const_iterator> lows, founds;
+    bt.lower_bound_many(probes.begin(), probes.end(), std::back_inserter(lows));
+    bt.find_many(probes.begin(), probes.end(), std::back_inserter(founds));
+    BOOST_TEST_EQ(lows.size(), probes.size());
+    BOOST_TEST_EQ(founds.size(), probes.size());
+    for (std::size_t j = 0; j < probes.size(); ++j)
+    {
+      BOOST_TEST(lows[j] == bt.lower_bound(probes[j]));
+      BOOST_TEST(founds[j] == bt.find(probes[j]));
+    }
+  }
+
   //  non-unique container erase by key test
   if (!(bt.header().flags() & btree::flags::unique))
   {
@@ -1087,6 +1113,181 @@ void find_and_bounds()
   cout << "    find_and_bounds complete" << endl;
 }
 
+//----------------------------------- node_search ----------------------------------------//
+
+template <class Key>
+void node_search_tests(Key lo, Key step)
+{
+  //  set and multiset leaves have a stride of sizeof(Key), map leaves and branches
+  //  have larger strides
+
+  typedef btree::btree_multiset<Key, btree::native_endian_traits> set_type;
+  typedef btree::btree_map<Key, int32_t, btree::native_endian_traits> map_type;
+  set_type set("node_search_set.btr", btree::flags::truncate, -1, btree::less(), 256);
+  map_type map("node_search_map.btr", btree::flags::truncate, -1, btree::less(), 256);
+  std::multiset<Key> stl;
+
+  for (int i = 0; i < 3000; ++i)
+  {
+    Key k = static_cast<Key>(lo + step * static_cast<Key>((i * 7919) % 1000));
+    set.insert(k);
+    map.emplace(k, i);
+    stl.insert(k);
+  }
+  BOOST_TEST(set.header().levels() > 1);
+  BOOST_TEST(map.header().levels() > 1);
+
+  for (int i = -2; i < 1003; ++i)
+  {
+    Key k = static_cast<Key>(lo + step * static_cast<Key>(i));
+    typename std::multiset<Key>::iterator stl_low = stl.lower_bound(k);
+    typename std::multiset<Key>::iterator stl_up = stl.upper_bound(k);
+
+    typename set_type::const_iterator low = set.lower_bound(k);
+    typename set_type::const_iterator up = set.upper_bound(k);
+    BOOST_TEST(stl_low == stl.end() ? low == set.end() : *low == *stl_low);
+    BOOST_TEST(stl_up == stl.end() ? up == set.end() : *up == *stl_up);
+    BOOST_TEST_EQ(set.count(k), static_cast<std::size_t>(std::distance(stl_low, stl_up)));
+
+    typename map_type::const_iterator mlow = map.lower_bound(k);
+    typename map_type::const_iterator mup = map.upper_bound(k);
+    BOOST_TEST(stl_low == stl.end() ? mlow == map.end() : mlow->first == *stl_low);
+    BOOST_TEST(stl_up == stl.end() ? mup == map.end() : mup->first == *stl_up);
+    BOOST_TEST_EQ(map.find(k) != map.end(), stl_low != stl_up);
+  }
+}
+
+template <class Key>
+struct node_search_element { int32_t id; Key key; };
+
+template <class Key>
+void node_search_array_tests(Key lo)
+{
+  //  every node size from empty to well beyond the linear window, with a stride that
+  //  is not the key size, and keys with gaps so that absent keys are searched too
+
+  node_search_element<Key> a[100];
+  for (std::size_t n = 0; n <= 100; ++n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      a[i].id = 0;
+      a[i].key = static_cast<Key>(lo + static_cast<Key>(2 * (i / 3)));
+    }
+    for (Key k = static_cast<Key>(lo - 2);
+      k <= static_cast<Key>(lo + static_cast<Key>(2 * (n / 3) + 2)); ++k)
+    {
+      std::size_t expected_low = 0, expected_up = 0;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        expected_low += a[i].key < k;
+        expected_up += !(k < a[i].key);
+      }
+      BOOST_TEST_EQ(static_cast<std::size_t>(btree::detail::node_lower_bound<btree::less,
+        btree::std_node_search>(a, a+n, &a[0].key, k, btree::less()) - a), expected_low);
+      BOOST_TEST_EQ(static_cast<std::size_t>(btree::detail::node_upper_bound<btree::less,
+        btree::std_node_search>(a, a+n, &a[0].key, k, btree::less()) - a), expected_up);
+    }
+  }
+}
+
+struct node_search_element_compare
+{
+  bool operator()(const node_search_element<fat>& e, const fat& k) const
+    { return e.key < k; }
+  bool operator()(const fat& k, const node_search_element<fat>& e) const
+    { return k < e.key; }
+};
+
+template <class Policy>
+void generic_node_search_tests()
+{
+  //  fat is not eligible for the SIMD search, so Policy is used
+
+  node_search_element<fat> a[100];
+  for (std::size_t n = 0; n <= 100; ++n)
+  {
+    for (std::size_t i = 0; i < n; ++i)
+      a[i].key = fat(static_cast<int>(2 * (i / 3)));
+    for (int i = -2; i <= static_cast<int>(2 * (n / 3) + 2); ++i)
+    {
+      fat k(i);
+      BOOST_TEST((btree::detail::node_lower_bound<btree::less, Policy>(a, a+n, &a[0].key,
+        k, node_search_element_compare())
+          == std::lower_bound(a, a+n, k, node_search_element_compare())));
+      BOOST_TEST((btree::detail::node_upper_bound<btree::less, Policy>(a, a+n, &a[0].key,
+        k, node_search_element_compare())
+          == std::upper_bound(a, a+n, k, node_search_element_compare())));
+    }
+  }
+}
+
+struct std_search_traits : public btree::default_traits
+{
+  typedef btree::std_node_search  node_search_type;
+};
+
+struct no_search_traits  // predates node_search_type
+{
+  typedef btree::default_traits::node_id_type         node_id_type;
+  typedef btree::default_traits::node_level_type      node_level_type;
+  typedef btree::default_traits::node_size_type       node_size_type;
+  typedef btree::default_traits::index_position_type  index_position_type;
+  static const BOOST_SCOPED_ENUM(endian::order) header_endianness
+    = btree::default_traits::header_endianness;
+};
+
+void node_search()
+{
+  cout << "  node_search..." << endl;
+
+  BOOST_TEST((btree::detail::node_search_kind<int32_t, btree::less, int32_t>::value
+    == btree::detail::int32_key));
+  BOOST_TEST((btree::detail::node_search_kind<int64_t, btree::less, int32_t>::value
+    == btree::detail::int64_key));
+  BOOST_TEST((btree::detail::node_search_kind<uint64_t, btree::less, int32_t>::value
+    == btree::detail::generic_key));
+  BOOST_TEST((btree::detail::node_search_kind<int32_t, btree::less, int64_t>::value
+    == btree::detail::generic_key));
+  BOOST_TEST((btree::detail::node_search_kind<fat, btree::less, fat>::value
+    == btree::detail::generic_key));
+
+  node_search_array_tests<int32_t>(-20);
+  node_search_array_tests<uint32_t>(0x7FFFFFF0u);
+  node_search_array_tests<int64_t>(-20);
+  node_search_array_tests<uint64_t>(0x7FFFFFFFFFFFFFF0ull);
+  node_search_array_tests<float>(-20.0f);
+  node_search_array_tests<double>(-20.0);
+
+  node_search_tests<int32_t>(-500, 3);
+  node_search_tests<uint32_t>(0x80000000u - 1000, 3);
+  node_search_tests<int64_t>(-(int64_t(1) << 40), int64_t(1) << 30);
+  node_search_tests<uint64_t>(0x8000000000000000ull - 1000, 3);
+  node_search_tests<double>(-100.0, 0.25);
+
+  BOOST_TEST((boost::is_same<btree::detail::node_search_policy<btree::default_traits>::type,
+    btree::branchless_node_search>::value));
+  BOOST_TEST((boost::is_same<btree::detail::node_search_policy<std_search_traits>::type,
+    btree::std_node_search>::value));
+  BOOST_TEST((boost::is_same<btree::detail::node_search_policy<no_search_traits>::type,
+    btree::branchless_node_search>::value));
+  generic_node_search_tests<btree::branchless_node_search>();
+  generic_node_search_tests<btree::std_node_search>();
+
+  {
+    typedef btree::btree_set<fat, std_search_traits> std_set_type;
+    std_set_type set("node_search_std.btr", btree::flags::truncate, -1,
+      btree::less(), 128);
+    for (int i = 0; i < 1000; ++i)
+      set.insert(fat((i * 7919) % 1000));
+    for (int i = 0; i < 1000; ++i)
+      BOOST_TEST_EQ(set.find(fat(i))->x, i);
+    BOOST_TEST(set.find(fat(1000)) == set.end());
+  }
+
+  cout << "    node_search complete" << endl;
+}
+
 //---------------------------------- insert_non_unique -----------------------------------//
 
 template <class BTree>
@@ -1145,6 +1346,802 @@ void insert_non_unique()
   cout << "    insert_non_unique complete" << endl;
 }
 
+//--------------------------------  leaf_links_test  ----------------------------------//
+
+void leaf_links_test()
+{
+  cout << "  leaf_links_test..." << endl;
+
+  typedef btree::btree_multimap<fat, int> map_type;
+  std::multimap<int, int> stl;
+  {
+    map_type bt("leaf_links.btr", btree::flags::truncate, -1, btree::less(), 128);
+    bt.max_cache_size(0);  // maximum stress
+
+    for (int i = 0; i < 2000; ++i)
+    {
+      bt.emplace(fat((i * 7919) % 500), i);  // each key four times
+      stl.insert(std::make_pair((i * 7919) % 500, i));
+    }
+
+    //  erase through iterators reached by sibling links, freeing whole leaves,
+    //  including the first and last
+    map_type::const_iterator it = bt.begin();
+    std::multimap<int, int>::iterator stl_it = stl.begin();
+    for (int i = 0; it != bt.end(); ++i)
+    {
+      if (i % 5 < 3 || it->first.x < 20 || it->first.x >= 480)
+      {
+        it = bt.erase(it);
+        stl.erase(stl_it++);
+      }
+      else
+      {
+        ++it;
+        ++stl_it;
+      }
+    }
+    BOOST_TEST_EQ(bt.size(), stl.size());
+    BOOST_TEST(bt.inspect_leaf_to_root(cout, bt.begin()));
+    BOOST_TEST(bt.inspect_leaf_to_root(cout, bt.last()));
+
+    //  insert through the first and last leaves after their predecessors were freed
+    bt.emplace(fat(0), -1);
+    stl.insert(std::make_pair(0, -1));
+    bt.emplace(fat(999), -2);
+    stl.insert(std::make_pair(999, -2));
+  }
+  {
+    map_type bt("leaf_links.btr", btree::flags::read_only);
+    bt.max_cache_size(0);
+    BOOST_TEST_EQ(bt.size(), stl.size());
+
+    //  a full scan in either direction reads each leaf once, and no branches
+    uint64_t reads = bt.manager().file_buffers_read();
+    std::set<unsigned> leaves;
+    std::multimap<int, int>::const_iterator stl_it = stl.begin();
+    for (map_type::const_iterator it = bt.begin(); it != bt.end(); ++it, ++stl_it)
+    {
+      BOOST_TEST_EQ(it->first.x, stl_it->first);
+      leaves.insert(it.node()->node_id());
+    }
+    BOOST_TEST_EQ(leaves.size(), bt.header().leaf_node_count());
+    BOOST_TEST_EQ(bt.manager().file_buffers_read() - reads,
+      static_cast<uint64_t>(bt.header().leaf_node_count()));
+
+    map_type::const_iterator first = bt.begin();  // holds the first leaf
+    reads = bt.manager().file_buffers_read();
+    std::multimap<int, int>::const_reverse_iterator stl_rit = stl.rbegin();
+    for (map_type::const_iterator it = bt.end(); it != first; ++stl_rit)
+    {
+      --it;
+      BOOST_TEST_EQ(it->first.x, stl_rit->first);
+    }
+    BOOST_TEST(stl_rit == stl.rend());
+    BOOST_TEST(bt.manager().file_buffers_read() - reads   // some may still be cached
+      <= static_cast<uint64_t>(bt.header().leaf_node_count() - 1));
+  }
+
+
+  //  branch splits leave the parent chains of the held leaves they move stale; erase
+  //  through those leaves, reached by sibling links, must not trust them
+  stl.clear();
+  {
+    map_type bt("leaf_links.btr", btree::flags::truncate, -1, btree::less(), 128);
+    for (int i = 0; i < 1000; i += 2)
+    {
+      bt.emplace(fat(i), i);
+      stl.insert(std::make_pair(i, i));
+    }
+    std::vector<map_type::const_iterator> held;  // keep every leaf and its chain
+    for (int i = 0; i < 1000; i += 2)
+      held.push_back(bt.find(fat(i)));
+    unsigned branches = bt.header().branch_node_count();
+    for (int i = 401; i < 600; i += 2)  // split branches over the middle leaves only
+    {
+      bt.emplace(fat(i), i);
+      stl.insert(std::make_pair(i, i));
+    }
+    BOOST_TEST(bt.header().branch_node_count() > branches);
+
+    map_type::const_iterator it = bt.begin();
+    std::multimap<int, int>::iterator stl_it = stl.begin();
+    while (it != bt.end() && it->first.x < 800)
+    {
+      it = bt.erase(it);
+      stl.erase(stl_it++);
+    }
+    BOOST_TEST_EQ(bt.size(), stl.size());
+    BOOST_TEST(bt.inspect_leaf_to_root(cout, bt.begin()));
+    bt.emplace(fat(1), 1);  // insert into the first leaf
+    stl.insert(std::make_pair(1, 1));
+  }
+  {
+    map_type bt("leaf_links.btr", btree::flags::read_only);
+    BOOST_TEST_EQ(bt.size(), stl.size());
+    std::multimap<int, int>::const_iterator stl_it = stl.begin();
+    for (map_type::const_iterator it = bt.begin(); it != bt.end() && stl_it != stl.end();
+      ++it, ++stl_it)
+    {
+      BOOST_TEST_EQ(it->first.x, stl_it->first);
+      BOOST_TEST(bt.find(it->first) != bt.end());
+    }
+  }
+
+  cout << "    leaf_links_test complete" << endl;
+}
+
+//-------------------------------  rebalance_test  -------------------------------------//
+
+template <class BTree>
+void leaf_fill_check(BTree& bt, std::size_t min_size)
+{
+  //  every leaf other than the root holds at least min_size elements, and has a
+  //  valid chain to the root
+  typename BTree::const_iterator it = bt.begin();
+  while (it != bt.end())
+  {
+    BOOST_TEST(bt.header().levels() == 1 || it.node()->size() >= min_size);
+    BOOST_TEST(bt.inspect_leaf_to_root(cout, it));
+    std::size_t n = it.node()->size();
+    for (std::size_t i = 0; i < n; ++i)
+      ++it;
+  }
+}
+
+void rebalance_test()
+{
+  cout << "  rebalance_test..." << endl;
+
+  typedef btree::btree_set<fat> set_type;
+  typedef btree::btree_multimap<fat, int> multimap_type;
+  const std::size_t node_sz = 512;
+  const unsigned pct = 40;
+
+  std::size_t max_leaf;  // elements per full leaf
+  {
+    set_type full("rebalance_full.btr", btree::flags::truncate, -1, btree::less(),
+      node_sz);
+    for (int i = 0; i < 100; ++i)
+      full.insert(fat(i));
+    max_leaf = full.begin().node()->size();
+  }
+  const std::size_t min_size = (max_leaf * pct + 99) / 100;
+
+  set_type lazy("rebalance_lazy.btr", btree::flags::truncate, -1, btree::less(), node_sz);
+  set_type bt("rebalance.btr", btree::flags::truncate, -1, btree::less(), node_sz);
+  bt.max_cache_size(0);  // maximum stress
+  BOOST_TEST_EQ(bt.min_fill_percent(), 0U);
+  bt.min_fill_percent(pct);
+  BOOST_TEST_EQ(bt.min_fill_percent(), pct);
+  std::set<int> stl;
+
+  const int n = 5000;
+  for (int i = 0; i < n; ++i)
+  {
+    int k = (i * 7919) % n;
+    bt.insert(fat(k));
+    lazy.insert(fat(k));
+    stl.insert(k);
+  }
+  unsigned levels = bt.header().levels();
+
+  //  purge 70% of the keys, by key, through iterators reached by sibling links, and
+  //  by range
+  for (int i = 0; i < n; ++i)
+  {
+    int k = (i * 104729) % n;
+    if (k % 10 < 4)
+    {
+      BOOST_TEST_EQ(bt.erase(fat(k)), 1U);
+      lazy.erase(fat(k));
+      stl.erase(k);
+    }
+  }
+  leaf_fill_check(bt, min_size);
+
+  set_type::const_iterator it = bt.begin();
+  for (int i = 0; it != bt.end(); ++i)
+  {
+    if (i % 3 == 0)
+    {
+      int k = it->x;
+      it = bt.erase(it);
+      lazy.erase(fat(k));
+      stl.erase(k);
+      BOOST_TEST(it == bt.end() || it->x == *stl.upper_bound(k));
+    }
+    else
+      ++it;
+  }
+  leaf_fill_check(bt, min_size);
+
+  it = bt.erase(bt.lower_bound(fat(1000)), bt.lower_bound(fat(2000)));
+  BOOST_TEST_EQ(it->x, *stl.lower_bound(2000));
+  lazy.erase(lazy.lower_bound(fat(1000)), lazy.lower_bound(fat(2000)));
+  stl.erase(stl.lower_bound(1000), stl.lower_bound(2000));
+
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  BOOST_TEST(bt == lazy);
+  BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+  leaf_fill_check(bt, min_size);
+  BOOST_TEST(bt.header().leaf_node_count() < lazy.header().leaf_node_count());
+  BOOST_TEST(bt.size() * 100 >= bt.header().leaf_node_count() * max_leaf * pct);
+  BOOST_TEST(bt.header().levels() <= levels);
+  cout << "      " << lazy.header().leaf_node_count() << " leaves without rebalancing, "
+       << bt.header().leaf_node_count() << " with" << endl;
+
+  //  the tree remains usable, including inserts that split merged nodes
+  for (int i = 0; i < n; i += 3)
+  {
+    bt.insert(fat(i));
+    stl.insert(i);
+  }
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+  for (std::set<int>::const_iterator sit = stl.begin(); sit != stl.end(); ++sit)
+    BOOST_TEST(bt.find(fat(*sit)) != bt.end());
+  leaf_fill_check(bt, min_size);
+
+  //  erase everything; the root collapses to a leaf
+  while (!stl.empty())
+  {
+    int k = *stl.begin();
+    BOOST_TEST_EQ(bt.erase(fat(k)), 1U);
+    stl.erase(stl.begin());
+    if (stl.size() % 500 == 0)
+      leaf_fill_check(bt, min_size);
+  }
+  BOOST_TEST(bt.empty());
+  BOOST_TEST_EQ(bt.header().levels(), 1U);
+
+  //  non-unique keys spanning leaves
+  {
+    multimap_type mm("rebalance_multimap.btr", btree::flags::truncate, -1,
+      btree::less(), node_sz);
+    mm.min_fill_percent(50);
+    std::multimap<int, int> stl_mm;
+    for (int i = 0; i < 3000; ++i)
+    {
+      mm.emplace(fat((i * 7919) % 300), i);
+      stl_mm.insert(std::make_pair((i * 7919) % 300, i));
+    }
+    for (int k = 0; k < 300; k += 2)
+    {
+      BOOST_TEST_EQ(mm.erase(fat(k)), 10U);
+      stl_mm.erase(k);
+    }
+    BOOST_TEST_EQ(mm.size(), stl_mm.size());
+    std::multimap<int, int>::const_iterator stl_it = stl_mm.begin();
+    for (multimap_type::const_iterator mit = mm.begin(); mit != mm.end();
+      ++mit, ++stl_it)
+    {
+      BOOST_TEST_EQ(mit->first.x, stl_it->first);
+      BOOST_TEST_EQ(mit->second, stl_it->second);
+    }
+    for (int k = 1; k < 300; k += 2)
+      BOOST_TEST_EQ(mm.count(fat(k)), 10U);
+  }
+
+  cout << "    rebalance_test complete" << endl;
+}
+
+//--------------------------------  compact_test  -------------------------------------//
+
+template <class BTree>
+void compact_check(BTree& bt)
+{
+  //  the leaves, in key order, are nodes 1, 2, 3, ... and every leaf has a valid
+  //  chain to the root
+  typename BTree::const_iterator it = bt.begin();
+  unsigned id = 1;
+  while (it != bt.end())
+  {
+    BOOST_TEST_EQ(it.node()->node_id(), id++);
+    BOOST_TEST(bt.inspect_leaf_to_root(cout, it));
+    std::size_t n = it.node()->size();
+    for (std::size_t i = 0; i < n; ++i)
+      ++it;
+  }
+  BOOST_TEST_EQ(bt.header().node_count(), bt.manager().buffer_count());
+}
+
+void compact_test()
+{
+  cout << "  compact_test..." << endl;
+
+  typedef btree::btree_set<fat> set_type;
+  typedef btree::btree_multimap<fat, int> multimap_type;
+  const std::size_t node_sz = 512;
+
+  //  a sparse tree: random inserts, then most keys erased
+  set_type bt("compact.btr", btree::flags::truncate, -1, btree::less(), node_sz);
+  bt.max_cache_size(0);  // maximum stress
+  std::set<int> stl;
+  const int n = 5000;
+  for (int i = 0; i < n; ++i)
+  {
+    int k = (i * 7919) % n;
+    bt.insert(fat(k));
+    stl.insert(k);
+  }
+  for (int i = 0; i < n; ++i)
+  {
+    int k = (i * 104729) % n;
+    if (k % 10 < 6)
+    {
+      bt.erase(fat(k));
+      stl.erase(k);
+    }
+  }
+
+  //  steps interleaved with reads
+  BOOST_TEST(!bt.compacting());
+  bt.compact_start();
+  BOOST_TEST(bt.compacting());
+  const btree::compact_stats& stats = bt.compaction_stats();
+  BOOST_TEST(stats.leaves_before > 0);
+  BOOST_TEST(stats.sequential_before < 50.0);
+  int steps = 0;
+  while (!bt.compact_step(10))
+  {
+    ++steps;
+    BOOST_TEST(bt.find(fat(*stl.begin())) != bt.end());
+    BOOST_TEST(bt.find(fat(*stl.rbegin())) != bt.end());
+    if (steps % 5 == 0)
+      BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+  }
+  BOOST_TEST(!bt.compacting());
+  BOOST_TEST(steps > 1);
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+  for (std::set<int>::const_iterator sit = stl.begin(); sit != stl.end(); ++sit)
+    BOOST_TEST(bt.find(fat(*sit)) != bt.end());
+  compact_check(bt);
+  BOOST_TEST_EQ(stats.sequential_after, 100.0);
+  BOOST_TEST(stats.fill_after > stats.fill_before);
+  BOOST_TEST(stats.fill_after > 95.0);
+  BOOST_TEST(stats.leaves_after < stats.leaves_before);
+  BOOST_TEST_EQ(stats.leaves_after, bt.header().leaf_node_count());
+  BOOST_TEST(stats.nodes_after < stats.nodes_before);
+  BOOST_TEST_EQ(bt.header().node_count(), 1 + bt.header().leaf_node_count()
+    + bt.header().branch_node_count());
+  bt.flush();
+  BOOST_TEST_EQ(bt.header().free_node_list_head_id(), 0U);
+  BOOST_TEST_EQ(boost::filesystem::file_size("compact.btr"),
+    bt.header().node_count() * node_sz);
+  cout << "      " << stats.leaves_before << " leaves, " << stats.fill_before
+       << "% full, " << stats.sequential_before << "% sequential; after, "
+       << stats.leaves_after << " leaves, " << stats.fill_after << "% full" << endl;
+
+  //  foreground inserts and erases between steps
+  for (int i = 0; i < n; i += 2)
+  {
+    bt.insert(fat(i));
+    stl.insert(i);
+  }
+  bt.compact_start(0.7);
+  for (int i = 1; !bt.compact_step(5); i += 97)
+  {
+    int k = (i * 7919) % n;
+    if (i % 2)
+    {
+      bt.insert(fat(k));
+      stl.insert(k);
+    }
+    else
+    {
+      bt.erase(fat(k));
+      stl.erase(k);
+    }
+    bt.erase(fat(*stl.begin()));
+    stl.erase(stl.begin());
+  }
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+  BOOST_TEST(bt.compaction_stats().sequential_after > 90.0);
+  BOOST_TEST_EQ(bt.header().node_count(), bt.manager().buffer_count());
+
+  //  a clean compaction at 0.7 tops up leaves to 70% full, leaving fuller ones be
+  bt.compact(0.7);
+  compact_check(bt);
+  BOOST_TEST(bt.compaction_stats().fill_after > 60.0);
+  BOOST_TEST(bt.compaction_stats().fill_after <= bt.compaction_stats().fill_before);
+
+  //  reopen, then the tree grows normally
+  bt.close();
+  bt.open("compact.btr", btree::flags::read_write, -1, btree::less(), node_sz);
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+  for (int i = n; i < n + 1000; ++i)
+  {
+    bt.insert(fat(i));
+    stl.insert(i);
+  }
+  BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+
+  //  stopped early, and closed while compacting
+  bt.compact_start();
+  bt.compact_step(3);
+  bt.compact_stop();
+  BOOST_TEST(!bt.compacting());
+  BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+  bt.compact_start();
+  bt.compact_step(3);
+  bt.close();
+  bt.open("compact.btr", btree::flags::read_write, -1, btree::less(), node_sz);
+  BOOST_TEST_EQ(bt.header().node_count(), bt.manager().buffer_count());
+  BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+
+  //  stopped at once, with every free node at the end of the file, so only the
+  //  truncation changes anything
+  {
+    set_type tail("compact_tail.btr", btree::flags::truncate, -1, btree::less(),
+      node_sz);
+    for (int i = 0; i < 2000; ++i)
+      tail.insert(fat(i));
+    for (int i = 1000; i < 2000; ++i)
+      tail.erase(fat(i));
+    tail.flush();
+    std::size_t nodes_before = tail.header().node_count();
+    tail.compact_start();
+    tail.compact_stop();
+    BOOST_TEST(tail.header().node_count() < nodes_before);
+    BOOST_TEST_EQ(tail.header().node_count(), tail.manager().buffer_count());
+    tail.close();
+    tail.open("compact_tail.btr", btree::flags::read_write, -1, btree::less(),
+      node_sz);
+    BOOST_TEST(tail.header().node_count() < nodes_before);
+    BOOST_TEST_EQ(tail.header().node_count(), tail.manager().buffer_count());
+    BOOST_TEST_EQ(boost::filesystem::file_size("compact_tail.btr"),
+      tail.header().node_count() * node_sz);
+    BOOST_TEST_EQ(tail.size(), 1000U);
+    for (int i = 2000; i < 3000; ++i)
+      tail.insert(fat(i));
+    BOOST_TEST_EQ(tail.size(), 2000U);
+    BOOST_TEST(tail.find(fat(999)) != tail.end());
+    BOOST_TEST(tail.find(fat(1000)) == tail.end());
+    BOOST_TEST(tail.find(fat(2999)) != tail.end());
+  }
+
+  //  non-unique keys spanning leaves, with rebalancing on erase
+  {
+    multimap_type mm("compact_multimap.btr", btree::flags::truncate, -1,
+      btree::less(), node_sz);
+    mm.min_fill_percent(30);
+    std::multimap<int, int> stl_mm;
+    for (int i = 0; i < 3000; ++i)
+    {
+      mm.emplace(fat((i * 7919) % 300), i);
+      stl_mm.insert(std::make_pair((i * 7919) % 300, i));
+    }
+    for (int k = 0; k < 300; k += 3)
+    {
+      mm.erase(fat(k));
+      stl_mm.erase(k);
+    }
+    mm.compact_start();
+    while (!mm.compact_step(4))
+      BOOST_TEST_EQ(mm.count(fat(1)), 10U);
+    compact_check(mm);
+    BOOST_TEST_EQ(mm.size(), stl_mm.size());
+    std::multimap<int, int>::const_iterator stl_it = stl_mm.begin();
+    for (multimap_type::const_iterator mit = mm.begin(); mit != mm.end();
+      ++mit, ++stl_it)
+    {
+      BOOST_TEST_EQ(mit->first.x, stl_it->first);
+      BOOST_TEST_EQ(mit->second, stl_it->second);
+    }
+    for (int k = 1; k < 300; k += 3)
+      BOOST_TEST_EQ(mm.count(fat(k)), 10U);
+  }
+
+  cout << "    compact_test complete" << endl;
+}
+
+//-----------------------------  node_allocation_test  ---------------------------------//
+
+template <class BTree>
+std::vector<unsigned> leaf_ids(BTree& bt)  // in key order
+{
+  std::vector<unsigned> ids;
+  typename BTree::const_iterator it = bt.begin();
+  while (it != bt.end())
+  {
+    ids.push_back(it.node()->node_id());
+    std::size_t n = it.node()->size();
+    for (std::size_t i = 0; i < n; ++i)
+      ++it;
+  }
+  return ids;
+}
+
+void node_allocation_test()
+{
+  cout << "  node_allocation_test..." << endl;
+
+  typedef btree::btree_set<fat> set_type;
+  const std::size_t node_sz = 512;
+  set_type bt("node_allocation.btr", btree::flags::truncate, -1, btree::less(),
+    node_sz);
+  bt.max_cache_size(0);
+  std::set<int> stl;
+
+  //  ascending inserts leave the leaves full and in node id order
+  const int n = 8000;
+  for (int i = 0; i < n; ++i)
+  {
+    bt.insert(fat(i * 10));
+    stl.insert(i * 10);
+  }
+
+  //  free every fourth leaf
+  std::set<unsigned> freed;
+  set_type::const_iterator it = bt.begin();
+  for (int i = 0; it != bt.end(); ++i)
+  {
+    int first = it->x;
+    int last = (it.node()->leaf().end() - 1)->x;
+    if (i % 4 == 2)
+    {
+      freed.insert(it.node()->node_id());
+      it = bt.erase(it, bt.upper_bound(fat(last)));
+      stl.erase(stl.lower_bound(first), stl.upper_bound(last));
+    }
+    else
+      it = bt.upper_bound(fat(last));
+  }
+  bt.flush();
+  BOOST_TEST_EQ(bt.header().free_node_list_head_id(), *freed.begin());
+
+  //  a split takes the free node nearest the leaf split, not the most recently freed
+  unsigned nodes = bt.header().node_count();
+  std::vector<unsigned> ids = leaf_ids(bt);
+  it = bt.begin();
+  for (int i = 0; it != bt.end(); ++i)
+  {
+    int last = (it.node()->leaf().end() - 1)->x;
+    if (i % 6 == 0)
+    {
+      bt.insert(fat(it->x + 1));
+      stl.insert(it->x + 1);
+    }
+    it = bt.upper_bound(fat(last));
+  }
+  BOOST_TEST_EQ(bt.header().node_count(), nodes);  // the file did not grow
+  std::vector<unsigned> after = leaf_ids(bt);
+  BOOST_TEST(after.size() > ids.size());
+  for (std::size_t i = 1; i < after.size(); ++i)
+  {
+    unsigned distance = after[i] > after[i-1] ? after[i] - after[i-1]
+                                              : after[i-1] - after[i];
+    BOOST_TEST(distance <= 8);  // a few branches are interleaved with the leaves
+  }
+
+  //  the free node list survives reopening, and is allocated from the same way
+  bt.close();
+  bt.open("node_allocation.btr", btree::flags::read_write, -1, btree::less(), node_sz);
+  BOOST_TEST_EQ(bt.header().node_count(), nodes);
+  for (int i = 0; i < n; i += 2)
+  {
+    bt.insert(fat(i * 10 + 5));
+    stl.insert(i * 10 + 5);
+  }
+  BOOST_TEST(bt.header().node_count() > nodes);  // once the free nodes were used up
+  BOOST_TEST_EQ(bt.header().leaf_node_count() + bt.header().branch_node_count() + 1,
+    bt.header().node_count());
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+
+  //  ending a compaction cuts free nodes from the end of the file, and the free node
+  //  list left on disk must then end before the cut
+  {
+    set_type bt2("node_allocation_2.btr", btree::flags::truncate, -1, btree::less(),
+      node_sz);
+    std::set<int> stl2;
+    for (int i = 0; i < n; ++i)
+    {
+      bt2.insert(fat(i));
+      stl2.insert(i);
+    }
+    bt2.erase(bt2.find(fat(n / 4)), bt2.find(fat(n / 4 + 200)));  // free a few low nodes
+    stl2.erase(stl2.find(n / 4), stl2.find(n / 4 + 200));
+    bt2.erase(bt2.find(fat(n / 2)), bt2.end());                   // and the tail
+    stl2.erase(stl2.find(n / 2), stl2.end());
+    bt2.flush();
+    unsigned tail_nodes = bt2.header().node_count();
+    bt2.compact_start();
+    bt2.compact_stop();
+    BOOST_TEST(bt2.header().node_count() < tail_nodes);
+    nodes = bt2.header().node_count();
+    bt2.close();
+    bt2.open("node_allocation_2.btr", btree::flags::read_write, -1, btree::less(),
+      node_sz);
+    BOOST_TEST_EQ(bt2.header().node_count(), nodes);
+    for (int i = n; i < 2 * n; ++i)  // allocates every free node, then appends
+    {
+      bt2.insert(fat(i));
+      stl2.insert(i);
+    }
+    BOOST_TEST_EQ(bt2.header().leaf_node_count() + bt2.header().branch_node_count() + 1,
+      bt2.header().node_count());
+    BOOST_TEST_EQ(bt2.size(), stl2.size());
+    BOOST_TEST(std::equal(bt2.begin(), bt2.end(), stl2.begin()));
+  }
+
+  cout << "    node_allocation_test complete" << endl;
+}
+
+//------------------------------  shrink_to_fit_test  ---------------------------------//
+
+void shrink_to_fit_test()
+{
+  cout << "  shrink_to_fit_test..." << endl;
+
+  typedef btree::btree_multimap<fat, int> multimap_type;
+  const std::size_t node_sz = 256;
+  multimap_type bt("shrink_to_fit.btr", btree::flags::truncate, -1, btree::less(),
+    node_sz);
+  bt.max_cache_size(0);  // maximum stress
+  std::multimap<int, int> stl;
+
+  //  append keys after the early ones, then erase most of the early keys, so that the
+  //  free nodes are low in the file and live nodes follow them
+  const int n = 4000;
+  for (int i = 0; i < n; ++i)
+  {
+    int k = (i * 7919) % (n / 4);  // duplicates
+    bt.emplace(fat(k), i);
+    stl.insert(std::make_pair(k, i));
+  }
+  for (int i = 0; i < n / 2; ++i)
+  {
+    bt.emplace(fat(n + i), i);
+    stl.insert(std::make_pair(n + i, i));
+  }
+  for (int k = 0; k < n / 4; ++k)
+  {
+    if (k % 5)
+    {
+      bt.erase(fat(k));
+      stl.erase(k);
+    }
+  }
+  bt.erase(fat(n + 100));  // leave a hole near the end
+  stl.erase(n + 100);
+  bt.flush();
+  unsigned nodes_before = bt.header().node_count();
+  BOOST_TEST(nodes_before > 1 + bt.header().leaf_node_count()
+    + bt.header().branch_node_count());
+
+  bt.shrink_to_fit();
+  BOOST_TEST_EQ(bt.header().node_count(), 1 + bt.header().leaf_node_count()
+    + bt.header().branch_node_count());
+  BOOST_TEST_EQ(bt.header().node_count(), bt.manager().buffer_count());
+  BOOST_TEST_EQ(bt.header().free_node_list_head_id(), 0U);
+  BOOST_TEST_EQ(boost::filesystem::file_size("shrink_to_fit.btr"),
+    bt.header().node_count() * node_sz);
+  cout << "      " << nodes_before << " nodes before, " << bt.header().node_count()
+       << " after" << endl;
+
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  std::multimap<int, int>::const_iterator stl_it = stl.begin();
+  for (multimap_type::const_iterator it = bt.begin(); it != bt.end(); ++it, ++stl_it)
+  {
+    BOOST_TEST_EQ(it->first.x, stl_it->first);
+    BOOST_TEST_EQ(it->second, stl_it->second);
+  }
+  leaf_fill_check(bt, 1);
+  for (int k = 0; k < n / 4; k += 5)
+    BOOST_TEST_EQ(bt.count(fat(k)), stl.count(k));
+
+  //  reopen, and the tree grows and shrinks normally
+  bt.close();
+  bt.open("shrink_to_fit.btr", btree::flags::read_write, -1, btree::less(), node_sz);
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  for (int i = 0; i < n; ++i)
+  {
+    int k = (i * 7919) % n;
+    bt.emplace(fat(k), -i);
+    stl.insert(std::make_pair(k, -i));
+  }
+  for (int k = n; k < n + n / 2; k += 2)
+  {
+    bt.erase(fat(k));
+    stl.erase(k);
+  }
+  bt.shrink_to_fit();
+  BOOST_TEST_EQ(bt.header().node_count(), 1 + bt.header().leaf_node_count()
+    + bt.header().branch_node_count());
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  leaf_fill_check(bt, 1);
+  bt.close();
+  bt.open("shrink_to_fit.btr", btree::flags::read_write, -1, btree::less(), node_sz);
+  BOOST_TEST_EQ(bt.size(), stl.size());
+  stl_it = stl.begin();
+  for (multimap_type::const_iterator it = bt.begin(); it != bt.end(); ++it, ++stl_it)
+    BOOST_TEST_EQ(it->first.x, stl_it->first);
+
+  //  nothing to do
+  unsigned nodes = bt.header().node_count();
+  bt.shrink_to_fit();
+  BOOST_TEST_EQ(bt.header().node_count(), nodes);
+
+  cout << "    shrink_to_fit_test complete" << endl;
+}
+
+//-----------------------------------  find_many_test  ----------------------------------//
+
+template <class BTree>
+void find_many_check(const BTree& bt, const std::vector<int>& probes)
+{
+  std::vector<typename BTree::const_iterator> lows, founds;
+  bt.lower_bound_many(probes.begin(), probes.end(), std::back_inserter(lows));
+  bt.find_many(probes.begin(), probes.end(), std::back_inserter(founds));
+  BOOST_TEST_EQ(lows.size(), probes.size());
+  BOOST_TEST_EQ(founds.size(), probes.size());
+  std::size_t errors = 0;
+  for (std::size_t i = 0; i < lows.size() && i < founds.size(); ++i)
+  {
+    if (lows[i] != bt.lower_bound(probes[i]) || founds[i] != bt.find(probes[i]))
+      ++errors;
+  }
+  BOOST_TEST_EQ(errors, 0U);
+}
+
+template <class BTree>
+void find_many_tests(BTree& bt)
+{
+  std::vector<int> probes;
+  find_many_check(bt, probes);  // no probes
+  probes.push_back(1);
+  find_many_check(bt, probes);  // empty tree
+
+  const int n = 5000;
+  for (int i = 0; i < n; ++i)
+    bt.emplace(fat((i * 7919) % (n / 2) * 2), i);  // even keys, duplicated if multi
+  BOOST_TEST(bt.header().levels() > 2);
+
+  //  random probes, including keys below, between, and beyond those present
+  probes.clear();
+  for (int i = 0; i < 1000; ++i)
+    probes.push_back((i * 104729) % (n + 10) - 5);
+  find_many_check(bt, probes);
+
+  //  clustered probes, which share most of their descents
+  probes.clear();
+  for (int i = 0; i < 300; ++i)
+    probes.push_back(2000 + (i * 37) % 150);
+  find_many_check(bt, probes);
+
+  //  a batch within one leaf, and one of a single repeated key
+  probes.assign(5, n / 2);
+  find_many_check(bt, probes);
+  probes.clear();
+  for (int i = 0; i < 4; ++i)
+    probes.push_back(100 - i);
+  find_many_check(bt, probes);
+}
+
+void find_many_test()
+{
+  cout << "  find_many_test..." << endl;
+
+  {
+    btree::btree_map<fat, int> bt("find_many_map.btr", btree::flags::truncate, -1,
+      btree::less(), 128);
+    bt.max_cache_size(0);  // maximum stress
+    find_many_tests(bt);
+  }
+  {
+    btree::btree_multimap<fat, int> bt("find_many_multimap.btr", btree::flags::truncate,
+      -1, btree::less(), 128);
+    find_many_tests(bt);
+  }
+
+  cout << "    find_many_test complete" << endl;
+}
+
 //--------------------------------  update_test  --------------------------------------//
 
 void update_test()
@@ -1433,6 +2430,292 @@ void  cache_size_test()
   cout << "    cache_size_test complete" << endl;
 }
 
+//--------------------------------  scrambled long_map  --------------------------------//
+
+//  The cache and I/O option tests share one data set: a btree_map<long, long> of
+//  long_map_size elements inserted in scrambled key order, key scrambled(i) mapping to
+//  i % long_map_size.
+
+typedef btree::btree_map<long, long> long_map;
+const long long_map_size = 5000;
+
+long scrambled(long i)  { return (i * 7919) % long_map_size; }
+
+void fill_long_map(long_map& bt, long sign = 1)
+{
+  for (long i = 0; i < long_map_size; ++i)
+    bt.emplace(scrambled(i), sign * i);
+}
+
+void create_long_map(const char* path, std::size_t node_sz,
+  btree::flags::bitmask flgs = btree::flags::truncate)
+{
+  long_map bt(path, flgs | btree::flags::truncate, -1, btree::less(), node_sz);
+  fill_long_map(bt);
+}
+
+void check_long_map(const long_map& bt, long sign = 1)
+{
+  BOOST_TEST_EQ(bt.size(), static_cast<long_map::size_type>(long_map_size));
+  long expected = 0;
+  for (long_map::const_iterator it = bt.begin(); it != bt.end(); ++it, ++expected)
+    BOOST_TEST_EQ(it->first, expected);
+  BOOST_TEST_EQ(expected, long_map_size);
+  for (long i = 0; i < long_map_size; i += 97)
+  {
+    long_map::const_iterator it = bt.find(scrambled(i));
+    BOOST_TEST(it != bt.end() && it->second == sign * i);
+  }
+}
+
+//--------------------------------  direct_io_test  ------------------------------------//
+
+//  Returns: true if the file system holding the current directory is known to accept
+//  direct I/O, so that flags::direct_io must take effect
+bool direct_io_supported()
+{
+# if defined(BOOST_WINDOWS_API)
+  return true;   // FILE_FLAG_NO_BUFFERING
+# elif defined(O_DIRECT)
+  int fd = ::open("direct_io.probe", O_CREAT | O_WRONLY | O_DIRECT, 0666);
+  if (fd < 0)
+    return false;
+  ::close(fd);
+  fs::remove("direct_io.probe");
+  return true;
+# else
+  return false;  // F_NOCACHE is only advice, so is not known to take effect
+# endif
+}
+
+void  direct_io_test()
+{
+  cout << "  direct_io_test..." << endl;
+
+  const bool supported = direct_io_supported();
+  if (!supported)
+    cout << "    direct I/O not supported here; direct() is not checked" << endl;
+  {
+    long_map bt("direct_io.btree", btree::flags::truncate | btree::flags::direct_io,
+      -1, btree::less(), 4096);
+    BOOST_TEST(bt.manager().direct() || !supported);
+    bt.max_cache_size(4);  // force nodes to be written and read back
+    fill_long_map(bt);
+  }
+  {
+    long_map bt("direct_io.btree", btree::flags::read_only | btree::flags::direct_io);
+    BOOST_TEST(bt.manager().direct() || !supported);
+    check_long_map(bt);
+  }
+  {
+    long_map bt("direct_io.btree");  // buffered open of a file written directly
+    BOOST_TEST(!bt.manager().direct());
+    check_long_map(bt);
+  }
+
+  cout << "     direct_io_test complete" << endl;
+}
+
+//--------------------------------  memory_map_test  -----------------------------------//
+
+void  memory_map_test()
+{
+  cout << "  memory_map_test..." << endl;
+
+  create_long_map("memory_map.btree", 256);
+  long_map bt("memory_map.btree", btree::flags::read_only | btree::flags::memory_map);
+  BOOST_TEST(bt.manager().mapped());
+  bt.max_cache_size(4);  // descriptors are still recycled
+  check_long_map(bt);
+  BOOST_TEST_EQ(bt.manager().frames_allocated(), 0U);  // no private copies
+  bt.close();
+  BOOST_TEST(!bt.manager().mapped());
+
+  cout << "     memory_map_test complete" << endl;
+}
+
+//--------------------------------  preload_cache_test  --------------------------------//
+
+void  preload_cache_test()
+{
+  cout << "  preload_cache_test..." << endl;
+
+  create_long_map("preload.btree", 128);
+  {
+    long_map bt("preload.btree", btree::flags::read_only | btree::flags::fastest);
+    BOOST_TEST(bt.header().levels() >= 3);
+    BOOST_TEST_EQ(bt.manager().buffers_in_memory(), 1U);  // just the root
+    boost::uint64_t reads = bt.manager().file_buffers_read();
+
+    std::size_t branches = bt.preload_cache(false);
+    BOOST_TEST_EQ(branches, bt.header().branch_node_count() - 1);  // less the root
+    BOOST_TEST_EQ(bt.manager().file_buffers_read() - reads, branches);
+
+    std::size_t leaves = bt.preload_cache();
+    BOOST_TEST_EQ(leaves, bt.header().leaf_node_count());
+    BOOST_TEST_EQ(bt.manager().buffers_in_memory(), bt.header().node_count() - 1);
+
+    reads = bt.manager().file_buffers_read();
+    check_long_map(bt);
+    BOOST_TEST_EQ(bt.manager().file_buffers_read(), reads);  // all hits
+  }
+  {
+    //  flags::preload stops when the cache is full
+    long_map bt("preload.btree",
+      btree::flags::read_only | btree::flags::preload | btree::flags::low_memory);
+    BOOST_TEST(bt.manager().buffers_available() <= bt.max_cache_size());
+    BOOST_TEST(bt.manager().buffers_available() + 1 >= bt.max_cache_size());
+    BOOST_TEST(bt.find(1234) != bt.end());
+  }
+
+  cout << "     preload_cache_test complete" << endl;
+}
+
+//--------------------------------  persist_cache_test  --------------------------------//
+
+void  persist_cache_test()
+{
+  cout << "  persist_cache_test..." << endl;
+
+  fs::remove("persist.btree.hotset");
+  create_long_map("persist.btree", 128, btree::flags::persist_cache);
+  BOOST_TEST(fs::exists("persist.btree.hotset"));
+
+  std::size_t cached;
+  {
+    long_map bt("persist.btree", btree::flags::read_only | btree::flags::persist_cache);
+    bt.max_cache_size(20);
+    for (long i = 100; i < 110; ++i)
+      BOOST_TEST(bt.find(i) != bt.end());
+    cached = bt.manager().buffers_in_memory();
+  }
+  {
+    long_map bt("persist.btree", btree::flags::read_only | btree::flags::persist_cache);
+    BOOST_TEST_EQ(bt.manager().buffers_in_memory(), cached);
+    boost::uint64_t reads = bt.manager().file_buffers_read();
+    for (long i = 100; i < 110; ++i)
+      BOOST_TEST(bt.find(i) != bt.end());
+    BOOST_TEST_EQ(bt.manager().file_buffers_read(), reads);  // warm from the start
+  }
+  fs::remove("persist.btree.hotset");
+
+  cout << "     persist_cache_test complete" << endl;
+}
+
+//---------------------------------  shared_cache_test  --------------------------------//
+
+void  shared_cache_test()
+{
+  cout << "  shared_cache_test..." << endl;
+
+  btree::buffer_pool& pool = btree::buffer_pool::global();
+  std::size_t old_max = pool.max_bytes();
+  pool.max_bytes(32 * 128);
+  {
+    long_map busy("shared_1.btree", btree::flags::truncate | btree::flags::shared_cache,
+      -1, btree::less(), 128);
+    long_map idle("shared_2.btree", btree::flags::truncate | btree::flags::shared_cache,
+      -1, btree::less(), 128);
+    BOOST_TEST_EQ(pool.managers(), 2U);
+    fill_long_map(idle);
+    fill_long_map(busy, -1);
+    BOOST_TEST(pool.available_bytes() <= pool.max_bytes());
+    BOOST_TEST(busy.manager().buffers_available() > idle.manager().buffers_available());
+    check_long_map(idle);
+    check_long_map(busy, -1);
+  }
+  BOOST_TEST_EQ(pool.managers(), 0U);
+  {
+    long_map bt("shared_2.btree", btree::flags::read_only);  // still valid
+    BOOST_TEST(!bt.manager().pool());
+    check_long_map(bt);
+  }
+  pool.max_bytes(old_max);
+
+  cout << "     shared_cache_test complete" << endl;
+}
+
+//--------------------------------  cache_branches_test  -------------------------------//
+
+void  cache_branches_test()
+{
+  cout << "  cache_branches_test..." << endl;
+
+  const std::size_t cache_max = 16;
+  long_map bt("cache_branches.btree", btree::flags::truncate | btree::flags::cache_branches,
+    -1, btree::less(), 128);
+  bt.max_cache_size(cache_max);
+  fill_long_map(bt);
+  BOOST_TEST(bt.header().levels() > 3);  // more branches than the cache can hold
+
+  long count = 0;
+  for (long_map::const_iterator it = bt.begin(); it != bt.end(); ++it)
+    ++count;
+  BOOST_TEST_EQ(count, long_map_size);
+
+  //  branches are preferred, but within a bounded share of the cache
+  BOOST_TEST_EQ(bt.manager().never_free_honored(), 0U);
+  BOOST_TEST(bt.manager().buffers_available() <= cache_max);
+  BOOST_TEST(bt.manager().priority_buffers_available() > 0);
+  BOOST_TEST(bt.manager().priority_buffers_available()
+    <= cache_max / 2 + 1);  // the share is enforced as buffers are evicted
+
+  //  a lookup after the scan finds its upper branch levels still cached
+  boost::uint64_t reads = bt.manager().file_buffers_read();
+  BOOST_TEST_EQ(bt.find(scrambled(2500))->second, 2500L);
+  BOOST_TEST(bt.manager().file_buffers_read() - reads < bt.header().levels() - 1);
+
+  cout << "     cache_branches_test complete" << endl;
+}
+
+//----------------------------------  auto_cache_test  ---------------------------------//
+
+void  auto_cache_test()
+{
+  cout << "  auto_cache_test..." << endl;
+
+  long_map bt("auto_cache.btree",
+    btree::flags::truncate | btree::flags::low_memory | btree::flags::auto_cache,
+    -1, btree::less(), 128);
+  BOOST_TEST(bt.manager().auto_size());
+  BOOST_TEST_EQ(bt.max_cache_size(), 32U);  // the low_memory default
+  fill_long_map(bt);
+  for (long i = 0; i < 4 * long_map_size; ++i)  // random lookups miss often in a small
+    BOOST_TEST_EQ(bt.find(scrambled(i))->second, i % long_map_size);  // cache
+  BOOST_TEST(bt.manager().cache_grows() > 0U);
+  BOOST_TEST(bt.max_cache_size() > 32U);
+
+  cout << "     auto_cache_test complete" << endl;
+}
+
+//----------------------------------  huge_pages_test  ---------------------------------//
+
+void  huge_pages_test()
+{
+  cout << "  huge_pages_test..." << endl;
+
+  {
+    long_map bt("huge_pages.btree", btree::flags::truncate | btree::flags::huge_pages,
+      -1, btree::less(), 4096);
+    BOOST_TEST(bt.manager().huge_pages());
+    fill_long_map(bt);
+#   if !defined(BOOST_WINDOWS_API) && (defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE))
+    //  chunks are mapped with MAP_HUGETLB, or else at least advised as MADV_HUGEPAGE
+    BOOST_TEST(bt.manager().huge_page_bytes() > 0U);
+#   else
+    BOOST_TEST_EQ(bt.manager().huge_page_bytes(), 0U);
+#   endif
+  }
+  {
+    long_map bt("huge_pages.btree", btree::flags::read_only);
+    BOOST_TEST(!bt.manager().huge_pages());
+    BOOST_TEST_EQ(bt.manager().huge_page_bytes(), 0U);
+    check_long_map(bt);
+  }
+
+  cout << "     huge_pages_test complete" << endl;
+}
+
 //----------------------- erase_return_iterator_validity_test  -------------------------//
 
 void  erase_return_iterator_validity_test(int start)
@@ -1509,6 +2792,273 @@ void  insert_unique_return_iterator_test()
   cout << "     insert_unique_return_iterator_test complete" << endl;
 }
 
+//--------------------------------  bulk_build_test  ----------------------------------//
+
+void  bulk_build_test()
+{
+  cout << "  bulk_build_test..." << endl;
+
+  typedef btree::btree_set<fat> set_type;
+  typedef btree::btree_multimap<fat, int> multimap_type;
+
+  std::vector<fat> v;
+  for (int i = 0; i < 3000; ++i)
+    v.push_back(fat(i / 3 * 2));  // each key three times, with gaps
+
+  //  full leaves, as insert_packed() produces, with ascending node ids
+  {
+    set_type packed("bulk_packed.btr", btree::flags::truncate, -1, btree::less(), 128);
+    for (std::vector<fat>::const_iterator it = v.begin(); it != v.end(); ++it)
+      packed.insert_packed(*it);
+
+    set_type bt("bulk_build.btr", btree::flags::truncate, -1, btree::less(), 128);
+    bt.max_cache_size(0);  // maximum stress
+    bt.bulk_build(v.begin(), v.end());
+    BOOST_TEST_EQ(bt.size(), 1000U);
+    BOOST_TEST(bt == packed);
+    BOOST_TEST(bt.header().levels() > 2);
+    BOOST_TEST_EQ(bt.header().leaf_node_count(), packed.header().leaf_node_count());
+    BOOST_TEST(bt.header().branch_node_count() <= packed.header().branch_node_count());
+
+    unsigned prior_id = 0;
+    for (set_type::const_iterator it = bt.begin(); it != bt.end(); ++it)
+    {
+      BOOST_TEST(it.node()->node_id() >= prior_id);
+      prior_id = it.node()->node_id();
+    }
+    BOOST_TEST_EQ(prior_id, bt.header().leaf_node_count());  // leaves are 1..n
+
+    for (int i = -1; i < 2001; ++i)
+    {
+      set_type::const_iterator it = bt.find(fat(i));
+      BOOST_TEST((it != bt.end()) == (i >= 0 && i < 2000 && i % 2 == 0));
+      BOOST_TEST_EQ(bt.lower_bound(fat(i)) == bt.end() ? 2000
+        : bt.lower_bound(fat(i))->x, (i + 1) / 2 * 2);
+    }
+    BOOST_TEST(bt.inspect_leaf_to_root(cout, bt.begin()));
+    BOOST_TEST(bt.inspect_leaf_to_root(cout, bt.last()));
+
+    //  the tree is an ordinary tree afterwards
+    BOOST_TEST(bt.insert(fat(1001)).second);
+    BOOST_TEST(bt.insert(fat(5000)).second);
+    BOOST_TEST_EQ(bt.erase(fat(0)), 1U);
+    BOOST_TEST_EQ(bt.size(), 1001U);
+    BOOST_TEST(bt.find(fat(1001)) != bt.end());
+  }
+  {
+    set_type bt("bulk_build.btr");
+    BOOST_TEST_EQ(bt.size(), 1001U);
+    BOOST_TEST_EQ(bt.begin()->x, 2);
+    BOOST_TEST_EQ(bt.last()->x, 5000);
+  }
+
+  //  fill factor
+  {
+    set_type full("bulk_full.btr", btree::flags::truncate, -1, btree::less(), 128);
+    full.bulk_build(v.begin(), v.end());
+    set_type half("bulk_half.btr", btree::flags::truncate, -1, btree::less(), 128);
+    half.bulk_build(v.begin(), v.end(), 0.5);
+    BOOST_TEST(half == full);
+    BOOST_TEST(half.header().leaf_node_count() >= 2 * full.header().leaf_node_count() - 1);
+    for (int i = 0; i < 2000; i += 2)  // leaves with room take inserts without splits
+      half.insert(fat(i + 1));
+    BOOST_TEST_EQ(half.size(), 2000U);
+    BOOST_TEST(half.inspect_leaf_to_root(cout, half.last()));
+  }
+
+  //  non-unique keys keep their input order
+  {
+    std::vector<multimap_type::value_type> mv;
+    for (int i = 0; i < 3000; ++i)
+      mv.push_back(multimap_type::value_type(fat(i / 3), i));
+    multimap_type bt("bulk_multimap.btr", btree::flags::truncate, -1,
+      btree::less(), 128);
+    bt.bulk_build(mv.begin(), mv.end());
+    BOOST_TEST_EQ(bt.size(), 3000U);
+    int i = 0;
+    for (multimap_type::const_iterator it = bt.begin(); it != bt.end(); ++it, ++i)
+    {
+      BOOST_TEST_EQ(it->first.x, i / 3);
+      BOOST_TEST_EQ(it->second, i);
+    }
+    for (int k = 0; k < 1000; k += 37)
+      BOOST_TEST_EQ(bt.count(fat(k)), 3U);
+  }
+  {
+    multimap_type bt("bulk_multimap.btr");  // nothing written since bulk_build()
+    BOOST_TEST_EQ(bt.size(), 3000U);
+    BOOST_TEST_EQ(bt.count(fat(500)), 3U);
+  }
+
+  //  copying a tree with the range constructor, as example/pack_map.cpp does, builds
+  //  the copy bottom up; its leaves are 1..n
+  {
+    set_type old_bt("bulk_build.btr");
+    set_type bt(old_bt.begin(), old_bt.end(), "bulk_copy.btr", btree::flags::truncate,
+      -1, btree::less(), 128);
+    BOOST_TEST(bt == old_bt);
+    BOOST_TEST(bt.header().levels() > 2);
+    unsigned prior_id = 0;
+    for (set_type::const_iterator it = bt.begin(); it != bt.end(); ++it)
+      prior_id = it.node()->node_id();
+    BOOST_TEST_EQ(prior_id, bt.header().leaf_node_count());
+
+    //  unsorted input, or a target that is not empty, is inserted element by element
+    std::vector<fat> unsorted(v.rbegin(), v.rend());
+    set_type bt2(unsorted.begin(), unsorted.end(), "bulk_copy.btr",
+      btree::flags::truncate, -1, btree::less(), 128);
+    BOOST_TEST_EQ(bt2.size(), 1000U);
+    BOOST_TEST(std::equal(bt2.begin(), bt2.end(), std::set<fat>(v.begin(), v.end()).begin()));
+    bt2.insert(old_bt.begin(), old_bt.end());
+    BOOST_TEST_EQ(bt2.size(), 1002U);  // 1001 and 5000 added; 0 already there
+
+    multimap_type mm("bulk_multimap.btr");
+    multimap_type mm2(mm.begin(), mm.end(), "bulk_multimap_copy.btr",
+      btree::flags::truncate, -1, btree::less(), 128);
+    BOOST_TEST(mm2.size() == mm.size());
+    BOOST_TEST(std::equal(mm2.begin(), mm2.end(), mm.begin()));
+  }
+
+  //  input that is not sorted, found after several leaves were filled, leaves the
+  //  tree empty
+  {
+    set_type bt("bulk_unsorted.btr", btree::flags::truncate, -1, btree::less(), 128);
+    bt.max_cache_size(0);  // maximum stress
+    std::vector<fat> unsorted(v.begin(), v.begin() + 300);
+    unsorted.push_back(fat(-1));
+    bool threw = false;
+    try { bt.bulk_build(unsorted.begin(), unsorted.end()); }
+    catch (const std::runtime_error&) { threw = true; }
+    BOOST_TEST(threw);
+    BOOST_TEST(bt.empty());
+    BOOST_TEST(bt.begin() == bt.end());
+    BOOST_TEST_EQ(bt.header().leaf_node_count(), 1U);
+    BOOST_TEST_EQ(bt.header().branch_node_count(), 0U);
+  }
+  {
+    set_type bt("bulk_unsorted.btr", btree::flags::read_write, -1, btree::less(), 128);
+    BOOST_TEST(bt.empty());
+    BOOST_TEST(bt.begin() == bt.end());
+    BOOST_TEST_EQ(bt.header().first_node_id(), bt.header().last_node_id());
+    bt.bulk_build(v.begin(), v.end());  // the freed leaves are reused
+    BOOST_TEST_EQ(bt.size(), 1000U);
+    BOOST_TEST(std::equal(bt.begin(), bt.end(), std::set<fat>(v.begin(), v.end()).begin()));
+    BOOST_TEST_EQ(bt.header().node_count(), 1 + bt.header().leaf_node_count()
+      + bt.header().branch_node_count());
+  }
+
+  cout << "     bulk_build_test complete" << endl;
+}
+
+//-------------------------------  hinted_insert_test  ---------------------------------//
+
+void  hinted_insert_test()
+{
+  cout << "  hinted_insert_test..." << endl;
+
+  typedef btree::btree_set<fat> set_type;
+  typedef btree::btree_multimap<fat, int> multimap_type;
+
+  //  ascending insert_packed() reads the last leaf, and searches from the root only
+  //  when that leaf is full
+  {
+    set_type packed("hinted_packed.btr", btree::flags::truncate, -1, btree::less(), 128);
+    set_type plain("hinted_plain.btr", btree::flags::truncate, -1, btree::less(), 128);
+
+    uint64_t reads = packed.manager().cached_buffers_read();
+    for (int i = 0; i < 2000; ++i)
+    {
+      std::pair<set_type::const_iterator, bool> result = packed.insert_packed(fat(i));
+      BOOST_TEST(result.second);
+      BOOST_TEST_EQ(result.first->x, i);
+    }
+    reads = packed.manager().cached_buffers_read() - reads;
+
+    uint64_t plain_reads = plain.manager().cached_buffers_read();
+    for (int i = 0; i < 2000; ++i)
+      plain.insert(fat(i));
+    plain_reads = plain.manager().cached_buffers_read() - plain_reads;
+
+    BOOST_TEST(packed.header().levels() > 2);
+    BOOST_TEST(reads < plain_reads);
+    BOOST_TEST(packed.header().leaf_node_count() == plain.header().leaf_node_count());
+    BOOST_TEST(packed == plain);
+    BOOST_TEST(packed.inspect_leaf_to_root(cout, packed.last()));
+
+    //  out of order and duplicate values fall back to an ordinary insert
+    BOOST_TEST(!packed.insert_packed(fat(1000)).second);
+    BOOST_TEST(packed.insert_packed(fat(-1)).second);
+    BOOST_TEST_EQ(packed.begin()->x, -1);
+    BOOST_TEST_EQ(packed.size(), 2001U);
+  }
+
+  //  hints that are right, wrong, on leaf boundaries, and end()
+  {
+    set_type bt("hinted_set.btr", btree::flags::truncate, -1, btree::less(), 128);
+    bt.max_cache_size(0);  // maximum stress
+    std::set<int> stl;
+    for (int i = 0; i < 1000; i += 2)
+    {
+      bt.insert(bt.end(), fat(i));
+      stl.insert(i);
+    }
+
+    for (int i = 1; i < 1000; i += 2)
+    {
+      set_type::const_iterator hint;
+      switch (i % 7)
+      {
+        case 0: hint = bt.begin(); break;
+        case 1: hint = bt.end(); break;
+        case 2: hint = bt.last(); break;
+        default: hint = bt.lower_bound(fat(i));  // right
+      }
+      set_type::const_iterator it = bt.insert(hint, fat(i));
+      BOOST_TEST_EQ(it->x, i);
+      stl.insert(i);
+    }
+    BOOST_TEST_EQ(bt.insert(bt.lower_bound(fat(500)), fat(500))->x, 500);  // duplicate
+    BOOST_TEST_EQ(bt.size(), stl.size());
+    BOOST_TEST(std::equal(bt.begin(), bt.end(), stl.begin()));
+    for (int i = 0; i < 1000; i += 111)
+      BOOST_TEST(bt.find(fat(i)) != bt.end());
+    BOOST_TEST(bt.inspect_leaf_to_root(cout, bt.begin()));
+    BOOST_TEST(bt.inspect_leaf_to_root(cout, bt.last()));
+  }
+
+  //  non-unique keys
+  {
+    multimap_type bt("hinted_multimap.btr", btree::flags::truncate, -1,
+      btree::less(), 128);
+    std::multimap<int, int> stl;
+    for (int i = 0; i < 600; ++i)
+    {
+      bt.insert_packed(multimap_type::value_type(fat(i / 4), i));
+      stl.insert(std::make_pair(i / 4, i));
+    }
+    for (int i = 0; i < 300; ++i)
+    {
+      //  a hint into a range of equivalent keys inserts immediately before it
+      multimap_type::const_iterator hint = bt.upper_bound(fat(i % 150));
+      multimap_type::const_iterator it = bt.emplace_hint(hint, fat(i % 150), -i);
+      BOOST_TEST_EQ(it->first.x, i % 150);
+      BOOST_TEST_EQ(it->second, -i);
+      stl.insert(std::make_pair(i % 150, -i));
+    }
+    BOOST_TEST_EQ(bt.size(), stl.size());
+    std::multimap<int, int>::const_iterator stl_it = stl.begin();
+    for (multimap_type::const_iterator it = bt.begin(); it != bt.end(); ++it, ++stl_it)
+    {
+      BOOST_TEST_EQ(it->first.x, stl_it->first);
+      BOOST_TEST_EQ(it->second, stl_it->second);
+    }
+    for (int i = 0; i < 150; i += 7)
+      BOOST_TEST_EQ(bt.count(fat(i)), 6U);
+  }
+
+  cout << "     hinted_insert_test complete" << endl;
+}
+
 //----------------------  relational_non_member_functions_test  -------------------------//
 
 void  relational_non_member_functions_test()
@@ -1613,6 +3163,7 @@ int cpp_main(int argc, char* argv[])
   insert_and_erase_test();
   insert_non_unique();
   find_and_bounds();
+  node_search();
   relational_non_member_functions_test();
   erase_return_iterator_validity_test(0);    // starting at begin is special case, so
                                              // test explicitly. 
@@ -1620,6 +3171,14 @@ int cpp_main(int argc, char* argv[])
   erase_return_iterator_validity_test(190);  // start near end
   erase_return_iterator_validity_test(192);  // start at last element
   insert_unique_return_iterator_test();
+  hinted_insert_test();
+  bulk_build_test();
+  leaf_links_test();
+  rebalance_test();
+  compact_test();
+  node_allocation_test();
+  shrink_to_fit_test();
+  find_many_test();
   update_test();
   //iteration();
   //multi();
@@ -1629,6 +3188,14 @@ int cpp_main(int argc, char* argv[])
   reopen_btree_object_test();
   //fixstr();
   cache_size_test();
+  direct_io_test();
+  memory_map_test();
+  preload_cache_test();
+  persist_cache_test();
+  shared_cache_test();
+  cache_branches_test();
+  auto_cache_test();
+  huge_pages_test();
   
 
   //{
@@ -22,6 +22,7 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <vector>
 #include <cstring>
 
 using namespace boost::btree;
@@ -40,12 +41,11 @@ namespace
 
     buffer pg (1);
 
-    buffer_manager::buffers_type set;
+    buffer_manager::buffers_type table;
 
-    set.insert(pg);
-    BOOST_TEST(&*set.begin() == &pg);
-    //  buffer_manager logic relies on iterator_to working as expected:
-    BOOST_TEST(set.begin() == set.iterator_to(pg));
+    table.insert(pg);
+    BOOST_TEST(&*table.begin() == &pg);
+    BOOST_TEST(table.find(1) == &pg);
 
     buffer_manager::avail_buffers_type list;
 
@@ -54,10 +54,70 @@ namespace
     //  buffer_manager logic relies on iterator_to working as expected:
     BOOST_TEST(list.begin() == list.iterator_to(pg));
 
-    //  retest, just to be sure list.push_back() had no side effect on set.iterator_to()
-    BOOST_TEST(&*set.begin() == &pg);
-    BOOST_TEST(set.begin() == set.iterator_to(pg));
+    //  retest, just to be sure list.push_back() had no side effect on the table
+    BOOST_TEST(&*table.begin() == &pg);
+    BOOST_TEST(table.find(1) == &pg);
+
+  }
+
+//  buffer_table_test  -----------------------------------------------------------------//
 
+  void buffer_table_test()
+  {
+    cout << "buffer_table_test..." << endl;
+
+    const buffer::buffer_id_type n = 1000;
+    std::vector<buffer*> bufs;
+    for (buffer::buffer_id_type id = 0; id < n; ++id)
+      bufs.push_back(new buffer(id * 7));  // stride so ids are not simply dense
+
+    buffer_manager::buffers_type table;
+    BOOST_TEST(table.empty());
+    BOOST_TEST(!table.find(0));
+    BOOST_TEST(table.begin() == table.end());
+
+    for (buffer::buffer_id_type id = 0; id < n; ++id)
+      table.insert(*bufs[id]);
+    BOOST_TEST_EQ(table.size(), n);
+    BOOST_TEST(table.capacity() >= 2 * n);
+
+    bool all_found = true;
+    for (buffer::buffer_id_type id = 0; id < n; ++id)
+      all_found = all_found && table.find(id * 7) == bufs[id]
+        && !table.find(id * 7 + 1);
+    BOOST_TEST(all_found);
+
+    std::size_t count = 0;
+    for (buffer_manager::buffers_type::const_iterator it = table.begin();
+      it != table.end(); ++it)
+      ++count;
+    BOOST_TEST_EQ(count, n);
+
+    //  erase every other buffer; backward-shift deletion must keep the rest findable
+    for (buffer::buffer_id_type id = 0; id < n; id += 2)
+      table.erase(*bufs[id]);
+    BOOST_TEST_EQ(table.size(), n / 2);
+    all_found = true;
+    for (buffer::buffer_id_type id = 0; id < n; ++id)
+      all_found = all_found && table.find(id * 7) == (id % 2 ? bufs[id] : 0);
+    BOOST_TEST(all_found);
+
+    //  reinsert, then erase everything
+    for (buffer::buffer_id_type id = 0; id < n; id += 2)
+      table.insert(*bufs[id]);
+    BOOST_TEST_EQ(table.size(), n);
+    for (buffer::buffer_id_type id = 0; id < n; ++id)
+      table.erase(*bufs[id]);
+    BOOST_TEST(table.empty());
+    BOOST_TEST(table.begin() == table.end());
+
+    table.insert(*bufs[3]);
+    table.clear();
+    BOOST_TEST(table.empty());
+    BOOST_TEST(!table.find(3 * 7));
+
+    for (buffer::buffer_id_type id = 0; id < n; ++id)
+      delete bufs[id];
   }
 
 //  buffer_test  -------------------------------------------------------------------------//
@@ -319,6 +379,660 @@ namespace
     cout << f;
   }
 
+//  replacement_policy_test  ------------------------------------------------------------//
+
+  void replacement_policy_test(replacement::policy rp, bool scan_resistant)
+  {
+    cout << "replacement_policy_test, policy " << rp << "..." << endl;
+
+    fs::path test_path("buffer_manager");
+    fs::remove(test_path);
+    buffer_manager f;
+
+    const std::size_t cache_sz = 16;
+    const std::size_t hot_sz = 4;
+    const std::size_t file_sz = 200;
+
+    f.open(test_path, oflag::out, cache_sz, 128, rp);
+    BOOST_TEST(f.replacement_policy() == rp);
+    for (std::size_t i = 0; i < file_sz; ++i)
+      f.new_buffer();
+    f.flush();
+    BOOST_TEST(f.buffers_available() <= cache_sz);
+    f.close();
+
+    f.open(test_path, oflag::in, cache_sz, 128, rp);
+    f.data_size(128);
+    BOOST_TEST_EQ(f.buffer_count(), file_sz);
+
+    //  reference the hot set several times so it is recognized as hot
+    for (int pass = 0; pass < 3; ++pass)
+      for (buffer_manager::buffer_id_type id = 0; id < hot_sz; ++id)
+        f.read(id);
+    BOOST_TEST_EQ(f.file_buffers_read(), hot_sz);
+
+    //  a one-pass sequential scan of everything else
+    for (buffer_manager::buffer_id_type id = hot_sz; id < file_sz; ++id)
+      f.read(id);
+    BOOST_TEST_EQ(f.file_buffers_read(), file_sz);
+    BOOST_TEST(f.buffers_available() <= cache_sz);
+
+    //  re-reference the hot set
+    for (buffer_manager::buffer_id_type id = 0; id < hot_sz; ++id)
+      f.read(id);
+    if (scan_resistant)
+      BOOST_TEST_EQ(f.file_buffers_read(), file_sz);  // hot set survived the scan
+    else
+      BOOST_TEST_EQ(f.file_buffers_read(), file_sz + hot_sz);  // LRU flushed it
+    BOOST_TEST(f.buffers_available() <= cache_sz);
+    BOOST_TEST_EQ(f.buffers_in_memory(), f.buffers_available());
+    f.close();
+  }
+
+//  page_arena_test  --------------------------------------------------------------------//
+
+  void page_arena_test()
+  {
+    cout << "page_arena_test..." << endl;
+
+    detail::page_arena arena;
+    arena.frame_size(4096);
+    BOOST_TEST_EQ(arena.stride(), 4096U);
+    std::vector<char*> frames;
+    for (int i = 0; i < 100; ++i)  // enough to need several chunks
+    {
+      frames.push_back(arena.allocate());
+      BOOST_TEST_EQ(reinterpret_cast<std::size_t>(frames.back()) % 4096, 0U);
+      std::memset(frames.back(), i, 4096);
+    }
+    BOOST_TEST_EQ(arena.frames_allocated(), 100U);
+    for (int i = 0; i < 100; ++i)  // frames must not overlap
+      BOOST_TEST(frames[i][0] == char(i) && frames[i][4095] == char(i));
+    arena.clear();
+    BOOST_TEST_EQ(arena.frames_allocated(), 0U);
+
+    arena.frame_size(5000);
+    BOOST_TEST_EQ(arena.stride(), 8192U);
+    BOOST_TEST_EQ(reinterpret_cast<std::size_t>(arena.allocate()) % 4096, 0U);
+    arena.clear();
+
+    arena.frame_size(100);  // small frames are aligned to their power of two size
+    BOOST_TEST_EQ(arena.stride(), 128U);
+    char* p0 = arena.allocate();
+    char* p1 = arena.allocate();
+    BOOST_TEST_EQ(reinterpret_cast<std::size_t>(p0) % 128, 0U);
+    BOOST_TEST_EQ(p1 - p0, 128);
+    arena.clear();
+
+    //  huge page chunks are 2 MiB multiples, whichever kind of memory backs them
+    detail::page_arena huge;
+    huge.huge_pages(true);
+    huge.frame_size(4096);
+    frames.clear();
+    for (int i = 0; i < 1200; ++i)  // more than one 2 MiB chunk
+    {
+      frames.push_back(huge.allocate());
+      BOOST_TEST_EQ(reinterpret_cast<std::size_t>(frames.back()) % 4096, 0U);
+      std::memset(frames.back(), i, 4096);
+    }
+    for (int i = 0; i < 1200; ++i)
+      BOOST_TEST(frames[i][0] == char(i) && frames[i][4095] == char(i));
+    BOOST_TEST(huge.chunk_count() >= 2U);
+    std::size_t chunk_bytes = 0;
+    for (std::size_t i = 0; i < huge.chunk_count(); ++i)
+    {
+      BOOST_TEST_EQ(huge.chunk(i).size % (2 * 1048576), 0U);
+      chunk_bytes += huge.chunk(i).size;
+    }
+    BOOST_TEST(huge.huge_page_bytes() == 0 || huge.huge_page_bytes() == chunk_bytes);
+    cout << "  huge page bytes: " << huge.huge_page_bytes() << endl;
+    huge.clear();
+    BOOST_TEST_EQ(huge.huge_page_bytes(), 0U);
+
+    //  evicted buffers are recycled rather than deleted and reallocated
+    fs::path test_path("buffer_manager");
+    fs::remove(test_path);
+    buffer_manager f;
+    f.open(test_path, oflag::out, 2, 4096);
+    for (int i = 0; i < 10; ++i)
+      f.new_buffer();
+    BOOST_TEST_EQ(reinterpret_cast<std::size_t>(f.read(0)->data()) % 4096, 0U);
+    {
+      std::vector<buffer_ptr> held;  // more in use than the cache holds
+      for (buffer_manager::buffer_id_type id = 0; id < 6; ++id)
+        held.push_back(f.read(id));
+    }
+    BOOST_TEST(f.buffers_spare() > 0U);
+    boost::uint64_t allocs = f.buffer_allocs();
+    std::size_t frames_allocated = f.frames_allocated();
+    {
+      std::vector<buffer_ptr> held;
+      for (buffer_manager::buffer_id_type id = 4; id < 10; ++id)
+        held.push_back(f.read(id));
+    }
+    BOOST_TEST_EQ(f.buffer_allocs(), allocs);
+    BOOST_TEST_EQ(f.frames_allocated(), frames_allocated);
+    f.close();
+  }
+
+//  coalesced_flush_test  ---------------------------------------------------------------//
+
+  void coalesced_flush_test()
+  {
+    cout << "coalesced_flush_test..." << endl;
+
+    fs::path test_path("buffer_manager");
+    fs::remove(test_path);
+    buffer_manager f;
+    f.open(test_path, oflag::out, 100, 128);
+    f.max_write_batch(4);
+    BOOST_TEST_EQ(f.max_write_batch(), 4U);
+
+    std::vector<buffer_ptr> bufs;
+    for (int i = 0; i < 10; ++i)
+    {
+      bufs.push_back(f.new_buffer());
+      std::memset(bufs.back()->data(), 'a' + i, 128);
+    }
+    BOOST_TEST(f.flush());
+    BOOST_TEST_EQ(f.file_buffers_written(), 10U);
+    BOOST_TEST_EQ(f.coalesced_writes(), 3U);  // ids 0-3, 4-7, 8-9
+    BOOST_TEST(!f.flush());
+
+    //  dirty ids 1, 2, 5, 7, 8, 9 form runs 1-2, 5, and 7-9
+    bufs[1]->needs_write(true); bufs[2]->needs_write(true); bufs[5]->needs_write(true);
+    bufs[9]->needs_write(true); bufs[7]->needs_write(true); bufs[8]->needs_write(true);
+    std::memset(bufs[8]->data(), 'z', 128);
+    BOOST_TEST(f.flush());
+    BOOST_TEST_EQ(f.file_buffers_written(), 16U);
+    BOOST_TEST_EQ(f.coalesced_writes(), 5U);
+    for (int i = 0; i < 10; ++i)
+      BOOST_TEST(!bufs[i]->needs_write());
+
+    bufs.clear();
+    f.close();
+
+    BOOST_TEST_EQ(fs::file_size(test_path), 10U * 128);
+    binary_file bf(test_path);
+    char page[128];
+    for (int i = 0; i < 10; ++i)
+    {
+      BOOST_TEST(bf.read_at(i * 128, page, 128));
+      BOOST_TEST_EQ(page[0], i == 8 ? 'z' : char('a' + i));
+      BOOST_TEST_EQ(page[127], i == 8 ? 'z' : char('a' + i));
+    }
+  }
+
+//  write_back_test  --------------------------------------------------------------------//
+
+  void write_back_test()
+  {
+    cout << "write_back_test..." << endl;
+
+    fs::path test_path("buffer_manager");
+    fs::remove(test_path);
+    buffer_manager f;
+    f.open(test_path, oflag::out, 8, 128);
+    BOOST_TEST(!f.write_back());
+    f.start_write_back(4);  // small, so backpressure is exercised
+    BOOST_TEST(f.write_back());
+
+    const int n = 200;
+    for (int round = 0; round < 3; ++round)
+    {
+      for (int i = 0; i < n; ++i)
+      {
+        buffer_ptr p = round ? f.read(i) : f.new_buffer();
+        if (round)
+          BOOST_TEST_EQ(p->data()[0], char(i + round - 1));  // prior round's value
+        std::memset(p->data(), char(i + round), 128);
+        p->needs_write(true);
+      }
+    }
+    BOOST_TEST_EQ(f.buffers_available(), 8U);
+    f.flush();
+    BOOST_TEST(f.file_buffers_written() >= boost::uint64_t(n));
+    f.stop_write_back();
+    BOOST_TEST(!f.write_back());
+    f.close();
+
+    BOOST_TEST_EQ(fs::file_size(test_path), n * 128U);
+    binary_file bf(test_path);
+    char page[128];
+    for (int i = 0; i < n; ++i)
+    {
+      BOOST_TEST(bf.read_at(i * 128, page, 128));
+      BOOST_TEST_EQ(page[0], char(i + 2));
+      BOOST_TEST_EQ(page[127], char(i + 2));
+    }
+  }
+
+//  async_io_flush_test  ----------------------------------------------------------------//
+
+  void async_io_flush_test()
+  {
+    cout << "async_io_flush_test..." << endl;
+
+    fs::path test_path("buffer_manager");
+    fs::remove(test_path);
+    buffer_manager f;
+    f.open(test_path, oflag::out, 200, 128);
+    f.max_write_batch(4);
+    BOOST_TEST(!f.async_io());
+    f.start_async_io(2);  // shallower than the number of writes
+    BOOST_TEST(f.async_io());
+
+    std::vector<buffer_ptr> bufs;
+    for (int i = 0; i < 30; ++i)
+    {
+      bufs.push_back(f.new_buffer());
+      std::memset(bufs.back()->data(), 'a' + i, 128);
+    }
+    BOOST_TEST(f.flush());
+    BOOST_TEST_EQ(f.file_buffers_written(), 30U);
+    BOOST_TEST_EQ(f.coalesced_writes(), 8U);  // 7 runs of 4, 1 run of 2
+    BOOST_TEST(!f.flush());
+
+    bufs[3]->needs_write(true);
+    bufs[29]->needs_write(true);
+    std::memset(bufs[29]->data(), 'z', 128);
+    BOOST_TEST(f.flush());
+    BOOST_TEST_EQ(f.file_buffers_written(), 32U);
+    BOOST_TEST_EQ(f.coalesced_writes(), 8U);
+    for (int i = 0; i < 30; ++i)
+      BOOST_TEST(!bufs[i]->needs_write());
+
+    bufs.clear();
+    f.close();
+    BOOST_TEST(!f.async_io());
+
+    BOOST_TEST_EQ(fs::file_size(test_path), 30U * 128);
+    binary_file bf(test_path);
+    char page[128];
+    for (int i = 0; i < 30; ++i)
+    {
+      BOOST_TEST(bf.read_at(i * 128, page, 128));
+      BOOST_TEST_EQ(page[0], i == 29 ? 'z' : char('a' + i));
+      BOOST_TEST_EQ(page[127], i == 29 ? 'z' : char('a' + i));
+    }
+  }
+
+//  direct_io_test  ---------------------------------------------------------------------//
+
+  void direct_io_test()
+  {
+    cout << "direct_io_test..." << endl;
+
+    fs::path test_path("buffer_manager");
+    fs::remove(test_path);
+    {
+      buffer_manager f;
+      f.open(test_path, oflag::out | oflag::direct, 2, 4096);
+      cout << "  direct: " << f.direct() << endl;
+      char hdr[100];
+      std::memset(hdr, 'h', sizeof(hdr));
+      buffer_ptr p0 = f.new_buffer();  // buffer 0 holds the header
+      for (int i = 1; i < 8; ++i)
+      {
+        buffer_ptr p = f.new_buffer();
+        std::memset(p->data(), 'a' + i, 4096);
+      }
+      f.flush();
+      f.write_header(hdr, sizeof(hdr));
+      p0.reset();
+      f.close();
+    }
+    BOOST_TEST_EQ(fs::file_size(test_path), 8U * 4096);
+    {
+      buffer_manager f;
+      BOOST_TEST(f.open(test_path, oflag::in | oflag::direct));
+      char hdr[100] = "";
+      BOOST_TEST(f.read_header(hdr, sizeof(hdr)));
+      BOOST_TEST_EQ(hdr[0], 'h');
+      BOOST_TEST_EQ(hdr[99], 'h');
+      f.data_size(4096);
+      for (int i = 7; i > 0; --i)
+      {
+        buffer_ptr p = f.read(i);
+        BOOST_TEST_EQ(p->data()[0], char('a' + i));
+        BOOST_TEST_EQ(p->data()[4095], char('a' + i));
+      }
+      f.close();
+    }
+
+    buffer_manager f;
+    fs::remove(test_path);
+    f.open(test_path, oflag::out | oflag::direct, 2, 4096);
+    if (f.direct())  // unaligned data sizes are rejected
+    {
+      f.close();
+      fs::remove(test_path);
+      bool thrown = false;
+      try { f.open(test_path, oflag::out | oflag::direct, 2, 128); }
+      catch (const buffer_manager_error&) { thrown = true; }
+      BOOST_TEST(thrown);
+      BOOST_TEST(!f.is_open());
+    }
+  }
+
+//  cache_state_test  -------------------------------------------------------------------//
+
+  void cache_state_test(replacement::policy policy)
+  {
+    cout << "cache_state_test, policy " << policy << "..." << endl;
+
+    fs::path test_path("buffer_manager");
+    fs::path state_path("buffer_manager.hotset");
+    fs::remove(test_path);
+    std::vector<buffer_manager::buffer_id_type> saved;
+    {
+      buffer_manager f;
+      f.open(test_path, oflag::out, 100, 128, policy);
+      for (int i = 0; i < 64; ++i)
+        std::memset(f.new_buffer()->data(), i, 128);
+      f.flush();
+      f.clear_cache();
+      f.max_cache_size(8);
+      for (int i = 60; i >= 0; i -= 6)   // 60, 54, ... 0; only the last 8 stay cached
+        f.read(i);
+      BOOST_TEST_EQ(f.buffers_available(), 8U);
+      buffer_ptr held = f.read(3);       // in use, so most recently used
+      boost::system::error_code ec;
+      f.save_cache_state(state_path, ec);
+      BOOST_TEST(!ec);
+      BOOST_TEST_EQ(fs::file_size(state_path), 24U + 8 * 4);  // 3 displaced 42
+      held.reset();
+      f.close();
+    }
+    {
+      buffer_manager f;
+      BOOST_TEST(f.open(test_path, oflag::in, 100, 128, policy));
+      f.data_size(128);
+      f.max_cache_size(5);
+      boost::system::error_code ec;
+      BOOST_TEST_EQ(f.restore_cache_state(state_path, ec), 5U);
+      BOOST_TEST(!ec);
+      BOOST_TEST_EQ(f.buffers_available(), 5U);
+      BOOST_TEST_EQ(f.file_buffers_read(), 5U);
+      for (int i = 0; i <= 18; i += 6)  // the four most recently read, plus 3
+        BOOST_TEST(f.in_memory(i));
+      BOOST_TEST(f.in_memory(3));
+      BOOST_TEST(!f.in_memory(24));
+      BOOST_TEST_EQ(f.read(18)->data()[0], 18);
+      BOOST_TEST_EQ(f.file_buffers_read(), 5U);
+
+      f.max_cache_size(100);
+      BOOST_TEST_EQ(f.restore_cache_state("no-such-file", ec), 0U);
+      BOOST_TEST(ec);
+
+      //  a count that disagrees with the file size, as from a damaged or truncated
+      //  file, is rejected before anything is allocated for it
+      fs::resize_file(state_path, 24U + 7 * 4);
+      BOOST_TEST_EQ(f.restore_cache_state(state_path, ec), 0U);
+      BOOST_TEST(ec == boost::system::errc::invalid_argument);
+      {
+        binary_file sf(state_path, oflag::out);
+        boost::uint32_t huge_count = 0xffffffffU;
+        sf.write_at(12, huge_count);
+      }
+      fs::resize_file(state_path, 24U + 8 * 4);
+      BOOST_TEST_EQ(f.restore_cache_state(state_path, ec), 0U);
+      BOOST_TEST(ec == boost::system::errc::invalid_argument);
+      fs::remove(state_path);
+      f.close();
+    }
+  }
+
+  //  shared_pool_test  -----------------------------------------------------------------//
+
+  void shared_pool_test()
+  {
+    cout << "shared_pool_test..." << endl;
+
+    fs::path a_path("buffer_manager");
+    fs::path b_path("buffer_manager_2");
+    buffer_pool pool(8 * 128);  // declared first, so destroyed after the managers
+    buffer_manager a, b;
+    a.pool(&pool);
+    b.pool(&pool);
+    BOOST_TEST_EQ(pool.managers(), 2U);
+    a.open(a_path, oflag::out | oflag::truncate, 100, 128);
+    b.open(b_path, oflag::out | oflag::truncate, 100, 128);
+
+    for (int i = 0; i < 16; ++i)
+      std::memset(a.new_buffer()->data(), i, 128);
+    BOOST_TEST_EQ(pool.buffers_available(), 8U);
+    BOOST_TEST_EQ(pool.available_bytes(), 8U * 128);
+    BOOST_TEST_EQ(a.buffers_available(), 8U);
+    BOOST_TEST_EQ(pool.evictions(), 8U);
+
+    //  b becomes the busy file, so takes all of a's memory
+    for (int i = 0; i < 16; ++i)
+      std::memset(b.new_buffer()->data(), 100 + i, 128);
+    BOOST_TEST_EQ(a.buffers_available(), 0U);
+    BOOST_TEST_EQ(b.buffers_available(), 8U);
+    BOOST_TEST_EQ(a.buffers_in_memory(), 0U);
+    BOOST_TEST_EQ(pool.evictions(), 24U);
+    BOOST_TEST_EQ(pool.frames_allocated(), 8U);  // frames moved, not allocated
+    BOOST_TEST_EQ(pool.frames_free(), 0U);
+    BOOST_TEST_EQ(a.file_buffers_written(), 16U);  // dirty buffers written on eviction
+
+    BOOST_TEST_EQ(a.read(3)->data()[0], 3);
+    BOOST_TEST_EQ(a.file_buffers_read(), 1U);
+    BOOST_TEST_EQ(b.read(15)->data()[0], 100 + 15);
+    BOOST_TEST_EQ(b.file_buffers_read(), 0U);
+    BOOST_TEST_EQ(b.buffers_available(), 7U);
+
+    a.close();
+    BOOST_TEST(!a.pool());
+    BOOST_TEST_EQ(pool.managers(), 1U);
+    BOOST_TEST_EQ(pool.buffers_available(), 7U);
+    BOOST_TEST_EQ(pool.frames_free(), 1U);
+
+    pool.max_bytes(2 * 128);
+    BOOST_TEST_EQ(b.read(0)->data()[0], 100);
+    BOOST_TEST_EQ(pool.buffers_available(), 2U);
+    b.close();
+    BOOST_TEST_EQ(pool.managers(), 0U);
+    BOOST_TEST_EQ(pool.frames_free(), pool.frames_allocated());
+    fs::remove(b_path);
+  }
+
+  //  priority_test  --------------------------------------------------------------------//
+
+  unsigned first_byte_priority(const buffer& buf)  { return buf.data()[0]; }
+
+  void priority_test()
+  {
+    cout << "priority_test..." << endl;
+
+    fs::path test_path("buffer_manager");
+    buffer_manager f;
+    f.open(test_path, oflag::out | oflag::truncate, 100, 128);
+    for (int i = 0; i < 32; ++i)   // 0-3 priority 2, 4-11 priority 1, others none
+      std::memset(f.new_buffer()->data(), i < 4 ? 2 : i < 12 ? 1 : 0, 128);
+    f.flush();
+    f.clear_cache();
+    f.max_cache_size(10);
+    f.priority_function(first_byte_priority);
+    BOOST_TEST_EQ(f.max_priority_percent(), 50U);
+
+    for (int i = 0; i < 32; ++i)
+      f.read(i);
+    //  prioritized buffers keep 5 of the 10 places, the highest priorities first
+    BOOST_TEST_EQ(f.buffers_available(), 10U);
+    BOOST_TEST_EQ(f.priority_buffers_available(), 5U);
+    for (int i = 0; i < 4; ++i)
+      BOOST_TEST(f.in_memory(i));
+    BOOST_TEST(f.in_memory(11));   // the most recently used priority 1 buffer
+    BOOST_TEST(!f.in_memory(10));
+    for (int i = 27; i < 32; ++i)
+      BOOST_TEST(f.in_memory(i));
+    BOOST_TEST(!f.in_memory(26));
+
+    //  without a share, prioritized buffers go first, lowest priority first
+    f.max_priority_percent(0);
+    f.read(26);
+    BOOST_TEST(!f.in_memory(11));
+    f.read(25);
+    BOOST_TEST(!f.in_memory(0));
+    BOOST_TEST(f.in_memory(1));
+    BOOST_TEST_EQ(f.priority_buffers_available(), 3U);
+    f.close();
+  }
+
+  //  auto_size_test  -------------------------------------------------------------------//
+
+  void auto_size_test()
+  {
+    cout << "auto_size_test..." << endl;
+
+    boost::uint64_t available, limit;
+    if (memory_status(available, limit))
+    {
+      BOOST_TEST(limit > 0);
+      BOOST_TEST(available <= limit);
+    }
+
+    fs::path test_path("buffer_manager");
+    buffer_manager f;
+    f.open(test_path, oflag::out | oflag::truncate, 100, 128);
+    for (int i = 0; i < 200; ++i)
+      f.new_buffer();
+    f.flush();
+    f.clear_cache();
+    f.max_cache_size(8);
+    f.auto_size(8, 100);
+    BOOST_TEST(f.auto_size());
+    const std::size_t interval = buffer_manager::auto_size_interval;
+
+    //  cycling through 64 buffers misses every time with 8 cached, so the cache grows
+    for (std::size_t i = 0; i < 8 * interval; ++i)
+      f.read(i % 64);
+    BOOST_TEST(f.cache_grows() >= 4U);
+    BOOST_TEST(f.max_cache_size() >= 48U);  // hovers about the 64 the cycle needs
+    BOOST_TEST(f.max_cache_size() <= 100U);
+
+    //  a working set of 4 buffers always hits, so the cache shrinks to the minimum
+    for (std::size_t i = 0; i < 64 * interval; ++i)
+      f.read(i % 4);
+    BOOST_TEST_EQ(f.max_cache_size(), 8U);
+    BOOST_TEST(f.buffers_available() <= 8U);
+    BOOST_TEST(f.cache_shrinks() > 0U);
+
+    f.stop_auto_size();
+    BOOST_TEST(!f.auto_size());
+    f.close();
+  }
+
+//  truncate_test  ----------------------------------------------------------------------//
+
+  void truncate_test()
+  {
+    cout << "truncate_test..." << endl;
+
+    fs::path test_path("buffer_manager");
+    buffer_manager f;
+    f.open(test_path, oflag::out | oflag::truncate, 16, 128);
+    for (int i = 0; i < 10; ++i)
+      std::memset(f.new_buffer()->data(), 'a' + i, 128);
+    f.flush();
+
+    {
+      buffer_ptr keep = f.read(5);
+      buffer_ptr dirty = f.read(8);
+      dirty->needs_write(true);
+      BOOST_TEST(f.in_use(5));
+      BOOST_TEST(f.in_use(8));
+      BOOST_TEST(!f.in_use(9));
+    }
+    BOOST_TEST(!f.in_use(8));
+    BOOST_TEST(f.in_memory(8));
+
+    //  buffers beyond the cut leave the cache without being written
+    boost::uint64_t written = f.file_buffers_written();
+    f.truncate(6);
+    BOOST_TEST_EQ(f.buffer_count(), 6U);
+    BOOST_TEST_EQ(fs::file_size(test_path), 6U * 128U);
+    BOOST_TEST(!f.in_memory(8));
+    BOOST_TEST(!f.in_memory(9));
+    BOOST_TEST(f.in_memory(5));
+    BOOST_TEST_EQ(f.file_buffers_written(), written);
+    BOOST_TEST_EQ(f.read(5)->data()[0], 'f');
+
+    //  the next new buffer takes the first id past the cut
+    buffer_ptr pp = f.new_buffer();
+    BOOST_TEST_EQ(pp->buffer_id(), 6U);
+    BOOST_TEST_EQ(pp->data()[0], 0);
+    pp.reset();
+
+    //  overwrite() of a buffer not in memory zero fills instead of reading
+    f.flush();
+    f.clear_cache();
+    boost::uint64_t reads = f.file_buffers_read();
+    pp = f.overwrite(2);
+    BOOST_TEST_EQ(f.file_buffers_read(), reads);
+    BOOST_TEST(pp->needs_write());
+    BOOST_TEST_EQ(pp->data()[0], 0);
+    std::memset(pp->data(), 'z', 128);
+    pp.reset();
+    f.flush();
+    f.clear_cache();
+    BOOST_TEST_EQ(f.read(2)->data()[0], 'z');
+    BOOST_TEST_EQ(f.read(3)->data()[0], 'd');
+
+    //  overwrite() of a buffer in memory returns it, contents intact
+    pp = f.overwrite(3);
+    BOOST_TEST(pp->needs_write());
+    BOOST_TEST_EQ(pp->data()[0], 'd');
+    pp.reset();
+    f.close();
+  }
+
+//  orphaned_buffer_test  ---------------------------------------------------------------//
+
+  void orphaned_buffer_test()
+  {
+    cout << "orphaned_buffer_test..." << endl;
+
+    //  a buffer_ptr, and any pointer into its data, stays valid after close()
+    fs::path test_path("buffer_manager");
+    buffer_ptr held;
+    const char* data;
+    {
+      buffer_manager f;
+      f.open(test_path, oflag::out | oflag::truncate, 2, 128);
+      for (int i = 0; i < 10; ++i)
+        std::memset(f.new_buffer()->data(), i, 128);
+      held = f.read(7);
+      data = held->data();
+      f.close();
+      BOOST_TEST(!held->manager());
+    }
+    BOOST_TEST(held->data() == data);
+    BOOST_TEST_EQ(data[0], 7);
+    BOOST_TEST_EQ(data[127], 7);
+    held.reset();
+
+    //  likewise if the frame came from a pool, even once the pool is gone
+    {
+      buffer_pool pool(4 * 128);
+      buffer_manager f;
+      f.pool(&pool);
+      f.open(test_path, oflag::in);
+      f.data_size(128);
+      held = f.read(3);
+      data = held->data();
+      f.close();
+      BOOST_TEST_EQ(pool.frames_free(), pool.frames_allocated() - 1);
+    }
+    BOOST_TEST(held->data() == data);
+    BOOST_TEST_EQ(data[0], 3);
+    BOOST_TEST_EQ(data[127], 3);
+    held.reset();
+    fs::remove(test_path);
+  }
+
 } // unnamed namespace
 
 //  cpp_main  --------------------------------------------------------------------------//
@@ -326,12 +1040,28 @@ namespace
 int cpp_main(int argc, char * argv[])
 {
   iterator_to_test();
+  buffer_table_test();
   buffer_test();
 //  buffer_ptr_test();
   open_new_file_test();
   open_existing_file_test();
   new_buffer_test();
   existing_buffer_test();
+  replacement_policy_test(replacement::lru, false);
+  replacement_policy_test(replacement::two_queue, true);
+  replacement_policy_test(replacement::clock_pro, true);
+  page_arena_test();
+  coalesced_flush_test();
+  write_back_test();
+  async_io_flush_test();
+  direct_io_test();
+  cache_state_test(replacement::lru);
+  cache_state_test(replacement::two_queue);
+  shared_pool_test();
+  priority_test();
+  auto_size_test();
+  truncate_test();
+  orphaned_buffer_test();
 
   cout << "all tests complete" << endl;
 
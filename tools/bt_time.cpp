@@ -22,6 +22,8 @@
 #include <string>
 #include <map>
 #include <set>
+#include <vector>
+#include <iterator>
 #include <cstring>
 #include <cstdlib>  // for atoll() or Microsoft equivalent
 #include <cctype>   // for isdigit()
@@ -48,6 +50,7 @@ namespace
   int64_t lg = 0;   // if != 0, log every lg iterations
   std::size_t cache_sz = -2;
   std::size_t node_sz = btree::default_node_size;
+  std::size_t batch_sz = 0;  // if != 0, find test looks up keys batch_sz at a time
   char thou_separator = ',';
   int min_string_len = 0;
   int max_string_len = 512;
@@ -55,6 +58,7 @@ namespace
   bool do_preload (false);
   bool do_insert (true);
   bool do_pack (false);
+  bool do_compact (false);
   bool do_find (true);
   bool do_iterate (true);
   bool do_erase (true);
@@ -95,6 +99,91 @@ namespace
     t.resume();
   }
 
+  //  copy the elements of from into the empty btree to
+
+  template <class BT>
+  void pack_copy(BT& to, const BT& from)
+  {
+    to.bulk_build(from.begin(), from.end());
+  }
+
+  //  an index set has no bulk_build(), as each element is pushed onto its flat file
+  template <class Key, class Traits, class Compare>
+  void pack_copy(btree::btree_index_set<Key,Traits,Compare>& to,
+    const btree::btree_index_set<Key,Traits,Compare>& from)
+  {
+    typedef btree::btree_index_set<Key,Traits,Compare> index_type;
+    for (typename index_type::const_iterator it = from.begin(); it != from.end(); ++it)
+      to.insert(*it);
+  }
+
+  //  compact bt in place, and report how its leaves changed
+
+  template <class BT>
+  void compact(BT& bt)
+  {
+    bt.compact();
+    const btree::compact_stats& s = bt.compaction_stats();
+    cout << "  leaves " << s.leaves_before << " -> " << s.leaves_after
+         << ", fill " << s.fill_before << "% -> " << s.fill_after
+         << "%, sequential " << s.sequential_before << "% -> " << s.sequential_after
+         << "%, nodes " << s.nodes_before << " -> " << s.nodes_after << endl;
+  }
+
+  //  an index set does not expose its btree for compaction
+  template <class Key, class Traits, class Compare>
+  void compact(btree::btree_index_set<Key,Traits,Compare>&)
+  {
+    cout << "  not supported for btree_index_set" << endl;
+  }
+
+  //  find the keys of batch, each of which must be present
+
+  template <class BT>
+  void find_batch(const BT& bt, const std::vector<typename BT::key_type>& batch)
+  {
+    std::vector<typename BT::const_iterator> found;
+    found.reserve(batch.size());
+    bt.find_many(batch.begin(), batch.end(), std::back_inserter(found));
+#   if !defined(NDEBUG)
+    for (std::size_t i = 0; i < batch.size(); ++i)
+    {
+      if (found[i] == bt.end())
+        throw std::runtime_error("btree find_many() returned end()");
+      if (bt.key(*found[i]) != batch[i])
+        throw std::runtime_error("btree find_many() returned wrong iterator");
+    }
+#   endif
+  }
+
+  template <class BT>
+  std::size_t find_batch_size(const BT&)  { return batch_sz; }
+
+  //  an index set has no find_many(), so its keys are found one at a time, and its
+  //  find_batch() is never called; batched string_view keys would also all view the
+  //  generator's reused string
+  template <class Key, class Traits, class Compare>
+  std::size_t find_batch_size(const btree::btree_index_set<Key,Traits,Compare>&)
+    { return 0; }
+  template <class Key, class Traits, class Compare>
+  void find_batch(const btree::btree_index_set<Key,Traits,Compare>&,
+    const std::vector<Key>&) {}
+
+  template <class BT, class Generator>
+  timer::nanosecond_type find_pass(const BT& bt, Generator& generator)
+  //  wall clock time to find the n keys again, once the cache has been warmed
+  {
+    generator.seed(seed);
+    for (int64_t i = 1; i <= n; ++i)
+      bt.find(generator.key());
+    generator.seed(seed);
+    timer::cpu_timer t;
+    for (int64_t i = 1; i <= n; ++i)
+      bt.find(generator.key());
+    t.stop();
+    return t.elapsed().wall;
+  }
+
   //------------------------------------------------------------------------------------//
   //     abstract away differences in value_type and random value generation            //
   //------------------------------------------------------------------------------------//
@@ -239,10 +328,7 @@ namespace
         bt_old.max_cache_size(cache_sz);
         BT bt_new(path, btree::flags::truncate, -1, btree::less(), node_sz);
         bt_new.max_cache_size(cache_sz);
-        for (typename BT::const_iterator it = bt_old.begin(); it != bt_old.end(); ++it)
-        {
-          bt_new.insert(*it);
-        }
+        pack_copy(bt_new, bt_old);
         bt_new.flush();
         cout << "  bt_old.size() " << bt_old.size() << std::endl;
         cout << "  bt_new.size() " << bt_new.size() << std::endl;
@@ -266,6 +352,22 @@ namespace
         bt.max_cache_size(cache_sz);
       }
 
+      if (do_compact)
+      {
+        cout << "\ncompacting btree..." << endl;
+        bt.manager().clear_statistics();
+        t.start();
+        compact(bt);
+        bt.flush();
+        t.report();
+        cout << endl;
+        cout << path << " file size: " << fs::file_size(path) << '\n';
+        if (header_info)
+          cout << bt;
+        if (buffer_stats)
+          cout << bt.manager();
+      }
+
       if (do_find)
       {
         cout << "\nfinding " << n << " btree elements..." << endl;
@@ -273,6 +375,7 @@ namespace
         generator.seed(seed);
         typename BT::const_iterator itr;
         typename BT::key_type k;
+        std::vector<typename BT::key_type> batch;
         t.start();
         timer::cpu_times then = t.elapsed();
         for (int64_t i = 1; i <= n; ++i)
@@ -280,6 +383,16 @@ namespace
           if (lg && i % lg == 0)
             log(t, then, i, bt);
           k = generator.key();
+          if (find_batch_size(bt))
+          {
+            batch.push_back(k);
+            if (batch.size() == batch_sz || i == n)
+            {
+              find_batch(bt, batch);
+              batch.clear();
+            }
+            continue;
+          }
           itr = bt.find(k);
 #       if !defined(NDEBUG)
           if (itr == bt.end())
@@ -296,6 +409,23 @@ namespace
           cout << bt;
         if (buffer_stats)
           cout << bt.manager();
+
+        if (common_flags & btree::flags::huge_pages)
+        {
+          cout << "\ncomparing find throughput with and without huge pages..." << endl;
+          bt.flush();
+          timer::nanosecond_type huge_tm = find_pass(bt, generator);
+          BT bt_normal(path, btree::flags::read_only
+            | (common_flags & ~btree::flags::huge_pages), -1, btree::less(), node_sz);
+          bt_normal.max_cache_size(cache_sz);
+          timer::nanosecond_type normal_tm = find_pass(bt_normal, generator);
+          if (huge_tm && normal_tm)
+            cout << "  huge pages: " << n / (huge_tm / sec) << " finds per sec, "
+                 << bt.manager().huge_page_bytes() << " bytes of huge pages\n"
+                 << "  normal pages: " << n / (normal_tm / sec) << " finds per sec\n"
+                 << "  huge page throughput difference: "
+                 << (normal_tm * 100.0) / huge_tm - 100.0 << "%\n";
+        }
       }
 
       if (do_iterate)
@@ -600,6 +730,16 @@ int cpp_main(int argc, char * argv[])
         buffer_stats = false;
       else if ( strcmp( argv[2]+1, "cache-branches" )==0 )
         common_flags |= btree::flags::cache_branches;
+      else if ( strcmp( argv[2]+1, "write-back" )==0 )
+        common_flags |= btree::flags::write_back;
+      else if ( strcmp( argv[2]+1, "async-io" )==0 )
+        common_flags |= btree::flags::async_io;
+      else if ( strcmp( argv[2]+1, "direct-io" )==0 )
+        common_flags |= btree::flags::direct_io;
+      else if ( strcmp( argv[2]+1, "auto-cache" )==0 )
+        common_flags |= btree::flags::auto_cache;
+      else if ( strcmp( argv[2]+1, "huge-pages" )==0 )
+        common_flags |= btree::flags::huge_pages;
       else if ( memcmp( argv[2]+1, "seed=", 5 )==0 && std::isdigit(*(argv[2]+6)) )
         seed = BOOST_BTREE_ATOLL( argv[2]+6 );
       else if ( memcmp( argv[2]+1, "node-sz=", 8 )==0 && std::isdigit(*(argv[2]+9)) )
@@ -611,6 +751,10 @@ int cpp_main(int argc, char * argv[])
         lg = BOOST_BTREE_ATOLL( argv[2]+5 );
       else if ( strcmp( argv[2]+1, "pack" )==0 )
         do_pack = true;
+      else if ( strcmp( argv[2]+1, "compact" )==0 )
+        do_compact = true;
+      else if ( memcmp( argv[2]+1, "batch=", 6 )==0 && std::isdigit(*(argv[2]+7)) )
+        batch_sz = atoi( argv[2]+7 );
       else if ( memcmp( argv[2]+1, "sep=", 4 )==0
           && (std::ispunct(*(argv[2]+5)) || *(argv[2]+5)== '\0') )
         thou_separator = *(argv[2]+5) ? *(argv[2]+5) : ' ';
@@ -636,6 +780,12 @@ int cpp_main(int argc, char * argv[])
         common_flags |= btree::flags::fast;
       else if ( strcmp( argv[2]+1, "hint=fastest" )==0 )
         common_flags |= btree::flags::fastest;
+      else if ( strcmp( argv[2]+1, "policy=lru" )==0 )
+        common_flags |= btree::flags::lru;
+      else if ( strcmp( argv[2]+1, "policy=two-queue" )==0 )
+        common_flags |= btree::flags::two_queue;
+      else if ( strcmp( argv[2]+1, "policy=clock-pro" )==0 )
+        common_flags |= btree::flags::clock_pro;
       else
       {
         cout << "Error - unknown option: " << argv[2] << "\n\n";
@@ -664,18 +814,31 @@ int cpp_main(int argc, char * argv[])
       "   -nocreate    No create; use file from prior -xe run\n"
       "   -noinsert    No insert test; forces -nocreate and doesn't do inserts\n"
       "   -nofind      No find test\n"
+      "   -batch=#     Find test looks up # keys at a time with find_many()\n"
       "   -noiterate   No iterate test\n"
       "   -noerase     No erase test; use to save file intact\n"
       "   -nostats     No buffer statistics\n"
-      "   -cache-branches  Enable caching of all branch pages touched;\n"
-      "                      default is to let -hint determine branch caching\n"
+      "   -cache-branches  Keep branch pages cached in preference to leaves, within\n"
+      "                      half the cache; default is to let -hint decide\n"
+      "   -write-back  Write modified nodes in a background thread\n"
+      "   -async-io    Flush with queued asynchronous writes (io_uring on Linux)\n"
+      "   -direct-io   Bypass the operating system disk cache; node size must be a\n"
+      "                  multiple of 4096\n"
+      "   -auto-cache  Adjust the cache size from the hit ratio and memory pressure,\n"
+      "                  starting from -cache-sz or the -hint default\n"
+      "   -huge-pages  Cache nodes in huge pages where available; the find test\n"
+      "                  then reports the throughput difference from normal pages\n"
       "   -pack        Pack tree after insert test\n"
+      "   -compact     Compact tree in place after insert test\n"
       "   -v           Verbose output statistics\n"
       "   -stl         Also run the tests against std::map\n"
-      "   -preload     Read entire file to preload operating system disk cache;\n"
+      "   -preload     Read entire file to preload operating system disk cache,\n"
+      "                  then load the btree cache breadth-first from the root;\n"
       "                  only applicable if -nocreate option present\n"
       "   -hint=least-memory|low-memory|balanced|fast|fastest \n"
       "                  default is -hint=balanced\n"
+      "   -policy=lru|two-queue|clock-pro  Cache replacement policy;\n"
+      "                  default is -policy=lru\n"
       "   -big         Use btree::big_endian_traits; this is the default\n"
       "   -little      Use btree::little_endian_traits\n"
       "   -native      Use btree::native_traits\n"
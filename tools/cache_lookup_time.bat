@@ -0,0 +1,5 @@
+rem Times buffer_manager page lookup on large caches, where every node visit of every
+rem find() is a page table lookup. Run with builds before and after a buffer_manager
+rem change and compare the insert and find wall clock times.
+bin\bt_time 1000000 -hint=fastest -noerase -nostats
+bin\bt_time 100000000 -hint=fastest -noerase -nostats
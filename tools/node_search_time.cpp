@@ -0,0 +1,167 @@
+//  node_search_time.cpp  --------------------------------------------------------------//
+
+//  Copyright agent 2026
+
+//  Distributed under the Boost Software License, Version 1.0.
+//  http://www.boost.org/LICENSE_1_0.txt
+
+//  See http://www.boost.org/libs/btree for documentation.
+
+//  Times the search within a node, using the same code as btree lower_bound(), for each
+//  node search policy, several key types, and 4 KiB, 16 KiB, and 64 KiB nodes. Nodes are
+//  laid out as leaves are, filled with sorted keys, and enough of them are allocated
+//  that most searches start with a cache miss, as they do in a large btree.
+
+#include <boost/btree/detail/node_search.hpp>
+#include <boost/btree/support/string_holder.hpp>
+#include <boost/random.hpp>
+#include <boost/timer/timer.hpp>
+#include <boost/detail/lightweight_main.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>  // for atoll() or Microsoft equivalent
+#ifndef _MSC_VER
+# define BOOST_BTREE_ATOLL std::atoll
+#else
+# define BOOST_BTREE_ATOLL _atoi64
+#endif
+
+using namespace boost;
+using std::cout;
+using std::endl;
+using std::strcmp;
+
+namespace
+{
+  int64_t n = 1000000;                      // number of searches per test
+  std::size_t memory = 256 * 1024 * 1024;   // bytes of nodes
+  int64_t seed = 1;
+
+  //  key types  -----------------------------------------------------------------------//
+
+  //  Built-in arithmetic keys use the SIMD search regardless of policy, so only keys
+  //  that are not eligible for it are timed
+
+  struct udt  // as in a btree_set<udt>
+  {
+    int64_t x;
+    udt() {}
+    explicit udt(int64_t v) : x(v) {}
+    bool operator<(const udt& rhs) const { return x < rhs.x; }
+  };
+
+  typedef btree::string_holder<15> string_key;
+
+  template <class Key> Key make_key(int64_t v)  { return Key(v); }
+
+  template <> string_key make_key<string_key>(int64_t v)
+  {
+    char buf[24];
+    std::sprintf(buf, "%015lld", static_cast<long long>(v));  // lexical order is v order
+    return string_key(buf);
+  }
+
+  //  time  ----------------------------------------------------------------------------//
+
+  template <class Key, class Policy>
+  double time(const std::vector<Key>& nodes, std::size_t node_keys, std::size_t& sum)
+  // Returns: nanoseconds per search
+  {
+    std::size_t node_count = nodes.size() / node_keys;
+    mt19937  rng(static_cast<uint32_t>(seed));
+    uniform_int<std::size_t>  node_dist(0, node_count - 1);
+    uniform_int<int64_t>  key_dist(0, 2 * static_cast<int64_t>(node_keys));
+
+    //  generate the probes first, so that only the searches are timed
+    std::vector<std::pair<std::size_t, Key> > probes;
+    probes.reserve(static_cast<std::size_t>(n));
+    for (int64_t i = 0; i < n; ++i)
+      probes.push_back(std::make_pair(node_dist(rng) * node_keys,
+        make_key<Key>(key_dist(rng))));
+
+    //  the first pass takes the page faults; only the second is timed
+    timer::cpu_timer t;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+      t.start();
+      for (std::size_t i = 0; i < probes.size(); ++i)
+      {
+        const Key* first = &nodes[probes[i].first];
+        sum += btree::detail::node_lower_bound<btree::less, Policy>(first,
+          first + node_keys, first, probes[i].second, btree::less()) - first;
+      }
+      t.stop();
+    }
+    return static_cast<double>(t.elapsed().wall) / n;
+  }
+
+  template <class Key>
+  void test(const char* name, std::size_t node_sz)
+  {
+    std::size_t node_keys = node_sz / sizeof(Key);
+    std::size_t node_count = memory / node_sz;
+    if (node_count == 0)
+      node_count = 1;
+
+    //  odd keys only, so that half the searches are for keys that are not present
+    std::vector<Key> nodes;
+    nodes.reserve(node_count * node_keys);
+    for (std::size_t i = 0; i < node_count; ++i)
+      for (std::size_t j = 0; j < node_keys; ++j)
+        nodes.push_back(make_key<Key>(2 * static_cast<int64_t>(j) + 1));
+
+    std::size_t sum = 0;
+    double std_ns = time<Key, btree::std_node_search>(nodes, node_keys, sum);
+    double branchless_ns = time<Key, btree::branchless_node_search>(nodes, node_keys, sum);
+
+    cout << std::setw(10) << name << std::setw(8) << node_sz / 1024 << " KiB"
+         << std::setw(8) << node_keys
+         << std::setw(12) << std_ns
+         << std::setw(12) << branchless_ns
+         << std::setw(12) << (std_ns - branchless_ns) * 100.0 / std_ns << "%"
+         << (sum == 0 ? " " : "")  // keep sum live
+         << endl;
+  }
+}
+
+int cpp_main(int argc, char * argv[])
+{
+  for (; argc > 1; ++argv, --argc)
+  {
+    if ( std::strncmp( argv[1]+1, "n=", 2 )==0 )
+      n = BOOST_BTREE_ATOLL( argv[1]+3 );
+    else if ( std::strncmp( argv[1]+1, "mem=", 4 )==0 )
+      memory = static_cast<std::size_t>(BOOST_BTREE_ATOLL( argv[1]+5 )) * 1024 * 1024;
+    else if ( std::strncmp( argv[1]+1, "seed=", 5 )==0 )
+      seed = BOOST_BTREE_ATOLL( argv[1]+6 );
+    else
+    {
+      cout << "Error - unknown option: " << argv[1] << "\n\n"
+        "Usage: node_search_time [Options]\n"
+        " Options:\n"
+        "   -n=#         Number of searches per test; default -n=1000000\n"
+        "   -mem=#       MiB of nodes to search; default -mem=256\n"
+        "                  Use a small value, such as -mem=0, to time cached nodes\n"
+        "   -seed=#      Seed for random number generator; default -seed=1\n"
+        ;
+      return 1;
+    }
+  }
+
+  cout << std::fixed << std::setprecision(1)
+       << "nanoseconds per search, " << n << " searches, "
+       << memory / (1024 * 1024) << " MiB of nodes\n\n"
+       << "       key   node size    keys  std::lower  branchless  improvement\n";
+
+  const std::size_t node_sizes[] = { 4096, 16384, 65536 };
+  for (std::size_t i = 0; i < sizeof(node_sizes) / sizeof(node_sizes[0]); ++i)
+  {
+    test<udt>("udt", node_sizes[i]);
+    test<string_key>("string", node_sizes[i]);
+  }
+  return 0;
+}